@@ -11,6 +11,8 @@
 #include "Var.h"
 #include "probabilistic/BloomFilter.h"
 #include "probabilistic/CardinalityCounter.h"
+#include "probabilistic/CountMinSketch.h"
+#include "probabilistic/TDigest.h"
 
 #include <broker/data.hh>
 #include <broker/error.hh>
@@ -953,6 +955,185 @@ bool CardinalityVal::DoUnserialize(const broker::data& data)
 	return true;
 	}
 
+TDigestVal::TDigestVal() : OpaqueVal(tdigest_type)
+	{
+	d = nullptr;
+	}
+
+TDigestVal::TDigestVal(probabilistic::detail::TDigest* arg_d)
+	: OpaqueVal(tdigest_type)
+	{
+	d = arg_d;
+	}
+
+TDigestVal::~TDigestVal()
+	{
+	delete d;
+	}
+
+ValPtr TDigestVal::DoClone(CloneState* state)
+	{
+	return state->NewClone(this,
+			       make_intrusive<TDigestVal>(new probabilistic::detail::TDigest(*d)));
+	}
+
+IMPLEMENT_OPAQUE_VALUE(TDigestVal)
+
+broker::expected<broker::data> TDigestVal::DoSerialize() const
+	{
+	return d->Serialize();
+	}
+
+bool TDigestVal::DoUnserialize(const broker::data& data)
+	{
+	auto du = probabilistic::detail::TDigest::Unserialize(data);
+	if ( ! du )
+		return false;
+
+	d = du.release();
+	return true;
+	}
+
+CountMinVal::CountMinVal() : OpaqueVal(countmin_type)
+	{
+	hash = nullptr;
+	sketch = nullptr;
+	}
+
+CountMinVal::CountMinVal(probabilistic::detail::CountMinSketch* cm)
+	: OpaqueVal(countmin_type)
+	{
+	hash = nullptr;
+	sketch = cm;
+	}
+
+CountMinVal::~CountMinVal()
+	{
+	delete hash;
+	delete sketch;
+	}
+
+ValPtr CountMinVal::DoClone(CloneState* state)
+	{
+	auto cm = make_intrusive<CountMinVal>(new probabilistic::detail::CountMinSketch(*sketch));
+
+	if ( type )
+		cm->Typify(type);
+
+	return state->NewClone(this, std::move(cm));
+	}
+
+bool CountMinVal::Typify(TypePtr arg_type)
+	{
+	if ( type )
+		return false;
+
+	type = std::move(arg_type);
+
+	auto tl = make_intrusive<TypeList>(type);
+	tl->Append(type);
+	hash = new detail::CompositeHash(std::move(tl));
+
+	return true;
+	}
+
+void CountMinVal::Add(const Val* val, uint64_t count)
+	{
+	auto key = hash->MakeHashKey(*val, true);
+	sketch->Add(key.get(), count);
+	}
+
+uint64_t CountMinVal::Estimate(const Val* val) const
+	{
+	auto key = hash->MakeHashKey(*val, true);
+	return sketch->Estimate(key.get());
+	}
+
+void CountMinVal::Clear()
+	{
+	sketch->Clear();
+	}
+
+CountMinValPtr CountMinVal::Merge(const CountMinVal* x, const CountMinVal* y)
+	{
+	if ( x->Type() && // any one 0 is ok here
+	     y->Type() &&
+	     ! same_type(x->Type(), y->Type()) )
+		{
+		reporter->Error("cannot merge Count-Min sketches with different types");
+		return nullptr;
+		}
+
+	auto copy = new probabilistic::detail::CountMinSketch(*x->sketch);
+
+	if ( ! copy->Merge(*y->sketch) )
+		{
+		delete copy;
+		reporter->Error("cannot merge Count-Min sketches with different parameters");
+		return nullptr;
+		}
+
+	auto merged = make_intrusive<CountMinVal>(copy);
+	const auto& t = x->Type() ? x->Type() : y->Type();
+
+	if ( t && ! merged->Typify(t) )
+		{
+		reporter->Error("failed to set type on merged Count-Min sketch");
+		return nullptr;
+		}
+
+	return merged;
+	}
+
+IMPLEMENT_OPAQUE_VALUE(CountMinVal)
+
+broker::expected<broker::data> CountMinVal::DoSerialize() const
+	{
+	broker::vector d;
+
+	if ( type )
+		{
+		auto t = SerializeType(type);
+		if ( ! t )
+			return broker::ec::invalid_data;
+
+		d.emplace_back(std::move(*t));
+		}
+	else
+		d.emplace_back(broker::none());
+
+	auto cm = sketch->Serialize();
+	if ( ! cm )
+		return broker::ec::invalid_data;
+
+	d.emplace_back(std::move(*cm));
+	return {std::move(d)};
+	}
+
+bool CountMinVal::DoUnserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+
+	if ( ! (v && v->size() == 2) )
+		return false;
+
+	auto no_type = caf::get_if<broker::none>(&(*v)[0]);
+	if ( ! no_type )
+		{
+		auto t = UnserializeType((*v)[0]);
+
+		if ( ! (t && Typify(std::move(t))) )
+			return false;
+		}
+
+	auto cm = probabilistic::detail::CountMinSketch::Unserialize((*v)[1]);
+	if ( ! cm )
+		return false;
+
+	sketch = cm.release();
+	return true;
+	}
+
 ParaglobVal::ParaglobVal(std::unique_ptr<paraglob::Paraglob> p)
 : OpaqueVal(paraglob_type)
 	{
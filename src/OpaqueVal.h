@@ -16,6 +16,8 @@ namespace broker { class data; }
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(BloomFilter, zeek, probabilistic);
 ZEEK_FORWARD_DECLARE_NAMESPACED(CardinalityCounter, zeek, probabilistic, detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(TDigest, zeek, probabilistic, detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(CountMinSketch, zeek, probabilistic, detail);
 
 namespace zeek {
 
@@ -25,6 +27,9 @@ using OpaqueValPtr = IntrusivePtr<OpaqueVal>;
 class BloomFilterVal;
 using BloomFilterValPtr = IntrusivePtr<BloomFilterVal>;
 
+class CountMinVal;
+using CountMinValPtr = IntrusivePtr<CountMinVal>;
+
 /**
   * Singleton that registers all available all available types of opaque
   * values. This faciliates their serialization into Broker values.
@@ -365,6 +370,56 @@ private:
 	probabilistic::detail::CardinalityCounter* c;
 };
 
+class TDigestVal : public OpaqueVal {
+public:
+	explicit TDigestVal(probabilistic::detail::TDigest*);
+	~TDigestVal() override;
+
+	ValPtr DoClone(CloneState* state) override;
+
+	probabilistic::detail::TDigest* Get()	{ return d; };
+
+protected:
+	TDigestVal();
+
+	DECLARE_OPAQUE_VALUE(TDigestVal)
+private:
+	probabilistic::detail::TDigest* d;
+};
+
+class CountMinVal : public OpaqueVal {
+public:
+	explicit CountMinVal(probabilistic::detail::CountMinSketch* cm);
+	~CountMinVal() override;
+
+	ValPtr DoClone(CloneState* state) override;
+
+	const TypePtr& Type() const
+		{ return type; }
+
+	bool Typify(TypePtr type);
+
+	void Add(const Val* val, uint64_t count);
+	uint64_t Estimate(const Val* val) const;
+	void Clear();
+
+	static CountMinValPtr Merge(const CountMinVal* x,
+	                            const CountMinVal* y);
+
+protected:
+	CountMinVal();
+
+	DECLARE_OPAQUE_VALUE(CountMinVal)
+private:
+	// Disable.
+	CountMinVal(const CountMinVal&);
+	CountMinVal& operator=(const CountMinVal&);
+
+	TypePtr type;
+	detail::CompositeHash* hash;
+	probabilistic::detail::CountMinSketch* sketch;
+};
+
 class ParaglobVal : public OpaqueVal {
 public:
 	explicit ParaglobVal(std::unique_ptr<paraglob::Paraglob> p);
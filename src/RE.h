@@ -159,6 +159,9 @@ public:
 	// Returns the number of bytes feeded into the matcher so far
 	int Length()	{ return current_pos; }
 
+	// Returns true if the input so far can't lead to any further match.
+	bool Failed() const	{ return current_pos >= 0 && ! current_state; }
+
 	// Returns true if this inputs leads to at least one new match.
 	// If clear is true, starts matching over.
 	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
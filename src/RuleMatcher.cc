@@ -218,6 +218,17 @@ RuleFileMagicState::~RuleFileMagicState()
 		delete matcher->state;
 		delete matcher;
 		}
+
+	for ( auto bucket : bucket_matchers )
+		{
+		for ( auto matcher : *bucket )
+			{
+			delete matcher->state;
+			delete matcher;
+			}
+
+		delete bucket;
+		}
 	}
 
 RuleMatcher::RuleMatcher(int arg_RE_level)
@@ -227,6 +238,9 @@ RuleMatcher::RuleMatcher(int arg_RE_level)
 	RE_level = arg_RE_level;
 	parse_error = false;
 	has_non_file_magic_rule = false;
+
+	for ( auto& bucket : file_magic_dispatch )
+		bucket = FILE_MAGIC_ALL_CANDIDATES;
 	}
 
 RuleMatcher::~RuleMatcher()
@@ -236,6 +250,17 @@ RuleMatcher::~RuleMatcher()
 #endif
 	Delete(root);
 
+	for ( auto psets : file_magic_buckets )
+		{
+		for ( auto pset : *psets )
+			{
+			delete pset->re;
+			delete pset;
+			}
+
+		delete psets;
+		}
+
 	for ( auto rule : rules )
 		delete rule;
 	}
@@ -284,6 +309,7 @@ bool RuleMatcher::ReadFiles(const std::vector<std::string>& files)
 	string_list exprs[Rule::TYPES];
 	int_list ids[Rule::TYPES];
 	BuildRegEx(root, exprs, ids);
+	BuildFileMagicDispatch();
 
 	return ! parse_error;
 	}
@@ -469,6 +495,114 @@ void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 		}
 	}
 
+void RuleMatcher::BuildFileMagicDispatch()
+	{
+	// File magic patterns are only ever attached to the root.
+	string_list exprs;
+	int_list ids;
+
+	for ( const auto& set : root->psets[Rule::FILE_MAGIC] )
+		{
+		for ( const auto& pattern : set->patterns )
+			exprs.push_back(pattern);
+
+		ids.insert(ids.end(), set->ids.begin(), set->ids.end());
+		}
+
+	if ( exprs.length() == 0 )
+		return;
+
+	// Feed each pattern every possible first byte on its own. If its DFA
+	// survives that (or has accepted already), the pattern is a candidate
+	// for data starting with that byte. Magic signatures are mostly
+	// anchored at the beginning of the file, so typically only very few
+	// patterns remain candidates for any given byte.
+	std::vector<std::vector<bool>> candidates(256, std::vector<bool>(exprs.length()));
+
+	for ( int i = 0; i < exprs.length(); ++i )
+		{
+		string_list single_expr;
+		int_list single_id;
+		single_expr.push_back(exprs[i]);
+		single_id.push_back(ids[i]);
+
+		Specific_RE_Matcher re(MATCH_EXACTLY, 1);
+
+		if ( ! re.CompileSet(single_expr, single_id) )
+			{
+			// Can't tell, so stay conservative.
+			for ( int c = 0; c < 256; ++c )
+				candidates[c][i] = true;
+
+			continue;
+			}
+
+		RE_Match_State state(&re);
+
+		for ( int c = 0; c < 256; ++c )
+			{
+			u_char byte = c;
+			state.Clear();
+			state.Match(&byte, 1, true, false, true);
+
+			if ( ! state.Failed() || ! state.AcceptedMatches().empty() )
+				candidates[c][i] = true;
+			}
+		}
+
+	// Bytes with the same set of candidates share their pattern sets.
+	std::map<std::vector<bool>, int> buckets;
+
+	for ( int c = 0; c < 256; ++c )
+		{
+		const auto& cands = candidates[c];
+		auto num_cands = std::count(cands.begin(), cands.end(), true);
+
+		if ( num_cands == 0 )
+			{
+			file_magic_dispatch[c] = FILE_MAGIC_NO_CANDIDATES;
+			continue;
+			}
+
+		if ( num_cands == exprs.length() )
+			{
+			file_magic_dispatch[c] = FILE_MAGIC_ALL_CANDIDATES;
+			continue;
+			}
+
+		auto it = buckets.find(cands);
+
+		if ( it != buckets.end() )
+			{
+			file_magic_dispatch[c] = it->second;
+			continue;
+			}
+
+		string_list bucket_exprs;
+		int_list bucket_ids;
+
+		for ( int i = 0; i < exprs.length(); ++i )
+			{
+			if ( cands[i] )
+				{
+				bucket_exprs.push_back(exprs[i]);
+				bucket_ids.push_back(ids[i]);
+				}
+			}
+
+		auto psets = new RuleHdrTest::pattern_set_list;
+		BuildPatternSets(psets, bucket_exprs, bucket_ids);
+
+		int idx = file_magic_buckets.size();
+		file_magic_buckets.push_back(psets);
+		buckets[cands] = idx;
+		file_magic_dispatch[c] = idx;
+		}
+
+	DBG_LOG(DBG_RULES, "%d file magic patterns dispatched into %zu buckets",
+	        exprs.length(), file_magic_buckets.size());
+	}
+
 // Get a 8/16/32-bit value from the given position in the packet header
 static inline uint32_t getval(const u_char* data, int size)
 	{
@@ -632,6 +766,22 @@ RuleFileMagicState* RuleMatcher::InitFileMagic() const
 
 	// Save some memory.
 	state->matchers.resize(0);
+
+	for ( auto psets : file_magic_buckets )
+		{
+		auto bucket = new RuleFileMagicState::matcher_list;
+
+		for ( const auto& set : *psets )
+			{
+			RuleFileMagicState::Matcher* m = new RuleFileMagicState::Matcher;
+			m->state = new RE_Match_State(set->re);
+			bucket->push_back(m);
+			}
+
+		bucket->resize(0);
+		state->bucket_matchers.push_back(bucket);
+		}
+
 	return state;
 	}
 
@@ -682,9 +832,29 @@ RuleMatcher::MIME_Matches* RuleMatcher::Match(RuleFileMagicState* state,
 		}
 #endif
 
+	// Restrict matching to the patterns that can match data starting
+	// with the given first byte.
+	RuleFileMagicState::matcher_list* matchers = &state->matchers;
+
+	if ( len > 0 )
+		{
+		int bucket = file_magic_dispatch[data[0]];
+
+		if ( bucket == FILE_MAGIC_NO_CANDIDATES )
+			return rval;
+
+		if ( bucket >= 0 )
+			matchers = state->bucket_matchers[bucket];
+		}
+
+	if ( state->last_matchers && state->last_matchers != matchers )
+		ClearFileMagicState(state);
+
+	state->last_matchers = matchers;
+
 	bool newmatch = false;
 
-	for ( const auto& m : state->matchers )
+	for ( const auto& m : *matchers )
 		{
 		if ( m->state->Match(data, len, true, false, true) )
 			newmatch = true;
@@ -697,7 +867,7 @@ RuleMatcher::MIME_Matches* RuleMatcher::Match(RuleFileMagicState* state,
 
 	AcceptingMatchSet accepted_matches;
 
-	for ( const auto& m : state->matchers )
+	for ( const auto& m : *matchers )
 		{
 		const AcceptingMatchSet& ams = m->state->AcceptedMatches();
 		accepted_matches.insert(ams.begin(), ams.end());
@@ -1132,8 +1302,14 @@ void RuleMatcher::ClearEndpointState(RuleEndpointState* state)
 
 void RuleMatcher::ClearFileMagicState(RuleFileMagicState* state) const
 	{
-	for ( const auto& matcher : state->matchers )
+	// Only the matchers of the last match may hold any state.
+	if ( ! state->last_matchers )
+		return;
+
+	for ( const auto& matcher : *state->last_matchers )
 		matcher->state->Clear();
+
+	state->last_matchers = nullptr;
 	}
 
 void RuleMatcher::PrintDebug()
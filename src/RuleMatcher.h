@@ -207,6 +207,13 @@ private:
 
 	using matcher_list = PList<Matcher>;
 	matcher_list matchers;
+
+	// Matchers for the candidate patterns of each bucket of first bytes
+	// (see RuleMatcher::BuildFileMagicDispatch()).
+	std::vector<matcher_list*> bucket_matchers;
+
+	// The matchers used by the most recent call to RuleMatcher::Match().
+	matcher_list* last_matchers = nullptr;
 };
 
 
@@ -328,6 +335,11 @@ private:
 	void BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 				const string_list& exprs, const int_list& ids);
 
+	// Determines for each possible first byte of a file which file magic
+	// patterns can match data starting with it, and builds pattern sets
+	// for just these candidates.
+	void BuildFileMagicDispatch();
+
 	// Check an arbitrary rule if it's satisfied right now.
 	// eos signals end of stream
 	void ExecRule(Rule* rule, RuleEndpointState* state, bool eos);
@@ -362,6 +374,16 @@ private:
 	RuleHdrTest* root;
 	rule_list rules;
 	rule_dict rules_by_id;
+
+	// Special values in file_magic_dispatch.
+	static constexpr int FILE_MAGIC_NO_CANDIDATES = -1;
+	static constexpr int FILE_MAGIC_ALL_CANDIDATES = -2;
+
+	// For each possible first byte of a file, the index of the bucket in
+	// file_magic_buckets holding the patterns that can match, or one of
+	// the special values above.
+	int file_magic_dispatch[256];
+	std::vector<RuleHdrTest::pattern_set_list*> file_magic_buckets;
 };
 
 // Keeps bi-directional matching-state.
@@ -1251,7 +1251,7 @@ EnumType::EnumType(const string& name)
 	}
 
 EnumType::EnumType(const EnumType* e)
-	: Type(TYPE_ENUM), names(e->names), vals(e->vals)
+	: Type(TYPE_ENUM), names(e->names), rev_names(e->rev_names), vals(e->vals)
 	{
 	counter = e->counter;
 	SetName(e->GetName());
@@ -1361,12 +1361,31 @@ void EnumType::AddNameInternal(const string& module_name, const char* name,
 	{
 	string fullname = detail::make_full_var_name(module_name.c_str(), name);
 	names[fullname] = val;
+
+	auto rev = rev_names.find(val);
+
+	if ( rev == rev_names.end() )
+		rev_names.emplace(val, fullname);
+	else if ( fullname < rev->second )
+		rev->second = fullname;
 	}
 
 bro_int_t EnumType::Lookup(const string& module_name, const char* name) const
 	{
+	// Names are stored fully qualified, and never with the global
+	// module's prefix. So for lookups in the global module, which is what
+	// Broker does for every enum it receives, try the name as given
+	// before building its full name.
+	if ( module_name == detail::GLOBAL_MODULE_NAME )
+		{
+		auto pos = names.find(name);
+
+		if ( pos != names.end() )
+			return pos->second;
+		}
+
 	NameMap::const_iterator pos =
-		names.find(detail::make_full_var_name(module_name.c_str(), name).c_str());
+		names.find(detail::make_full_var_name(module_name.c_str(), name));
 
 	if ( pos == names.end() )
 		return -1;
@@ -1376,12 +1395,12 @@ bro_int_t EnumType::Lookup(const string& module_name, const char* name) const
 
 const char* EnumType::Lookup(bro_int_t value) const
 	{
-	for ( NameMap::const_iterator iter = names.begin();
-	      iter != names.end(); ++iter )
-		if ( iter->second == value )
-			return iter->first.c_str();
+	auto pos = rev_names.find(value);
 
-	return nullptr;
+	if ( pos == rev_names.end() )
+		return nullptr;
+
+	return pos->second.c_str();
 	}
 
 EnumType::enum_name_list EnumType::Names() const
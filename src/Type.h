@@ -723,9 +723,13 @@ protected:
 	                     const char* name, bro_int_t val, bool is_export,
 	                     detail::Expr* deprecation = nullptr);
 
-	typedef std::map<std::string, bro_int_t> NameMap;
+	typedef std::map<std::string, bro_int_t, std::less<>> NameMap;
 	NameMap names;
 
+	// Maps values back to their names, for Lookup(bro_int_t). If
+	// several names share a value, this holds the smallest one.
+	std::unordered_map<bro_int_t, std::string> rev_names;
+
 	using ValMap = std::unordered_map<bro_int_t, EnumValPtr>;
 	ValMap vals;
 
@@ -887,6 +891,8 @@ extern zeek::OpaqueTypePtr entropy_type;
 extern zeek::OpaqueTypePtr cardinality_type;
 extern zeek::OpaqueTypePtr topk_type;
 extern zeek::OpaqueTypePtr bloomfilter_type;
+extern zeek::OpaqueTypePtr tdigest_type;
+extern zeek::OpaqueTypePtr countmin_type;
 extern zeek::OpaqueTypePtr x509_opaque_type;
 extern zeek::OpaqueTypePtr ocsp_resp_opaque_type;
 extern zeek::OpaqueTypePtr paraglob_type;
@@ -1464,6 +1464,36 @@ void TableVal::RemoveAll()
 	val.table_val->SetDeleteFunc(table_entry_val_delete_func);
 	}
 
+void TableVal::SwapContents(TableVal* other)
+	{
+	// A pending expiration iterates over the current entries; restart
+	// them after the swap.
+	for ( auto t : {this, other} )
+		{
+		if ( t->expire_cookie )
+			{
+			t->AsTable()->StopIteration(t->expire_cookie);
+			t->expire_cookie = nullptr;
+			}
+		}
+
+	std::swap(val.table_val, other->val.table_val);
+	std::swap(subnets, other->subnets);
+
+	Modified();
+	other->Modified();
+	}
+
+void TableVal::Reserve(int n)
+	{
+	if ( Size() > 0 || n <= 0 )
+		return;
+
+	delete AsTable();
+	val.table_val = new PDict<TableEntryVal>(UNORDERED, n);
+	val.table_val->SetDeleteFunc(table_entry_val_delete_func);
+	}
+
 int TableVal::Size() const
 	{
 	return AsTable()->Length();
@@ -838,6 +838,15 @@ public:
 	// Remove the entire contents.
 	void RemoveAll();
 
+	// Exchange the entire contents with those of another table of the
+	// same type. Neither &on_change functions nor Broker stores learn
+	// about the change.
+	void SwapContents(TableVal* other);
+
+	// Make room for the given number of entries up front, to avoid
+	// resizing while adding them. Has no effect on a non-empty table.
+	void Reserve(int n);
+
 	// Remove the entire contents of the table from the given value.
 	// which must also be a TableVal.
 	// Returns true if the addition typechecked, false if not.
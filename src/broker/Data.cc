@@ -209,10 +209,12 @@ struct val_converter {
 
 		auto tt = type->AsTableType();
 		auto rval = make_intrusive<TableVal>(IntrusivePtr{NewRef{}, tt});
+		rval->Reserve(a.size());
+
+		const auto& expected_index_types = tt->GetIndices()->GetTypes();
 
 		for ( auto& item : a )
 			{
-			const auto& expected_index_types = tt->GetIndices()->GetTypes();
 			broker::vector composite_key;
 			auto indices = caf::get_if<broker::vector>(&item);
 
@@ -268,10 +270,12 @@ struct val_converter {
 
 		auto tt = type->AsTableType();
 		auto rval = make_intrusive<TableVal>(IntrusivePtr{NewRef{}, tt});
+		rval->Reserve(a.size());
+
+		const auto& expected_index_types = tt->GetIndices()->GetTypes();
 
 		for ( auto& item : a )
 			{
-			const auto& expected_index_types = tt->GetIndices()->GetTypes();
 			broker::vector composite_key;
 			auto indices = caf::get_if<broker::vector>(&item.first);
 
@@ -331,15 +335,16 @@ struct val_converter {
 			{
 			auto vt = type->AsVectorType();
 			auto rval = make_intrusive<VectorVal>(IntrusivePtr{NewRef{}, vt});
+			rval->Resize(a.size());
 
-			for ( auto& item : a )
+			for ( size_t i = 0; i < a.size(); ++i )
 				{
-				auto item_val = data_to_val(move(item), vt->Yield().get());
+				auto item_val = data_to_val(move(a[i]), vt->Yield().get());
 
 				if ( ! item_val )
 					return nullptr;
 
-				rval->Assign(rval->Size(), std::move(item_val));
+				rval->Assign(i, std::move(item_val));
 				}
 
 			return rval;
@@ -882,12 +887,8 @@ broker::expected<broker::data> val_to_data(const Val* v)
 		auto is_set = v->GetType()->IsSet();
 		auto table = v->AsTable();
 		auto table_val = v->AsTableVal();
-		broker::data rval;
-
-		if ( is_set )
-			rval = broker::set();
-		else
-			rval = broker::table();
+		broker::set set_rval;
+		broker::table table_rval;
 
 		zeek::detail::HashKey* hk;
 		TableEntryVal* entry;
@@ -898,28 +899,38 @@ broker::expected<broker::data> val_to_data(const Val* v)
 			auto vl = table_val->RecreateIndex(*hk);
 			delete hk;
 
-			broker::vector composite_key;
-			composite_key.reserve(vl->Length());
+			broker::data key;
 
-			for ( auto k = 0; k < vl->Length(); ++k )
+			if ( vl->Length() == 1 )
 				{
-				auto key_part = val_to_data(vl->Idx(k).get());
+				// The common case, which doesn't need a composite key.
+				auto key_part = val_to_data(vl->Idx(0).get());
 
 				if ( ! key_part )
 					return broker::ec::invalid_data;
 
-				composite_key.emplace_back(move(*key_part));
+				key = move(*key_part);
 				}
+			else
+				{
+				broker::vector composite_key;
+				composite_key.reserve(vl->Length());
 
-			broker::data key;
+				for ( auto k = 0; k < vl->Length(); ++k )
+					{
+					auto key_part = val_to_data(vl->Idx(k).get());
+
+					if ( ! key_part )
+						return broker::ec::invalid_data;
+
+					composite_key.emplace_back(move(*key_part));
+					}
 
-			if ( composite_key.size() == 1 )
-				key = move(composite_key[0]);
-			else
 				key = move(composite_key);
+				}
 
 			if ( is_set )
-				caf::get<broker::set>(rval).emplace(move(key));
+				set_rval.emplace(move(key));
 			else
 				{
 				auto val = val_to_data(entry->GetVal().get());
@@ -927,11 +938,14 @@ broker::expected<broker::data> val_to_data(const Val* v)
 				if ( ! val )
 					return broker::ec::invalid_data;
 
-				caf::get<broker::table>(rval).emplace(move(key), move(*val));
+				table_rval.emplace(move(key), move(*val));
 				}
 			}
 
-		return {std::move(rval)};
+		if ( is_set )
+			return {broker::data{std::move(set_rval)}};
+
+		return {broker::data{std::move(table_rval)}};
 		}
 	case TYPE_VECTOR:
 		{
@@ -0,0 +1,476 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "broker/LocalTransport.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+namespace zeek::Broker::detail {
+
+static constexpr char ring_magic[8] = {'Z', 'E', 'E', 'K', 'R', 'N', 'G', '1'};
+static constexpr uint32_t wrap_marker = 0xffffffff;
+static constexpr size_t data_offset = 256;
+
+// How long to wait before trying again to attach to a receiver.
+static constexpr double attach_retry_interval = 5.0;
+
+// How often a receiver looks for new and abandoned rings even if it
+// didn't get told about them.
+static constexpr double scan_interval = 5.0;
+
+// The maximum number of messages a receiver takes from a ring in one go,
+// so that a busy sender can't starve the others.
+static constexpr size_t max_drain = 10000;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "rings need lock-free atomics to be shared across processes");
+
+// Each message is a 32-bit length followed by the data, padded to keep
+// the lengths aligned. The length of a message is stored in 8 bytes, so
+// that there's always space for the wrap marker at the end of the buffer.
+struct ShmRing::Header {
+	char magic[8];
+	uint64_t capacity;
+	int32_t producer;
+	std::atomic<uint32_t> closed;
+	alignas(64) std::atomic<uint64_t> head;	// Total bytes written.
+	alignas(64) std::atomic<uint64_t> tail;	// Total bytes consumed.
+};
+
+static inline uint64_t record_size(uint64_t len)
+	{
+	return 8 + ((len + 7) & ~uint64_t(7));
+	}
+
+ShmRing::ShmRing(std::string arg_path, void* mem, size_t size)
+	: path(std::move(arg_path)), hdr(static_cast<Header*>(mem)),
+	  data(static_cast<char*>(mem) + data_offset), map_size(size)
+	{
+	}
+
+ShmRing::~ShmRing()
+	{
+	munmap(hdr, map_size);
+	}
+
+std::unique_ptr<ShmRing> ShmRing::Create(const std::string& path, size_t capacity)
+	{
+	static_assert(sizeof(Header) <= data_offset, "ring header too large");
+
+	capacity = (std::max(capacity, size_t(4096)) + 7) & ~size_t(7);
+	size_t size = data_offset + capacity;
+
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+
+	if ( fd < 0 )
+		return nullptr;
+
+	void* mem = MAP_FAILED;
+
+	if ( ftruncate(fd, size) == 0 )
+		mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	int err = errno;
+	close(fd);
+
+	if ( mem == MAP_FAILED )
+		{
+		unlink(path.c_str());
+		errno = err;
+		return nullptr;
+		}
+
+	// The file starts out zeroed, which is a valid empty ring. Set the
+	// magic last, so that a consumer never sees a partial header.
+	auto hdr = new (mem) Header;
+	hdr->capacity = capacity;
+	hdr->producer = getpid();
+	hdr->closed.store(0, std::memory_order_relaxed);
+	hdr->head.store(0, std::memory_order_relaxed);
+	hdr->tail.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(hdr->magic, ring_magic, sizeof(ring_magic));
+
+	return std::unique_ptr<ShmRing>(new ShmRing(path, mem, size));
+	}
+
+std::unique_ptr<ShmRing> ShmRing::Attach(const std::string& path)
+	{
+	int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+
+	if ( fd < 0 )
+		return nullptr;
+
+	struct stat st;
+	void* mem = MAP_FAILED;
+
+	if ( fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) > data_offset )
+		mem = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	close(fd);
+
+	if ( mem == MAP_FAILED )
+		return nullptr;
+
+	std::unique_ptr<ShmRing> ring(new ShmRing(path, mem, st.st_size));
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if ( memcmp(ring->hdr->magic, ring_magic, sizeof(ring_magic)) != 0 ||
+	     ring->hdr->capacity + data_offset != static_cast<uint64_t>(st.st_size) ||
+	     ring->hdr->capacity % 8 != 0 )
+		return nullptr;
+
+	return ring;
+	}
+
+bool ShmRing::Push(std::initializer_list<std::string_view> parts, bool* was_empty)
+	{
+	uint64_t len = 0;
+
+	for ( const auto& p : parts )
+		len += p.size();
+
+	uint64_t cap = hdr->capacity;
+	uint64_t rec = record_size(len);
+
+	if ( len >= wrap_marker || rec > cap )
+		return false;
+
+	uint64_t head = hdr->head.load(std::memory_order_relaxed);
+	uint64_t tail = hdr->tail.load(std::memory_order_acquire);
+	uint64_t pos = head;
+	uint64_t off = pos % cap;
+	uint64_t skip = cap - off < rec ? cap - off : 0;
+
+	if ( skip + rec > cap - (head - tail) )
+		return false;
+
+	if ( skip )
+		{
+		uint32_t marker = wrap_marker;
+		memcpy(data + off, &marker, sizeof(marker));
+		pos += skip;
+		off = 0;
+		}
+
+	uint32_t len32 = len;
+	memcpy(data + off, &len32, sizeof(len32));
+	char* p = data + off + 8;
+
+	for ( const auto& part : parts )
+		{
+		memcpy(p, part.data(), part.size());
+		p += part.size();
+		}
+
+	// Publishing the new head and then checking the tail pairs with the
+	// consumer's storing the tail and then checking the head. With both
+	// sequentially consistent, either we see that the consumer has
+	// caught up with us and wake it, or it sees our message.
+	hdr->head.store(pos + rec, std::memory_order_seq_cst);
+	*was_empty = hdr->tail.load(std::memory_order_seq_cst) == head;
+	return true;
+	}
+
+const char* ShmRing::Peek(uint32_t* len)
+	{
+	uint64_t cap = hdr->capacity;
+
+	for ( ;; )
+		{
+		uint64_t tail = hdr->tail.load(std::memory_order_relaxed);
+		uint64_t head = hdr->head.load(std::memory_order_seq_cst);
+
+		if ( tail == head )
+			return nullptr;
+
+		uint64_t off = tail % cap;
+		uint32_t n;
+		memcpy(&n, data + off, sizeof(n));
+
+		if ( n == wrap_marker )
+			{
+			hdr->tail.store(tail + cap - off, std::memory_order_seq_cst);
+			continue;
+			}
+
+		if ( record_size(n) > cap - off || record_size(n) > head - tail )
+			{
+			// Corrupt. Treat the ring as done.
+			hdr->closed.store(1);
+			hdr->tail.store(head, std::memory_order_seq_cst);
+			return nullptr;
+			}
+
+		peeked = record_size(n);
+		*len = n;
+		return data + off + 8;
+		}
+	}
+
+void ShmRing::Pop()
+	{
+	uint64_t tail = hdr->tail.load(std::memory_order_relaxed);
+	hdr->tail.store(tail + peeked, std::memory_order_seq_cst);
+	peeked = 0;
+	}
+
+void ShmRing::Close()
+	{
+	hdr->closed.store(1);
+	}
+
+bool ShmRing::Abandoned() const
+	{
+	if ( hdr->closed.load() )
+		return true;
+
+	return kill(hdr->producer, 0) < 0 && errno == ESRCH;
+	}
+
+LocalSender::LocalSender(std::string arg_dir, size_t arg_ring_size)
+	: dir(std::move(arg_dir)), ring_size(arg_ring_size)
+	{
+	}
+
+LocalSender::~LocalSender()
+	{
+	Detach();
+	}
+
+bool LocalSender::Attach(double now)
+	{
+	if ( ring )
+		return true;
+
+	if ( now < next_attempt )
+		return false;
+
+	next_attempt = now + attach_retry_interval;
+
+	// Opening the FIFO for writing fails without a receiver having it
+	// open for reading.
+	fifo = open((dir + "/wakeup").c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if ( fifo < 0 )
+		return false;
+
+	static unsigned int counter = 0;
+	auto path = dir + "/" + std::to_string(getpid()) + "-" +
+	            std::to_string(counter++) + ".ring";
+
+	// A leftover of an earlier process with the same PID.
+	unlink(path.c_str());
+
+	ring = ShmRing::Create(path, ring_size);
+
+	if ( ! ring || ! Wakeup('n') )
+		{
+		if ( ring )
+			unlink(path.c_str());
+
+		ring.reset();
+		close(fifo);
+		fifo = -1;
+		return false;
+		}
+
+	return true;
+	}
+
+bool LocalSender::Wakeup(char c)
+	{
+	if ( write(fifo, &c, 1) == 1 )
+		return true;
+
+	// A full FIFO means that the receiver has wakeups pending already.
+	return errno == EAGAIN;
+	}
+
+bool LocalSender::Send(std::initializer_list<std::string_view> parts)
+	{
+	if ( ! ring )
+		return false;
+
+	bool was_empty;
+
+	if ( ! ring->Push(parts, &was_empty) )
+		{
+		// Full. A receiver that has gone away won't ever make room,
+		// so better find out.
+		Check();
+		return false;
+		}
+
+	// If the receiver has gone away, the message stays in the ring for
+	// the next one. Sending it another way could then duplicate it.
+	if ( was_empty && ! Wakeup('d') )
+		Detach();
+
+	return true;
+	}
+
+void LocalSender::Check()
+	{
+	if ( ring && ! Wakeup('d') )
+		Detach();
+	}
+
+void LocalSender::Detach()
+	{
+	if ( ring )
+		{
+		ring->Close();
+		(void) Wakeup('d');
+		ring.reset();
+		}
+
+	if ( fifo >= 0 )
+		{
+		close(fifo);
+		fifo = -1;
+		}
+	}
+
+LocalReceiver::LocalReceiver(std::string arg_dir, int arg_fifo, int arg_fifo_writer)
+	: dir(std::move(arg_dir)), fifo(arg_fifo), fifo_writer(arg_fifo_writer)
+	{
+	}
+
+LocalReceiver::~LocalReceiver()
+	{
+	close(fifo);
+	close(fifo_writer);
+	unlink((dir + "/wakeup").c_str());
+	}
+
+std::unique_ptr<LocalReceiver> LocalReceiver::Create(const std::string& dir)
+	{
+	if ( mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST )
+		return nullptr;
+
+	auto path = dir + "/wakeup";
+	unlink(path.c_str());
+
+	if ( mkfifo(path.c_str(), 0600) < 0 )
+		return nullptr;
+
+	int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if ( fd < 0 )
+		return nullptr;
+
+	int writer = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if ( writer < 0 )
+		{
+		int err = errno;
+		close(fd);
+		errno = err;
+		return nullptr;
+		}
+
+	return std::unique_ptr<LocalReceiver>(new LocalReceiver(dir, fd, writer));
+	}
+
+void LocalReceiver::Scan()
+	{
+	DIR* d = opendir(dir.c_str());
+
+	if ( ! d )
+		return;
+
+	while ( auto e = readdir(d) )
+		{
+		std::string_view name = e->d_name;
+
+		if ( name.size() < 5 || name.substr(name.size() - 5) != ".ring" )
+			continue;
+
+		auto path = dir + "/" + e->d_name;
+
+		if ( rings.count(path) )
+			continue;
+
+		if ( auto ring = ShmRing::Attach(path) )
+			rings.emplace(path, std::move(ring));
+		}
+
+	closedir(d);
+	}
+
+size_t LocalReceiver::Drain(double now, const std::function<void (const char*, uint32_t)>& cb)
+	{
+	char buf[256];
+	ssize_t n;
+	bool new_rings = false;
+
+	while ( (n = read(fifo, buf, sizeof(buf))) > 0 )
+		if ( memchr(buf, 'n', n) )
+			new_rings = true;
+
+	if ( new_rings || now >= next_scan )
+		{
+		Scan();
+		next_scan = now + scan_interval;
+		}
+
+	size_t rval = 0;
+	bool more = false;
+
+	for ( auto i = rings.begin(); i != rings.end(); )
+		{
+		auto& ring = i->second;
+
+		// Check first, so that draining afterwards gets everything
+		// the producer ever wrote.
+		bool abandoned = ring->Abandoned();
+		size_t count = 0;
+		const char* msg;
+		uint32_t len;
+
+		while ( count < max_drain && (msg = ring->Peek(&len)) )
+			{
+			cb(msg, len);
+			ring->Pop();
+			++count;
+			}
+
+		rval += count;
+
+		if ( count == max_drain )
+			{
+			more = true;
+			++i;
+			}
+
+		else if ( abandoned )
+			{
+			unlink(i->first.c_str());
+			i = rings.erase(i);
+			}
+
+		else
+			++i;
+		}
+
+	if ( more )
+		{
+		// Come back for the rest.
+		char c = 'd';
+		(void) write(fifo_writer, &c, 1);
+		}
+
+	return rval;
+	}
+
+} // namespace zeek::Broker::detail
@@ -0,0 +1,203 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// A transport for log messages between Zeek processes on the same host,
+// e.g. the nodes of a supervised cluster. Messages go through
+// single-producer, single-consumer rings in memory-mapped files instead of
+// through Broker's loopback TCP connections.
+//
+// A receiver owns a directory in which it creates a FIFO named "wakeup".
+// A sender attaches by creating its own ring file in that directory and
+// announcing it through the FIFO. It then writes a byte to the FIFO
+// whenever it appends to an empty ring. The receiver reads messages
+// directly out of the mapped ring. The FIFO also tells a sender whether
+// the receiver is still around: writing to it fails once the receiver has
+// gone away, in which case the sender detaches and falls back to Broker.
+// Senders check this periodically, not just when waking the receiver.
+//
+// A message in a ring belongs to the ring: a sender that finds its
+// receiver gone leaves the ring file in place, and the next receiver
+// in the directory drains whatever the old one didn't get to.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace zeek::Broker::detail {
+
+/**
+ * A single-producer, single-consumer ring of variable-length messages in
+ * a memory-mapped file shared by two processes.
+ */
+class ShmRing {
+public:
+	/**
+	 * Creates a new ring file and maps it, for the producer.
+	 * @param path the file to create.
+	 * @param capacity the number of bytes available to messages.
+	 * @return the ring, or null on error, with errno set.
+	 */
+	static std::unique_ptr<ShmRing> Create(const std::string& path, size_t capacity);
+
+	/**
+	 * Maps an existing ring file, for the consumer.
+	 * @param path the ring's file.
+	 * @return the ring, or null if the file isn't a valid ring.
+	 */
+	static std::unique_ptr<ShmRing> Attach(const std::string& path);
+
+	~ShmRing();
+
+	/**
+	 * Appends a message made up of several parts. Only the producer may
+	 * call this.
+	 * @param parts the message's parts, which get concatenated.
+	 * @param was_empty set to true if the consumer may have found the
+	 * ring empty, and thus needs a wakeup.
+	 * @return false if the ring doesn't have enough space left.
+	 */
+	bool Push(std::initializer_list<std::string_view> parts, bool* was_empty);
+
+	/**
+	 * Returns the next message, without removing it. The data stays
+	 * valid until the next call to Pop(). Only the consumer may call
+	 * this.
+	 * @param len set to the message's length.
+	 * @return the message, or null if the ring is empty.
+	 */
+	const char* Peek(uint32_t* len);
+
+	/**
+	 * Removes the message that Peek() returned.
+	 */
+	void Pop();
+
+	/**
+	 * Marks the ring as no longer written to.
+	 */
+	void Close();
+
+	/**
+	 * @return true if the producer has closed the ring, or has exited.
+	 */
+	bool Abandoned() const;
+
+	const std::string& Path() const	{ return path; }
+
+private:
+	struct Header;
+
+	ShmRing(std::string path, void* mem, size_t size);
+
+	std::string path;
+	Header* hdr;
+	char* data;
+	size_t map_size;
+	uint32_t peeked = 0;	// Size of the record that Peek() returned.
+};
+
+/**
+ * The sending side of the transport to one receiver.
+ */
+class LocalSender {
+public:
+	/**
+	 * @param dir the receiver's directory.
+	 * @param ring_size the capacity of the ring to create.
+	 */
+	LocalSender(std::string dir, size_t ring_size);
+	~LocalSender();
+
+	/**
+	 * Attaches to the receiver if not attached yet. Failed attempts are
+	 * only retried after a while.
+	 * @param now the current time.
+	 * @return true if attached.
+	 */
+	bool Attach(double now);
+
+	/**
+	 * @return true if attached to the receiver.
+	 */
+	bool Attached() const	{ return ring != nullptr; }
+
+	/**
+	 * Sends a message made up of several parts.
+	 * @return false if the message wasn't sent, because the ring is full
+	 * or the sender isn't attached. It's then up to the caller to send
+	 * it another way, which may get it to the receiver ahead of the
+	 * messages still in the ring. Once in the ring, a message counts as
+	 * sent even if the receiver turns out to be gone.
+	 */
+	bool Send(std::initializer_list<std::string_view> parts);
+
+	/**
+	 * Detaches if the receiver has gone away. Meant to be called
+	 * periodically, as sending notices only when it wakes the receiver.
+	 */
+	void Check();
+
+	/**
+	 * Closes the ring, leaving its file for the receiver to drain.
+	 */
+	void Detach();
+
+private:
+	bool Wakeup(char c);
+
+	std::string dir;
+	size_t ring_size;
+	int fifo = -1;
+	std::unique_ptr<ShmRing> ring;
+	double next_attempt = 0;
+};
+
+/**
+ * The receiving side of the transport, taking messages from any number of
+ * senders.
+ */
+class LocalReceiver {
+public:
+	/**
+	 * Creates the receiver's directory and FIFO.
+	 * @param dir the directory.
+	 * @return the receiver, or null on error, with errno set.
+	 */
+	static std::unique_ptr<LocalReceiver> Create(const std::string& dir);
+
+	~LocalReceiver();
+
+	/**
+	 * @return the file descriptor that becomes ready when messages
+	 * arrive.
+	 */
+	int Fd() const	{ return fifo; }
+
+	/**
+	 * Passes all pending messages to a callback. The callback's data is
+	 * only valid for the duration of the call.
+	 * @param now the current time.
+	 * @return the number of messages processed.
+	 */
+	size_t Drain(double now, const std::function<void (const char*, uint32_t)>& cb);
+
+private:
+	LocalReceiver(std::string dir, int fifo, int fifo_writer);
+
+	void Scan();
+
+	std::string dir;
+	int fifo;
+	int fifo_writer;	// Keeps the FIFO from ever reporting EOF.
+	std::map<std::string, std::unique_ptr<ShmRing>> rings;
+	double next_scan = 0;
+};
+
+} // namespace zeek::Broker::detail
@@ -2,6 +2,8 @@
 
 #include <broker/broker.hh>
 #include <broker/zeek.hh>
+#include <cctype>
+#include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <unistd.h>
@@ -146,6 +148,7 @@ void Manager::InitPostScript()
 	DBG_LOG(DBG_BROKER, "Initializing");
 
 	log_batch_size = get_option("Broker::log_batch_size")->AsCount();
+	event_batch_size = get_option("Broker::event_batch_size")->AsCount();
 	default_log_topic_prefix =
 	    get_option("Broker::default_log_topic_prefix")->AsString()->CheckString();
 	log_topic_func = get_option("Broker::log_topic")->AsFunc();
@@ -153,6 +156,8 @@ void Manager::InitPostScript()
 	writer_id_type = id::find_type("Log::Writer")->AsEnumType();
 	zeek_table_manager = get_option("Broker::table_store_master")->AsBool();
 	zeek_table_db_directory = get_option("Broker::table_store_db_directory")->AsString()->CheckString();
+	local_transport_dir = get_option("Broker::local_transport_dir")->AsString()->CheckString();
+	local_transport_ring_size = get_option("Broker::local_transport_ring_size")->AsCount();
 
 	detail::opaque_of_data_type = make_intrusive<OpaqueType>("Broker::Data");
 	detail::opaque_of_set_iterator = make_intrusive<OpaqueType>("Broker::SetIterator");
@@ -267,10 +272,22 @@ void Manager::InitializeBrokerStoreForwarding()
 void Manager::Terminate()
 	{
 	FlushLogBuffers();
+	FlushEventBuffers();
 
 	iosource_mgr->UnregisterFd(bstate->subscriber.fd(), this);
 	iosource_mgr->UnregisterFd(bstate->status_subscriber.fd(), this);
 
+	if ( local_receiver )
+		{
+		iosource_mgr->UnregisterFd(local_receiver->Fd(), this);
+		local_receiver.reset();
+		}
+
+	// Whatever the senders still have in their rings gets drained by the
+	// receiver once it notices that they're gone.
+	local_routes.clear();
+	local_senders.clear();
+
 	vector<string> stores_to_close;
 
 	for ( auto& x : data_stores )
@@ -282,6 +299,7 @@ void Manager::Terminate()
 		CloseStore(x);
 
 	FlushLogBuffers();
+	FlushEventBuffers();
 
 	for ( auto& p : bstate->endpoint.peers() )
 		if ( p.peer.network )
@@ -397,6 +415,7 @@ void Manager::Unpeer(const string& addr, uint16_t port)
 	        addr.c_str(), port);
 
 	FlushLogBuffers();
+	FlushEventBuffers();
 	bstate->endpoint.unpeer_nosync(addr, port);
 	}
 
@@ -424,8 +443,31 @@ bool Manager::PublishEvent(string topic, std::string name, broker::vector args)
 	DBG_LOG(DBG_BROKER, "Publishing event: %s",
 		RenderEvent(topic, name, args).c_str());
 	broker::zeek::Event ev(std::move(name), std::move(args));
-	bstate->endpoint.publish(move(topic), ev.move_data());
-	++statistics.num_events_outgoing;
+
+	if ( event_batch_size <= 1 )
+		{
+		bstate->endpoint.publish(move(topic), ev.move_data());
+		++statistics.num_events_outgoing;
+		return true;
+		}
+
+	// Batches use the same message type as log batches, which receivers
+	// unpack into their individual events.
+	auto& pending_batch = event_buffers[topic];
+
+	if ( pending_batch.empty() )
+		pending_batch.reserve(event_batch_size);
+
+	pending_batch.emplace_back(ev.move_data());
+
+	if ( pending_batch.size() >= event_batch_size )
+		{
+		statistics.num_events_outgoing += pending_batch.size();
+		broker::zeek::Batch msg(std::move(pending_batch));
+		bstate->endpoint.publish(move(topic), msg.move_data());
+		pending_batch = broker::vector{};
+		}
+
 	return true;
 	}
 
@@ -532,6 +574,40 @@ bool Manager::PublishLogCreate(EnumVal* stream, EnumVal* writer,
 		fields_data.push_back(move(field_data));
 		}
 
+	if ( peer.node == NoPeer.node && ! local_senders.empty() )
+		{
+		// Writes going through the same-host transport may arrive before
+		// this, so the receivers get told about the writer that way, too.
+		zeek::detail::BinarySerializationFormat fmt;
+		fmt.StartWrite();
+
+		bool success = fmt.Write('c', "kind") &&
+		               fmt.Write(stream_id, "stream") &&
+		               fmt.Write(writer_id, "writer") &&
+		               info.Write(&fmt) &&
+		               fmt.Write(num_fields, "num_fields");
+
+		for ( int i = 0; success && i < num_fields; ++i )
+			success = fields[i]->Write(&fmt);
+
+		char* data;
+		int len = fmt.EndWrite(&data);
+
+		for ( auto& s : local_senders )
+			{
+			auto& sender = s.second;
+
+			// If the receiver doesn't get this, it mustn't get our
+			// writes either. Detaching sends them through Broker until
+			// we're attached again, which then repeats all creations.
+			if ( sender->Attached() &&
+			     ! (success && sender->Send({std::string_view(data, len)})) )
+				sender->Detach();
+			}
+
+		free(data);
+		}
+
 	std::string topic = default_log_topic_prefix + stream_id;
 	auto bstream_id = broker::enum_value(move(stream_id));
 	auto bwriter_id = broker::enum_value(move(writer_id));
@@ -617,6 +693,31 @@ bool Manager::PublishLogWrite(EnumVal* stream, EnumVal* writer, string path,
 
 	std::string topic = v->AsString()->CheckString();
 
+	if ( ! local_transport_dir.empty() )
+		{
+		if ( auto sender = LocalSenderFor(topic) )
+			{
+			fmt.StartWrite();
+			fmt.Write('w', "kind");
+			fmt.Write(stream_id, "stream");
+			fmt.Write(writer_id, "writer");
+			fmt.Write(path, "path");
+			len = fmt.EndWrite(&data);
+			std::string_view header(data, len);
+
+			// The values follow the header as they are, so that the
+			// receiver can read the whole message in one go.
+			success = sender->Send({header, serial_data});
+			free(data);
+
+			if ( success )
+				{
+				++statistics.num_logs_outgoing;
+				return true;
+				}
+			}
+		}
+
 	auto bstream_id = broker::enum_value(move(stream_id));
 	auto bwriter_id = broker::enum_value(move(writer_id));
 	broker::zeek::LogWrite msg(move(bstream_id), move(bwriter_id), move(path),
@@ -671,10 +772,132 @@ size_t Manager::FlushLogBuffers()
 	for ( auto& lb : log_buffers )
 		rval += lb.Flush(bstate->endpoint, log_batch_size);
 
+	// Notice receivers that have gone away even while their rings don't
+	// need waking.
+	for ( auto& s : local_senders )
+		s.second->Check();
+
 	statistics.num_logs_outgoing += rval;
 	return rval;
 	}
 
+size_t Manager::FlushEventBuffers()
+	{
+	if ( bstate->endpoint.is_shutdown() )
+		return 0;
+
+	DBG_LOG(DBG_BROKER, "Flushing all event buffers");
+	size_t rval = 0;
+
+	for ( auto& kv : event_buffers )
+		{
+		auto& pending_batch = kv.second;
+
+		if ( pending_batch.empty() )
+			continue;
+
+		rval += pending_batch.size();
+		broker::zeek::Batch msg(std::move(pending_batch));
+		bstate->endpoint.publish(kv.first, msg.move_data());
+		pending_batch = broker::vector{};
+		}
+
+	statistics.num_events_outgoing += rval;
+	return rval;
+	}
+
+// The weight function of Rendezvous hashing, as in the hrw_weight() BiF.
+// The part of it that only depends on the site is precomputed as its seed.
+static constexpr uint32_t hrw_a = 1103515245;
+static constexpr uint32_t hrw_b = 12345;
+
+static uint32_t hrw_seed(uint32_t site_id)
+	{
+	return hrw_a * site_id + hrw_b;
+	}
+
+static uint32_t hrw_weight(uint32_t key_digest, uint32_t seed)
+	{
+	return (hrw_a * (seed ^ (key_digest & 0x7fffffff)) + hrw_b) & 0x7fffffff;
+	}
+
+// The FNV-1a digest of a key, as in the fnv1a32() BiF.
+static uint32_t hrw_digest(const Val* key)
+	{
+	ODesc desc(DESC_BINARY);
+	key->Describe(&desc);
+
+	auto bytes = desc.Bytes();
+	uint32_t rval = 2166136261;
+
+	for ( auto i = 0; i < desc.Len(); ++i )
+		{
+		rval ^= (uint32_t) bytes[i];
+		rval *= 16777619;
+		}
+
+	return rval;
+	}
+
+bool Manager::AddPoolSite(RecordVal* pool, uint32_t site_id, StringValPtr topic)
+	{
+	auto& ps = pool_sites[pool];
+
+	if ( ! ps.pool )
+		ps.pool = {NewRef{}, pool};
+
+	for ( const auto& s : ps.sites )
+		if ( s.id == site_id )
+			return false;
+
+	ps.sites.push_back({site_id, hrw_seed(site_id), std::move(topic)});
+	return true;
+	}
+
+bool Manager::RemovePoolSite(RecordVal* pool, uint32_t site_id)
+	{
+	auto i = pool_sites.find(pool);
+
+	if ( i == pool_sites.end() )
+		return false;
+
+	auto& sites = i->second.sites;
+
+	for ( auto s = sites.begin(); s != sites.end(); ++s )
+		if ( s->id == site_id )
+			{
+			sites.erase(s);
+			return true;
+			}
+
+	return false;
+	}
+
+StringVal* Manager::PoolTopic(RecordVal* pool, const Val* key)
+	{
+	auto i = pool_sites.find(pool);
+
+	if ( i == pool_sites.end() || i->second.sites.empty() )
+		return nullptr;
+
+	auto digest = hrw_digest(key);
+	const PoolSite* best = nullptr;
+	uint32_t best_weight = 0;
+
+	for ( const auto& s : i->second.sites )
+		{
+		auto w = hrw_weight(digest, s.seed);
+
+		if ( ! best || w > best_weight || (w == best_weight && s.id > best->id) )
+			{
+			best = &s;
+			best_weight = w;
+			}
+		}
+
+	return best->topic.get();
+	}
+
 void Manager::Error(const char* format, ...)
 	{
 	va_list args;
@@ -993,6 +1216,15 @@ void Manager::Process()
 			}
 		}
 
+	if ( local_receiver )
+		{
+		auto process = [this](const char* data, uint32_t len)
+			{ ProcessLocalLog(data, len); };
+
+		if ( local_receiver->Drain(util::current_time(), process) > 0 )
+			had_input = true;
+		}
+
 	if ( had_input )
 		{
 		if ( run_state::network_time == 0 )
@@ -1063,6 +1295,9 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		if ( ! storehandle )
 			return;
 
+		if ( storehandle->cache )
+			storehandle->cache->Put(insert.key(), insert.value());
+
 		const auto& table = storehandle->forward_to;
 		if ( ! table )
 			return;
@@ -1079,6 +1314,9 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		if ( ! storehandle )
 			return;
 
+		if ( storehandle->cache )
+			storehandle->cache->Put(update.key(), update.new_value());
+
 		const auto& table = storehandle->forward_to;
 		if ( ! table )
 			return;
@@ -1095,6 +1333,9 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		if ( ! storehandle )
 			return;
 
+		if ( storehandle->cache )
+			storehandle->cache->Erase(erase.key());
+
 		auto table = storehandle->forward_to;
 		if ( ! table )
 			return;
@@ -1118,13 +1359,15 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		}
 	else if ( auto expire = broker::store_event::expire::make(msg) )
 		{
-		// We just ignore expiries - expiring information on the Zeek side is handled by Zeek itself.
-#ifdef DEBUG
-		// let's only debug log for stores that we know.
 		auto storehandle = broker_mgr->LookupStore(expire.store_id());
 		if ( ! storehandle )
 			return;
 
+		if ( storehandle->cache )
+			storehandle->cache->Erase(expire.key());
+
+		// We otherwise ignore expiries - expiring information on the Zeek side is handled by Zeek itself.
+#ifdef DEBUG
 		auto table = storehandle->forward_to;
 		if ( ! table )
 			return;
@@ -1284,6 +1527,37 @@ bool Manager::ProcessLogCreate(broker::zeek::LogCreate lc)
 	return true;
 	}
 
+// Reads the values that PublishLogWrite() serialized.
+static threading::Value** read_log_values(zeek::detail::SerializationFormat* fmt,
+                                          int* num_fields, const char* stream_name)
+	{
+	if ( ! fmt->Read(num_fields, "num_fields") )
+		{
+		reporter->Warning("failed to unserialize remote log num fields for stream: %s", stream_name);
+		return nullptr;
+		}
+
+	auto vals = new threading::Value* [*num_fields];
+
+	for ( int i = 0; i < *num_fields; ++i )
+		{
+		vals[i] = new threading::Value;
+
+		if ( ! vals[i]->Read(fmt) )
+			{
+			for ( int j = 0; j <=i; ++j )
+				delete vals[j];
+
+			delete [] vals;
+			reporter->Warning("failed to unserialize remote log field %d for stream: %s", i, stream_name);
+
+			return nullptr;
+			}
+		}
+
+	return vals;
+	}
+
 bool Manager::ProcessLogWrite(broker::zeek::LogWrite lw)
 	{
 	DBG_LOG(DBG_BROKER, "Received log-write: %s", RenderMessage(lw.as_data()).c_str());
@@ -1336,36 +1610,208 @@ bool Manager::ProcessLogWrite(broker::zeek::LogWrite lw)
 	fmt.StartRead(serial_data->data(), serial_data->size());
 
 	int num_fields;
-	bool success = fmt.Read(&num_fields, "num_fields");
+	auto vals = read_log_values(&fmt, &num_fields, stream_id_name.data());
 
-	if ( ! success )
+	if ( ! vals )
+		return false;
+
+	log_mgr->WriteFromRemote(stream_id->AsEnumVal(), writer_id->AsEnumVal(),
+	                               std::move(*path), num_fields, vals);
+	fmt.EndRead();
+	return true;
+	}
+
+// The directory of the same-host transport's receiver for a topic.
+static std::string local_transport_topic_dir(const std::string& base, const std::string& topic)
+	{
+	std::string name = topic;
+
+	for ( auto& c : name )
+		if ( ! (isalnum(c) || c == '-' || c == '_' || c == '.') )
+			c = '_';
+
+	return base + "/" + name;
+	}
+
+// How long to wait before looking again for the receiver of a topic.
+static constexpr double local_receiver_lookup_interval = 5.0;
+
+// Receivers accept logs for a topic prefix, like subscriptions do. Returns
+// the directory of the receiver with the longest prefix of a topic, or an
+// empty string if there's none.
+static std::string find_local_receiver(const std::string& base, const std::string& topic)
+	{
+	std::string prefix = topic;
+
+	while ( ! prefix.empty() )
 		{
-		reporter->Warning("failed to unserialize remote log num fields for stream: %s", stream_id_name.data());
+		auto dir = local_transport_topic_dir(base, prefix);
+
+		if ( access((dir + "/wakeup").c_str(), F_OK) == 0 )
+			return dir;
+
+		// Drop the last component, keeping the slash before it.
+		if ( prefix.back() == '/' )
+			prefix.pop_back();
+
+		auto slash = prefix.rfind('/');
+		prefix.resize(slash == std::string::npos ? 0 : slash + 1);
+		}
+
+	return "";
+	}
+
+bool Manager::AcceptLocalLogs(const std::string& topic)
+	{
+	if ( local_transport_dir.empty() )
+		return false;
+
+	if ( local_receiver )
+		{
+		reporter->Error("already accepting local logs");
 		return false;
 		}
 
-	auto vals = new threading::Value* [num_fields];
+	util::detail::ensure_dir(local_transport_dir.c_str());
+	local_receiver = detail::LocalReceiver::Create(local_transport_topic_dir(local_transport_dir, topic));
 
-	for ( int i = 0; i < num_fields; ++i )
+	if ( ! local_receiver )
 		{
-		vals[i] = new threading::Value;
+		reporter->Error("cannot accept local logs for topic %s in %s: %s",
+		                topic.c_str(), local_transport_dir.c_str(), strerror(errno));
+		return false;
+		}
+
+	iosource_mgr->RegisterFd(local_receiver->Fd(), this);
+	DBG_LOG(DBG_BROKER, "Accepting local logs for topic %s", topic.c_str());
+	return true;
+	}
+
+detail::LocalSender* Manager::LocalSenderFor(const std::string& topic)
+	{
+	auto& route = local_routes[topic];
+
+	if ( route.sender && route.sender->Attached() )
+		return route.sender;
+
+	double now = util::current_time();
+
+	if ( ! route.sender )
+		{
+		// Without a receiver for the topic, don't look again for
+		// every write.
+		if ( now < route.next_lookup )
+			return nullptr;
+
+		route.next_lookup = now + local_receiver_lookup_interval;
+		auto dir = find_local_receiver(local_transport_dir, topic);
+
+		if ( dir.empty() )
+			return nullptr;
+
+		// Topics with the same receiver share a ring.
+		auto& sender = local_senders[dir];
+
+		if ( ! sender )
+			sender = std::make_unique<detail::LocalSender>(dir, local_transport_ring_size);
+
+		route.sender = sender.get();
+		}
+
+	auto sender = route.sender;
 
-		if ( ! vals[i]->Read(&fmt) )
+	if ( ! sender->Attach(now) )
+		return nullptr;
+
+	DBG_LOG(DBG_BROKER, "Sending logs for topic %s through shared memory", topic.c_str());
+
+	// The receiver needs to know our writers before it sees their
+	// writes. This goes out to all peers, which just ignore writers they
+	// know already.
+	log_mgr->SendAllWritersTo(NoPeer);
+	return sender->Attached() ? sender : nullptr;
+	}
+
+void Manager::ProcessLocalLog(const char* data, uint32_t len)
+	{
+	zeek::detail::BinarySerializationFormat fmt;
+	fmt.StartRead(data, len);
+
+	char kind;
+	std::string stream_name, writer_name;
+
+	if ( ! (fmt.Read(&kind, "kind") &&
+	        fmt.Read(&stream_name, "stream") &&
+	        fmt.Read(&writer_name, "writer")) )
+		{
+		reporter->Warning("failed to unserialize local log message");
+		return;
+		}
+
+	auto stream_id = log_id_type->Lookup(zeek::detail::GLOBAL_MODULE_NAME, stream_name.c_str());
+	auto writer_id = writer_id_type->Lookup(zeek::detail::GLOBAL_MODULE_NAME, writer_name.c_str());
+
+	if ( stream_id < 0 || writer_id < 0 )
+		{
+		reporter->Warning("failed to unpack local log stream %s with writer %s",
+		                  stream_name.c_str(), writer_name.c_str());
+		return;
+		}
+
+	auto stream = log_id_type->GetEnumVal(stream_id);
+	auto writer = writer_id_type->GetEnumVal(writer_id);
+
+	if ( kind == 'c' )
+		{
+		auto writer_info = std::make_unique<logging::WriterBackend::WriterInfo>();
+		int num_fields;
+
+		if ( ! (writer_info->Read(&fmt) && fmt.Read(&num_fields, "num_fields")) )
 			{
-			for ( int j = 0; j <=i; ++j )
-				delete vals[j];
+			reporter->Warning("failed to unpack local log writer info");
+			return;
+			}
 
-			delete [] vals;
-			reporter->Warning("failed to unserialize remote log field %d for stream: %s", i, stream_id_name.data());
+		auto fields = new threading::Field* [num_fields];
 
-			return false;
+		for ( int i = 0; i < num_fields; ++i )
+			{
+			fields[i] = new threading::Field(nullptr, nullptr, TYPE_VOID, TYPE_VOID, false);
+
+			if ( ! fields[i]->Read(&fmt) )
+				{
+				for ( int j = 0; j <= i; ++j )
+					delete fields[j];
+
+				delete [] fields;
+				reporter->Warning("failed to convert local log field # %d", i);
+				return;
+				}
 			}
+
+		if ( ! log_mgr->CreateWriterForRemoteLog(stream.get(), writer.get(), writer_info.release(), num_fields, fields) )
+			reporter->Warning("failed to create local log stream for %s", stream_name.c_str());
+
+		return;
 		}
 
-	log_mgr->WriteFromRemote(stream_id->AsEnumVal(), writer_id->AsEnumVal(),
-	                               std::move(*path), num_fields, vals);
+	std::string path;
+
+	if ( ! fmt.Read(&path, "path") )
+		{
+		reporter->Warning("failed to unpack local log path for stream: %s", stream_name.c_str());
+		return;
+		}
+
+	int num_fields;
+	auto vals = read_log_values(&fmt, &num_fields, stream_name.c_str());
+
+	if ( ! vals )
+		return;
+
+	++statistics.num_logs_incoming;
+	log_mgr->WriteFromRemote(stream.get(), writer.get(), std::move(path), num_fields, vals);
 	fmt.EndRead();
-	return true;
 	}
 
 bool Manager::ProcessIdentifierUpdate(broker::zeek::IdentifierUpdate iu)
@@ -1669,6 +2115,38 @@ void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::Stor
 	return;
 	}
 
+bool Manager::EnableStoreCache(detail::StoreHandleVal* handle)
+	{
+	if ( handle->cache )
+		return true;
+
+	auto keys = handle->store.keys();
+	if ( ! keys )
+		{
+		Error("Failed to load keys of data store %s for its local cache: %s",
+		      handle->store.name().c_str(), to_string(keys.error()).c_str());
+		return false;
+		}
+
+	auto cache = std::make_unique<detail::StoreCache>();
+
+	if ( auto set = caf::get_if<broker::set>(&(keys->get_data())) )
+		{
+		for ( const auto& key : *set )
+			{
+			auto value = handle->store.get(key);
+
+			// The key may have gone away in the meantime.
+			if ( value )
+				cache->Put(key, std::move(*value));
+			}
+		}
+
+	DBG_LOG(DBG_BROKER, "Enabled local cache for data store %s", handle->store.name().c_str());
+	handle->cache = std::move(cache);
+	return true;
+	}
+
 detail::StoreHandleVal* Manager::MakeClone(const string& name, double resync_interval,
                                            double stale_interval,
                                            double mutation_buffer_interval)
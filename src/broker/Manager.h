@@ -21,6 +21,7 @@
 #include "IntrusivePtr.h"
 #include "iosource/IOSource.h"
 #include "logging/WriterBackend.h"
+#include "broker/LocalTransport.h"
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(Func, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Frame, zeek::detail);
@@ -306,6 +307,15 @@ public:
 	 */
 	detail::StoreHandleVal* LookupStore(const std::string& name);
 
+	/**
+	 * Enables the local cache of a data store, which allows synchronous
+	 * lookups of its content. The cache is filled from the store's
+	 * current content, and then updated from the store's events.
+	 * @param handle the store's handle.
+	 * @return true if the cache is enabled.
+	 */
+	bool EnableStoreCache(detail::StoreHandleVal* handle);
+
 	/**
 	 * Register a Zeek table that is associated with a Broker store that is backing it. This
 	 * causes all changes that happen to the Broker store in the future to be applied to theZzeek
@@ -339,6 +349,49 @@ public:
 	 */
 	size_t FlushLogBuffers();
 
+	/**
+	 * Send all pending event messages.
+	 * @return the number of events sent.
+	 */
+	size_t FlushEventBuffers();
+
+	/**
+	 * Adds a node to the Rendezvous hashing state of a cluster pool.
+	 * @param pool the Cluster::Pool record.
+	 * @param site_id the node's site ID.
+	 * @param topic the topic that reaches the node.
+	 * @return false if the node was already part of the pool.
+	 */
+	bool AddPoolSite(RecordVal* pool, uint32_t site_id, StringValPtr topic);
+
+	/**
+	 * Removes a node from the Rendezvous hashing state of a cluster pool.
+	 * @param pool the Cluster::Pool record.
+	 * @param site_id the node's site ID.
+	 * @return false if the node wasn't part of the pool.
+	 */
+	bool RemovePoolSite(RecordVal* pool, uint32_t site_id);
+
+	/**
+	 * Picks the node of a cluster pool that a key maps to, using the same
+	 * Rendezvous hashing as Cluster::hrw_topic().
+	 * @param pool the Cluster::Pool record.
+	 * @param key the key to distribute.
+	 * @return the topic of the node, or null if the pool has no nodes.
+	 */
+	StringVal* PoolTopic(RecordVal* pool, const Val* key);
+
+	/**
+	 * Starts receiving logs that other Zeek processes on the same host
+	 * send through the shared-memory transport (see
+	 * Broker::local_transport_dir).
+	 * @param topic a prefix of the topics that the senders' log topic
+	 * function returns. Like with subscriptions, senders pick the
+	 * receiver with the longest matching prefix.
+	 * @return true if the receiver could be set up.
+	 */
+	bool AcceptLocalLogs(const std::string& topic);
+
 	/**
 	 * Flushes all pending data store queries and also clears all contents.
 	 */
@@ -369,6 +422,8 @@ private:
 	void ProcessEvent(const broker::topic& topic, broker::zeek::Event ev);
 	bool ProcessLogCreate(broker::zeek::LogCreate lc);
 	bool ProcessLogWrite(broker::zeek::LogWrite lw);
+	void ProcessLocalLog(const char* data, uint32_t len);
+	detail::LocalSender* LocalSenderFor(const std::string& topic);
 	bool ProcessIdentifierUpdate(broker::zeek::IdentifierUpdate iu);
 	void ProcessStatus(broker::status stat);
 	void ProcessError(broker::error err);
@@ -411,7 +466,22 @@ private:
 			}
 	};
 
+	// A node of a cluster pool, for Rendezvous hashing.
+	struct PoolSite {
+		uint32_t id;
+		uint32_t seed;	// The key-independent part of the weight.
+		StringValPtr topic;
+	};
+
+	struct PoolSites {
+		RecordValPtr pool;	// Keeps the pool, and thus its key, alive.
+		std::vector<PoolSite> sites;
+	};
+
 	std::vector<LogBuffer> log_buffers; // Indexed by stream ID enum.
+
+	// Events waiting to be sent as a batch, indexed by topic string.
+	std::unordered_map<std::string, broker::vector> event_buffers;
 	std::string default_log_topic_prefix;
 	std::shared_ptr<BrokerState> bstate;
 	std::unordered_map<std::string, detail::StoreHandleVal*> data_stores;
@@ -419,6 +489,18 @@ private:
 	std::unordered_map<query_id, detail::StoreQueryCallback*,
 	                   query_id_hasher> pending_queries;
 	std::vector<std::string> forwarded_prefixes;
+	std::unordered_map<const RecordVal*, PoolSites> pool_sites;
+
+	// Same-host log transport. Topics map to the sender for the receiver
+	// whose directory they were found to belong to.
+	struct LocalRoute {
+		detail::LocalSender* sender = nullptr;
+		double next_lookup = 0;
+	};
+
+	std::unordered_map<std::string, LocalRoute> local_routes;
+	std::unordered_map<std::string, std::unique_ptr<detail::LocalSender>> local_senders; // By directory.
+	std::unique_ptr<detail::LocalReceiver> local_receiver;
 
 	Stats statistics;
 
@@ -428,12 +510,15 @@ private:
 	int peer_count;
 
 	size_t log_batch_size;
+	size_t event_batch_size;
 	Func* log_topic_func;
 	VectorTypePtr vector_of_data_type;
 	EnumType* log_id_type;
 	EnumType* writer_id_type;
 	bool zeek_table_manager = false;
 	std::string zeek_table_db_directory;
+	std::string local_transport_dir;
+	size_t local_transport_ring_size;
 
 	static int script_scope;
 };
@@ -1,6 +1,11 @@
 #include "broker/Store.h"
+
+#include <chrono>
+
 #include "Desc.h"
 #include "ID.h"
+#include "Val.h"
+#include "util.h"
 #include "broker/Manager.h"
 
 zeek::OpaqueTypePtr zeek::Broker::detail::opaque_of_store_handle;
@@ -25,6 +30,49 @@ EnumValPtr query_status(bool success)
 	return rval;
 	}
 
+void StoreCache::Put(broker::data key, broker::data value)
+	{
+	entries[std::move(key)] = std::move(value);
+	++updates;
+	last_update = util::current_time();
+	}
+
+void StoreCache::Erase(const broker::data& key)
+	{
+	entries.erase(key);
+	++updates;
+	last_update = util::current_time();
+	}
+
+const broker::data* StoreCache::Lookup(const broker::data& key)
+	{
+	auto start = std::chrono::steady_clock::now();
+	auto i = entries.find(key);
+
+	if ( i == entries.end() )
+		{
+		++misses;
+		return nullptr;
+		}
+
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	hit_time += d.count();
+	++hits;
+	return &i->second;
+	}
+
+RecordValPtr StoreCache::Stats() const
+	{
+	auto rval = make_intrusive<RecordVal>(BifType::Record::Broker::StoreCacheStats);
+	rval->Assign(0, val_mgr->Count(entries.size()));
+	rval->Assign(1, val_mgr->Count(hits));
+	rval->Assign(2, val_mgr->Count(misses));
+	rval->Assign(3, val_mgr->Count(updates));
+	rval->Assign(4, make_intrusive<IntervalVal>(hits ? hit_time / hits : 0.0));
+	rval->Assign(5, make_intrusive<IntervalVal>(last_update ? util::current_time() - last_update : 0.0));
+	return rval;
+	}
+
 void StoreHandleVal::ValDescribe(ODesc* d) const
 	{
 	//using BifEnum::Broker::BackendType;
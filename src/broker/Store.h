@@ -5,6 +5,8 @@
 #include "OpaqueVal.h"
 #include "Trigger.h"
 
+#include <memory>
+
 #include <broker/store.hh>
 #include <broker/store_event.hh>
 #include <broker/backend.hh>
@@ -108,6 +110,45 @@ private:
 	broker::store store;
 };
 
+/**
+ * A local copy of a data store's content that scripts can query
+ * synchronously. It is filled from the store once when enabled, and then
+ * kept up to date from the store's change events. It's only ever accessed
+ * from the main thread, so it needs no locking.
+ */
+class StoreCache {
+public:
+	/**
+	 * Inserts or updates an entry.
+	 */
+	void Put(broker::data key, broker::data value);
+
+	/**
+	 * Removes an entry.
+	 */
+	void Erase(const broker::data& key);
+
+	/**
+	 * Looks up the value of a key, updating the hit and miss counters.
+	 * @return the value, or null if the key isn't in the cache. The
+	 * pointer is valid until the next update.
+	 */
+	const broker::data* Lookup(const broker::data& key);
+
+	/**
+	 * @return a Broker::StoreCacheStats value with the cache's counters.
+	 */
+	RecordValPtr Stats() const;
+
+private:
+	broker::table entries;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t updates = 0;
+	double hit_time = 0;	// Total time spent on lookups that hit.
+	double last_update = 0;
+};
+
 /**
  * An opaque handle which wraps a Broker data store.
  */
@@ -124,6 +165,8 @@ public:
 	broker::publisher_id store_pid;
 	// Zeek table that events are forwarded to.
 	TableValPtr forward_to;
+	// Local copy of the content, if enabled.
+	std::unique_ptr<StoreCache> cache;
 
 protected:
 
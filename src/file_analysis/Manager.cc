@@ -11,6 +11,8 @@
 #include "analyzer/Manager.h"
 #include "file_analysis/file_analysis.bif.h"
 
+#include <algorithm>
+
 #include <openssl/md5.h>
 
 using namespace std;
@@ -20,7 +22,8 @@ namespace zeek::file_analysis {
 Manager::Manager()
 	: plugin::ComponentManager<file_analysis::Tag,
 	                           file_analysis::Component>("Files", "Tag"),
-	  current_file_id(), magic_state(), cumulative_files(0), max_files(0)
+	  current_file_id(), handle_cache_next(0), last_lookup(nullptr),
+	  magic_state(), cumulative_files(0), max_files(0)
 	{
 	}
 
@@ -59,6 +62,9 @@ void Manager::Terminate()
 	for ( const auto& entry : id_map )
 		keys.push_back(entry.first);
 
+	// Time out files in a deterministic order.
+	std::sort(keys.begin(), keys.end());
+
 	for ( const string& key : keys )
 		Timeout(key, true);
 
@@ -88,7 +94,19 @@ void Manager::SetHandle(const string& handle)
 		}
 #endif
 
+	for ( const auto& entry : handle_cache )
+		if ( entry.handle == handle && ! entry.file_id.empty() )
+			{
+			current_file_id = entry.file_id;
+			return;
+			}
+
 	current_file_id = HashHandle(handle);
+
+	auto& entry = handle_cache[handle_cache_next];
+	entry.handle = handle;
+	entry.file_id = current_file_id;
+	handle_cache_next = (handle_cache_next + 1) % HANDLE_CACHE_SIZE;
 	}
 
 string Manager::DataIn(const u_char* data, uint64_t len, uint64_t offset,
@@ -352,10 +370,15 @@ File* Manager::GetFile(const string& file_id, Connection* conn,
 
 File* Manager::LookupFile(const string& file_id) const
 	{
+	// Consecutive lookups are mostly for the same file.
+	if ( last_lookup && last_lookup->GetID() == file_id )
+		return last_lookup;
+
 	const auto& entry = id_map.find(file_id);
 	if ( entry == id_map.end() )
 		return nullptr;
 
+	last_lookup = entry->second;
 	return entry->second;
 	}
 
@@ -412,12 +435,19 @@ bool Manager::RemoveFile(const string& file_id)
 
 	id_map.erase(file_id);
 	ignored.erase(file_id);
+
+	if ( f == last_lookup )
+		last_lookup = nullptr;
+
 	delete f;
 	return true;
 	}
 
 bool Manager::IsIgnored(const string& file_id)
 	{
+	if ( ignored.empty() )
+		return false;
+
 	return ignored.find(file_id) != ignored.end();
 	}
 
@@ -2,9 +2,11 @@
 
 #pragma once
 
+#include <array>
 #include <string>
 #include <set>
-#include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "Component.h"
 #include "RunState.h"
@@ -415,13 +417,28 @@ protected:
 
 private:
 	typedef std::set<Tag> TagSet;
-	typedef std::map<std::string, TagSet*> MIMEMap;
+	typedef std::unordered_map<std::string, TagSet*> MIMEMap;
 
 	TagSet* LookupMIMEType(const std::string& mtype, bool add_if_not_found);
 
-	std::map<std::string, File*> id_map;  /**< Map file ID to file_analysis::File records. */
-	std::set<std::string> ignored; /**< Ignored files.  Will be finally removed on EOF. */
+	/**
+	 * A recently seen file handle along with the file ID derived from it.
+	 * Protocol analyzers typically feed a file in many chunks, each of
+	 * which goes through SetHandle() with the same handle again.
+	 */
+	struct HandleCacheEntry {
+		std::string handle;
+		std::string file_id;
+	};
+
+	static constexpr size_t HANDLE_CACHE_SIZE = 8;
+
+	std::unordered_map<std::string, File*> id_map;  /**< Map file ID to file_analysis::File records. */
+	std::unordered_set<std::string> ignored; /**< Ignored files.  Will be finally removed on EOF. */
 	std::string current_file_id;	/**< Hash of what get_file_handle event sets. */
+	std::array<HandleCacheEntry, HANDLE_CACHE_SIZE> handle_cache;	/**< Recent handles, see SetHandle(). */
+	size_t handle_cache_next;	/**< Index of the next handle_cache slot to replace. */
+	mutable File* last_lookup;	/**< Result of the most recent LookupFile(), if any. */
 	zeek::detail::RuleFileMagicState* magic_state;	/**< File magic signature match state. */
 	MIMEMap mime_types;/**< Mapping of MIME types to analyzers. */
 
@@ -1,20 +1,141 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include <string>
+#include <mutex>
+#include <condition_variable>
 #include <fcntl.h>
+#include <unistd.h>
 
 #include "Extract.h"
 #include "util.h"
 #include "Event.h"
+#include "Reporter.h"
 #include "file_analysis/Manager.h"
+#include "threading/Manager.h"
+#include "threading/TaskPool.h"
+
+#include "analyzer/extract/consts.bif.h"
 
 namespace zeek::file_analysis::detail {
 
+namespace {
+
+enum BackpressurePolicy { WB_BLOCK, WB_TRUNCATE, WB_DROP_FILE };
+
+/**
+ * Writes extracted data from a dedicated thread. All writes and closes go
+ * through a single thread in submission order, so the data for each file
+ * lands on disk in sequence. The amount of data in flight is bounded by
+ * FileExtract::write_behind_max_pending.
+ *
+ * The thread belongs to a pool of the thread manager, which finishes
+ * whatever is still queued when it terminates. By then, terminating the
+ * file manager has destroyed all Extract analyzers.
+ */
+class WriteBehind {
+public:
+	WriteBehind()
+		: max_pending(BifConst::FileExtract::write_behind_max_pending),
+		  pending(0)
+		{
+		auto policy_val = BifConst::FileExtract::write_behind_policy;
+		auto policy_type = policy_val->GetType()->AsEnumType();
+		auto policy_int = policy_val->AsEnum();
+
+		if ( policy_int == policy_type->Lookup("FileExtract", "TRUNCATE") )
+			policy = WB_TRUNCATE;
+		else if ( policy_int == policy_type->Lookup("FileExtract", "DROP_FILE") )
+			policy = WB_DROP_FILE;
+		else
+			policy = WB_BLOCK;
+		}
+
+	static WriteBehind* Instance()
+		{
+		static WriteBehind instance;
+		return &instance;
+		}
+
+	BackpressurePolicy Policy() const	{ return policy; }
+
+	/**
+	 * Queues data for writing. Returns false, without queuing anything,
+	 * if that would exceed the limit and the policy doesn't permit
+	 * blocking.
+	 */
+	bool Write(int fd, std::string data)
+		{
+		size_t n = data.size();
+
+			{
+			std::unique_lock<std::mutex> lock(mtx);
+
+			if ( max_pending && pending + n > max_pending )
+				{
+				// A batch larger than the limit would block forever, so
+				// we let it through once the queue is empty.
+				if ( policy != WB_BLOCK )
+					return false;
+
+				cond.wait(lock, [this, n] { return pending == 0 || pending + n <= max_pending; });
+				}
+
+			pending += n;
+			}
+
+		Pool()->Submit([this, fd, data = std::move(data)]
+			{
+			util::safe_write(fd, data.data(), data.size());
+
+				{
+				std::lock_guard<std::mutex> lock(mtx);
+				pending -= data.size();
+				}
+
+			cond.notify_all();
+			});
+
+		return true;
+		}
+
+	/**
+	 * Queues closing a file after all of its data has been written,
+	 * optionally removing it afterwards.
+	 */
+	void Close(int fd, std::string unlink_path)
+		{
+		Pool()->Submit([fd, unlink_path = std::move(unlink_path)]
+			{
+			util::safe_close(fd);
+
+			if ( ! unlink_path.empty() )
+				unlink(unlink_path.c_str());
+			});
+		}
+
+private:
+	// A single thread keeps the writes in order.
+	static threading::detail::TaskPool* Pool()
+		{
+		return thread_mgr->SharedPool("zk.extract", 1);
+		}
+
+	std::mutex mtx;
+	std::condition_variable cond;
+	BackpressurePolicy policy;
+	size_t max_pending;
+	size_t pending;
+};
+
+} // namespace
+
 Extract::Extract(RecordValPtr args, file_analysis::File* file,
                  const std::string& arg_filename, uint64_t arg_limit)
     : file_analysis::Analyzer(file_mgr->GetComponentTag("EXTRACT"),
                               std::move(args), file),
-      filename(arg_filename), limit(arg_limit), depth(0)
+      filename(arg_filename), limit(arg_limit), depth(0),
+      write_behind(BifConst::FileExtract::write_behind), stopped(false),
+      discard(false)
 	{
 	fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
 
@@ -29,10 +150,69 @@ Extract::Extract(RecordValPtr args, file_analysis::File* file,
 
 Extract::~Extract()
 	{
-	if ( fd )
+	if ( ! fd )
+		return;
+
+	if ( write_behind )
+		{
+		Flush();
+		WriteBehind::Instance()->Close(fd, discard ? filename : "");
+		}
+	else
 		util::safe_close(fd);
 	}
 
+bool Extract::Write(const char* data, uint64_t len)
+	{
+	if ( ! write_behind )
+		{
+		util::safe_write(fd, data, len);
+		return true;
+		}
+
+	if ( stopped )
+		return false;
+
+	// Batch small chunks so that the writer thread can issue fewer,
+	// larger writes.
+	pending.append(data, len);
+
+	if ( pending.size() < BifConst::FileExtract::write_behind_batch_size )
+		return true;
+
+	return Flush();
+	}
+
+bool Extract::Flush()
+	{
+	if ( stopped )
+		return false;
+
+	if ( pending.empty() )
+		return true;
+
+	auto wb = WriteBehind::Instance();
+
+	if ( wb->Write(fd, std::move(pending)) )
+		{
+		pending.clear();
+		return true;
+		}
+
+	// The writer thread can't keep up and we must not block. Either way
+	// we stop extracting; for DROP_FILE, what's been written so far gets
+	// removed once the file is closed.
+	pending.clear();
+	stopped = true;
+	discard = (wb->Policy() == WB_DROP_FILE);
+
+	reporter->Weird(GetFile(), discard ? "file_extraction_write_behind_dropped" :
+	                                     "file_extraction_write_behind_truncated",
+	                filename.c_str());
+
+	return false;
+	}
+
 static const ValPtr& get_extract_field_val(const RecordValPtr& args,
                                            const char* name)
 	{
@@ -107,7 +287,9 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len)
 
 	if ( towrite > 0 )
 		{
-		util::safe_write(fd, reinterpret_cast<const char*>(data), towrite);
+		if ( ! Write(reinterpret_cast<const char*>(data), towrite) )
+			return false;
+
 		depth += towrite;
 		}
 
@@ -119,8 +301,12 @@ bool Extract::Undelivered(uint64_t offset, uint64_t len)
 	if ( depth == offset )
 		{
 		char* tmp = new char[len]();
-		util::safe_write(fd, tmp, len);
+		bool ok = Write(tmp, len);
 		delete [] tmp;
+
+		if ( ! ok )
+			return false;
+
 		depth += len;
 		}
 
@@ -71,10 +71,29 @@ protected:
 	        const std::string& arg_filename, uint64_t arg_limit);
 
 private:
+	/**
+	 * Writes data to the extraction file, either directly or by passing
+	 * it on to the write-behind thread.
+	 * @return false if write-behind backpressure caused the extraction
+	 *         to stop, else true.
+	 */
+	bool Write(const char* data, uint64_t len);
+
+	/**
+	 * Hands all data buffered for the write-behind thread over to it.
+	 * @return false if write-behind backpressure caused the extraction
+	 *         to stop, else true.
+	 */
+	bool Flush();
+
 	std::string filename;
 	int fd;
 	uint64_t limit;
 	uint64_t depth;
+	bool write_behind;
+	bool stopped;	// write-behind backpressure ended extraction
+	bool discard;	// remove the file once closed
+	std::string pending;	// data not yet handed to the write-behind thread
 };
 
 } // namespace zeek::file_analysis::detail
@@ -1,11 +1,18 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include <algorithm>
+#include <iterator>
 #include <string>
 
 #include "Hash.h"
 #include "util.h"
 #include "Event.h"
+#include "Reporter.h"
 #include "file_analysis/Manager.h"
+#include "threading/Manager.h"
+#include "threading/TaskPool.h"
+
+#include "analyzer/hash/consts.bif.h"
 
 namespace zeek::file_analysis::detail {
 
@@ -61,4 +68,208 @@ void Hash::Finalize()
 	);
 	}
 
+// Amount of data fed into each of the digests in turn, sized to remain
+// in L1 cache.
+static constexpr uint64_t MULTI_DIGEST_BLOCK_SIZE = 8192;
+
+static const char* digest_kind(zeek::detail::HashAlgorithm alg)
+	{
+	switch ( alg ) {
+	case zeek::detail::Hash_MD5: return "md5";
+	case zeek::detail::Hash_SHA1: return "sha1";
+	case zeek::detail::Hash_SHA256: return "sha256";
+	default: return nullptr;
+	}
+	}
+
+MultiDigest::MultiDigest(const std::vector<zeek::detail::HashAlgorithm>& algs)
+	: valid(true)
+	{
+	digests.reserve(algs.size());
+
+	for ( auto alg : algs )
+		digests.push_back({alg, zeek::detail::hash_init(alg)});
+	}
+
+MultiDigest::~MultiDigest()
+	{
+	for ( auto& d : digests )
+		if ( d.ctx )
+			EVP_MD_CTX_free(d.ctx);
+	}
+
+void MultiDigest::Update(const u_char* data, uint64_t len)
+	{
+	if ( ! valid )
+		return;
+
+	// Not using zeek::detail::hash_update() here since this may run
+	// outside of the main thread, where we can't use the reporter.
+	while ( len > 0 )
+		{
+		uint64_t n = std::min(len, MULTI_DIGEST_BLOCK_SIZE);
+
+		for ( auto& d : digests )
+			if ( ! EVP_DigestUpdate(d.ctx, data, n) )
+				valid = false;
+
+		data += n;
+		len -= n;
+		}
+	}
+
+std::vector<std::pair<const char*, std::string>> MultiDigest::Final()
+	{
+	std::vector<std::pair<const char*, std::string>> rval;
+	u_char buf[EVP_MAX_MD_SIZE];
+
+	for ( auto& d : digests )
+		{
+		unsigned int n = 0;
+		bool ok = EVP_DigestFinal(d.ctx, buf, &n);
+		EVP_MD_CTX_free(d.ctx);
+		d.ctx = nullptr;
+
+		if ( valid && ok )
+			rval.emplace_back(digest_kind(d.alg), zeek::detail::digest_print(buf, n));
+		}
+
+	if ( ! valid )
+		rval.clear();
+
+	return rval;
+	}
+
+// Shared by all MultiHash analyzers; created on first use and shut down by
+// the thread manager.
+static threading::detail::TaskPool* offload_pool()
+	{
+	return thread_mgr->SharedPool("zk.filehash", BifConst::FileHash::offload_threads);
+	}
+
+MultiHash::MultiHash(RecordValPtr args, file_analysis::File* file,
+                     const std::vector<zeek::detail::HashAlgorithm>& algs)
+	: file_analysis::Analyzer(file_mgr->GetComponentTag("MULTI_HASH"),
+	                          std::move(args), file),
+	  digests(std::make_shared<MultiDigest>(algs)), seen(0), fed(false)
+	{
+	}
+
+MultiHash::~MultiHash()
+	{
+	// Any still pending offloaded work keeps the digests alive by itself,
+	// there's no need to wait for it.
+	}
+
+file_analysis::Analyzer* MultiHash::Instantiate(RecordValPtr args,
+                                                file_analysis::File* file)
+	{
+	if ( ! file_hash )
+		return nullptr;
+
+	static const zeek::detail::HashAlgorithm supported[] = {
+		zeek::detail::Hash_MD5, zeek::detail::Hash_SHA1, zeek::detail::Hash_SHA256
+	};
+
+	std::vector<zeek::detail::HashAlgorithm> algs;
+	const auto& kinds = args->GetField("hash_kinds");
+
+	if ( ! kinds )
+		algs.assign(std::begin(supported), std::end(supported));
+	else
+		{
+		auto lv = kinds->AsTableVal()->ToPureListVal();
+		bool want[std::size(supported)] = { };
+
+		for ( int i = 0; i < lv->Length(); ++i )
+			{
+			auto kind = lv->Idx(i)->AsString()->CheckString();
+			bool found = false;
+
+			for ( size_t j = 0; j < std::size(supported); ++j )
+				if ( util::streq(kind, digest_kind(supported[j])) )
+					found = want[j] = true;
+
+			if ( ! found )
+				reporter->Warning("unsupported hash kind '%s' requested for file %s",
+				                  kind, file->GetID().c_str());
+			}
+
+		// Always compute in the same order so that events are raised
+		// consistently.
+		for ( size_t j = 0; j < std::size(supported); ++j )
+			if ( want[j] )
+				algs.push_back(supported[j]);
+		}
+
+	if ( algs.empty() )
+		return nullptr;
+
+	return new MultiHash(std::move(args), file, algs);
+	}
+
+bool MultiHash::DeliverStream(const u_char* data, uint64_t len)
+	{
+	if ( len == 0 )
+		return true;
+
+	fed = true;
+	seen += len;
+
+	if ( BifConst::FileHash::offload_threads == 0 ||
+	     seen <= BifConst::FileHash::offload_threshold )
+		{
+		digests->Update(data, len);
+		return true;
+		}
+
+	if ( ! offload )
+		offload = std::make_shared<threading::detail::SerialQueue>(offload_pool());
+
+	// Bound the memory held by copies of not-yet-hashed data. If the
+	// workers can't keep up, hashing throttles the main thread just like
+	// hashing inline would.
+	auto max_pending = BifConst::FileHash::offload_max_pending;
+
+	if ( max_pending > 0 )
+		offload->WaitBelow(max_pending > len ? max_pending - len : 0);
+
+	auto chunk = std::make_shared<std::string>(reinterpret_cast<const char*>(data), len);
+	offload->Submit([d = digests, chunk]
+		{
+		d->Update(reinterpret_cast<const u_char*>(chunk->data()), chunk->size());
+		}, len);
+
+	return true;
+	}
+
+bool MultiHash::EndOfFile()
+	{
+	Finalize();
+	return false;
+	}
+
+bool MultiHash::Undelivered(uint64_t offset, uint64_t len)
+	{
+	return false;
+	}
+
+void MultiHash::Finalize()
+	{
+	if ( ! fed || ! file_hash )
+		return;
+
+	if ( offload )
+		offload->Wait();
+
+	fed = false;
+
+	for ( const auto& [kind, digest] : digests->Final() )
+		event_mgr.Enqueue(file_hash,
+		                  GetFile()->ToVal(),
+		                  make_intrusive<StringVal>(kind),
+		                  make_intrusive<StringVal>(digest)
+		);
+	}
+
 } // namespace zeek::file_analysis::detail
@@ -2,7 +2,9 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "Val.h"
 #include "OpaqueVal.h"
@@ -11,6 +13,8 @@
 
 #include "events.bif.h"
 
+ZEEK_FORWARD_DECLARE_NAMESPACED(SerialQueue, zeek, threading, detail);
+
 namespace zeek::file_analysis::detail {
 
 /**
@@ -157,6 +161,130 @@ protected:
 		{}
 };
 
+/**
+ * The running state of a set of digests computed over the same data. It's
+ * kept separate from the analyzer so that it can be updated by a
+ * threading::detail::TaskPool worker while the analyzer may already be gone.
+ */
+class MultiDigest {
+public:
+	/**
+	 * Constructor.
+	 * @param algs the digest algorithms to compute.
+	 */
+	explicit MultiDigest(const std::vector<zeek::detail::HashAlgorithm>& algs);
+
+	/**
+	 * Destructor.
+	 */
+	~MultiDigest();
+
+	/**
+	 * Feeds data into all digests. The data is processed in blocks small
+	 * enough to stay in the CPU's L1 cache while each of the digests
+	 * consumes it, so that the chunk effectively gets read from memory
+	 * only once.  This method does not access any global state and may
+	 * be called from any thread.
+	 * @param data pointer to start of the data.
+	 * @param len number of bytes in the data.
+	 */
+	void Update(const u_char* data, uint64_t len);
+
+	/**
+	 * Finalizes all digests.
+	 * @return pairs of the digest's kind (e.g., "md5") and its
+	 *         hex-encoded value, in the order the algorithms were passed
+	 *         to the constructor.  Empty if an update failed.
+	 */
+	std::vector<std::pair<const char*, std::string>> Final();
+
+private:
+	struct Digest {
+		zeek::detail::HashAlgorithm alg;
+		EVP_MD_CTX* ctx;
+	};
+
+	std::vector<Digest> digests;
+	bool valid;
+};
+
+/**
+ * An analyzer that computes any subset of the MD5, SHA1 and SHA256 digests
+ * of file contents in a single pass over the data.  Once a file grows
+ * beyond FileHash::offload_threshold bytes, further hashing is moved to a
+ * pool of FileHash::offload_threads threads (if non-zero).  The main thread
+ * then only copies the data; it waits for outstanding work before raising
+ * the "file_hash" events, one per digest, in the order md5, sha1, sha256.
+ */
+class MultiHash : public file_analysis::Analyzer {
+public:
+
+	/**
+	 * Destructor.
+	 */
+	~MultiHash() override;
+
+	/**
+	 * Incrementally hash next chunk of file contents.
+	 * @param data pointer to start of a chunk of a file data.
+	 * @param len number of bytes in the data chunk.
+	 * @return always true.
+	 */
+	bool DeliverStream(const u_char* data, uint64_t len) override;
+
+	/**
+	 * Finalizes the hashes and raises "file_hash" events.
+	 * @return always false so analyze will be deteched from file.
+	 */
+	bool EndOfFile() override;
+
+	/**
+	 * Missing data can't be handled, so just indicate the this analyzer should
+	 * be removed from receiving further data.  The hashes will not be finalized.
+	 * @param offset byte offset in file at which missing chunk starts.
+	 * @param len number of missing bytes.
+	 * @return always false so analyzer will detach from file.
+	 */
+	bool Undelivered(uint64_t offset, uint64_t len) override;
+
+	/**
+	 * Create a new instance of the multi-digest hashing file analyzer.
+	 * @param args the \c AnalyzerArgs value which represents the analyzer.
+	 *        Its "hash_kinds" field selects the digests to compute; all
+	 *        supported ones if not set.
+	 * @param file the file to which the analyzer will be attached.
+	 * @return the new analyzer instance or a null pointer if there's no
+	 *         handler for the "file_hash" event or no valid digest kind
+	 *         was requested.
+	 */
+	static file_analysis::Analyzer* Instantiate(RecordValPtr args,
+	                                            file_analysis::File* file);
+
+protected:
+
+	/**
+	 * Constructor.
+	 * @param args the \c AnalyzerArgs value which represents the analyzer.
+	 * @param file the file to which the analyzer will be attached.
+	 * @param algs the digest algorithms to compute.
+	 */
+	MultiHash(RecordValPtr args, file_analysis::File* file,
+	          const std::vector<zeek::detail::HashAlgorithm>& algs);
+
+	/**
+	 * If some file contents have been seen, waits for any offloaded
+	 * hashing to complete, finalizes the digests and raises the
+	 * "file_hash" events with the results.
+	 */
+	void Finalize();
+
+private:
+	std::shared_ptr<MultiDigest> digests;
+	std::shared_ptr<threading::detail::SerialQueue> offload;
+	uint64_t seen;
+	bool fed;
+};
+
 } // namespace zeek::file_analysis
 
 namespace file_analysis {
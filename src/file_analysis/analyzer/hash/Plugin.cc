@@ -13,6 +13,7 @@ public:
 		AddComponent(new zeek::file_analysis::Component("MD5", zeek::file_analysis::detail::MD5::Instantiate));
 		AddComponent(new zeek::file_analysis::Component("SHA1", zeek::file_analysis::detail::SHA1::Instantiate));
 		AddComponent(new zeek::file_analysis::Component("SHA256", zeek::file_analysis::detail::SHA256::Instantiate));
+		AddComponent(new zeek::file_analysis::Component("MULTI_HASH", zeek::file_analysis::detail::MultiHash::Instantiate));
 
 		zeek::plugin::Configuration config;
 		config.name = "Zeek::FileHash";
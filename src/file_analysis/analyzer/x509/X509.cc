@@ -4,9 +4,11 @@
 
 #include "X509.h"
 #include "Event.h"
+#include "Hash.h"
 
 #include "events.bif.h"
 #include "types.bif.h"
+#include "consts.bif.h"
 
 #include "file_analysis/File.h"
 #include "file_analysis/Manager.h"
@@ -70,6 +72,24 @@ bool X509::EndOfFile()
 			}
 		}
 
+	// Next, see if we have parsed the very same certificate recently.
+	uint64_t der_hash = 0;
+	auto cache_size = BifConst::X509::parsed_cache_size;
+
+	if ( cache_size > 0 )
+		{
+		der_hash = zeek::detail::KeyedHash::Hash64(cert_data.data(), cert_data.size());
+		auto it = parsed_cache_index.find(der_hash);
+
+		if ( it != parsed_cache_index.end() && it->second->second.der == cert_data )
+			{
+			// Move to the front of the LRU list.
+			parsed_cache.splice(parsed_cache.begin(), parsed_cache, it->second);
+			RaiseCachedEvents(it->second->second);
+			return false;
+			}
+		}
+
 	// ok, now we can try to parse the certificate with openssl. Should
 	// be rather straightforward...
 	::X509* ssl_cert = d2i_X509(NULL, &cert_char, cert_data.size());
@@ -79,6 +99,10 @@ bool X509::EndOfFile()
 		return false;
 		}
 
+	// Certificates that trigger weirds while parsing don't go into the
+	// cache, as later users would not see them.
+	auto weirds = reporter->GetWeirdCount();
+
 	X509Val* cert_val = new X509Val(ssl_cert); // cert_val takes ownership of ssl_cert
 
 	// parse basic information into record.
@@ -93,14 +117,52 @@ bool X509::EndOfFile()
 
 	// after parsing the certificate - parse the extensions...
 
+	std::vector<ParsedExtension> extensions;
 	int num_ext = X509_get_ext_count(ssl_cert);
 	for ( int k = 0; k < num_ext; ++k )
 		{
 		X509_EXTENSION* ex = X509_get_ext(ssl_cert, k);
-		if ( ! ex )
-			continue;
+		ParsedExtension pe;
+
+		if ( cache_size > 0 )
+			RecordExtensionEvents(&pe.events);
+
+		if ( ex )
+			pe.record = ParseExtension(ex, x509_extension, false);
+
+		RecordExtensionEvents(nullptr);
+
+		if ( cache_size > 0 && pe.record )
+			pe.record = cast_intrusive<RecordVal>(pe.record->Clone());
+
+		extensions.emplace_back(std::move(pe));
+		}
+
+	if ( cache_size > 0 && reporter->GetWeirdCount() == weirds )
+		{
+		// Store copies of the records, since scripts may modify the
+		// ones we just passed on.
+		ParsedCertificate pc{cert_data, IntrusivePtr{NewRef{}, cert_val},
+		                     cast_intrusive<RecordVal>(cert_record->Clone()),
+		                     std::move(extensions)};
+
+		auto it = parsed_cache_index.find(der_hash);
+
+		if ( it != parsed_cache_index.end() )
+			{
+			// A different certificate with the same hash; replace it.
+			parsed_cache.erase(it->second);
+			parsed_cache_index.erase(it);
+			}
+
+		parsed_cache.emplace_front(der_hash, std::move(pc));
+		parsed_cache_index[der_hash] = parsed_cache.begin();
 
-		ParseExtension(ex, x509_extension, false);
+		while ( parsed_cache.size() > cache_size )
+			{
+			parsed_cache_index.erase(parsed_cache.back().first);
+			parsed_cache.pop_back();
+			}
 		}
 
 	// X509_free(ssl_cert); We do _not_ free the certificate here. It is refcounted
@@ -113,6 +175,41 @@ bool X509::EndOfFile()
 	return false;
 	}
 
+void X509::RaiseCachedEvents(const ParsedCertificate& pc)
+	{
+	if ( x509_certificate )
+		event_mgr.Enqueue(x509_certificate,
+		                  GetFile()->ToVal(),
+		                  pc.cert_val,
+		                  pc.cert_record->Clone());
+
+	// Same order as when parsing: each extension's generic event, then
+	// its specific ones.
+	for ( const auto& pe : pc.extensions )
+		{
+		if ( pe.record && x509_extension )
+			event_mgr.Enqueue(x509_extension, GetFile()->ToVal(),
+			                  pe.record->Clone());
+
+		for ( const auto& [h, args] : pe.events )
+			{
+			zeek::Args copy{GetFile()->ToVal()};
+			copy.reserve(args.size() + 1);
+
+			for ( const auto& a : args )
+				copy.emplace_back(a->Clone());
+
+			event_mgr.Enqueue(h, std::move(copy));
+			}
+		}
+	}
+
+void X509::FlushParsedCache()
+	{
+	parsed_cache_index.clear();
+	parsed_cache.clear();
+	}
+
 RecordValPtr X509::ParseCertificate(X509Val* cert_val,
                                     file_analysis::File* f)
 	{
@@ -297,10 +394,8 @@ void X509::ParseBasicConstraints(X509_EXTENSION* ex)
 			if ( constr->pathlen )
 				pBasicConstraint->Assign(1, val_mgr->Count((int32_t) ASN1_INTEGER_get(constr->pathlen)));
 
-			event_mgr.Enqueue(x509_ext_basic_constraints,
-			                  GetFile()->ToVal(),
-			                  std::move(pBasicConstraint)
-			);
+			EnqueueExtensionEvent(x509_ext_basic_constraints,
+			                      {std::move(pBasicConstraint)});
 			}
 
 		BASIC_CONSTRAINTS_free(constr);
@@ -438,9 +533,8 @@ void X509::ParseSAN(X509_EXTENSION* ext)
 
 		sanExt->Assign(4, val_mgr->Bool(otherfields));
 
-		event_mgr.Enqueue(x509_ext_subject_alternative_name,
-		                        GetFile()->ToVal(),
-		                        std::move(sanExt));
+		EnqueueExtensionEvent(x509_ext_subject_alternative_name,
+		                      {std::move(sanExt)});
 	GENERAL_NAMES_free(altname);
 	}
 
@@ -4,6 +4,9 @@
 
 #include <string>
 #include <map>
+#include <list>
+#include <unordered_map>
+#include <vector>
 
 #include "OpaqueVal.h"
 #include "X509Common.h"
@@ -114,6 +117,12 @@ public:
 	 */
 	static void FreeRootStore();
 
+	/**
+	 * Empties the cache of parsed certificates (see
+	 * X509::parsed_cache_size).
+	 */
+	static void FlushParsedCache();
+
 	/**
 	 * Sets the table[string] that used as the certificate cache inside of Zeek.
 	 */
@@ -136,6 +145,40 @@ private:
 
 	std::string cert_data;
 
+	/**
+	 * The events raised for an extension of a cached certificate.
+	 */
+	struct ParsedExtension {
+		RecordValPtr record;	// for x509_extension, if raised
+		ExtensionEvents events;	// for the specific extension events
+	};
+
+	/**
+	 * The results of parsing a certificate, as kept in the LRU cache
+	 * of parsed certificates.
+	 */
+	struct ParsedCertificate {
+		std::string der;
+		ValPtr cert_val;	// the X509Val
+		RecordValPtr cert_record;
+		std::vector<ParsedExtension> extensions;	// by extension index
+	};
+
+	/**
+	 * Raises the events for a certificate parsed earlier, without parsing
+	 * it or its extensions again. All event arguments are passed on as
+	 * copies, so that scripts modifying them don't affect later users of
+	 * the cache entry.
+	 */
+	void RaiseCachedEvents(const ParsedCertificate& pc);
+
+	using ParsedCacheList = std::list<std::pair<uint64_t, ParsedCertificate>>;
+
+	/** LRU cache of parsed certificates, keyed by hash of their DER encoding. */
+	inline static ParsedCacheList parsed_cache = ParsedCacheList();
+	inline static std::unordered_map<uint64_t, ParsedCacheList::iterator> parsed_cache_index =
+		std::unordered_map<uint64_t, ParsedCacheList::iterator>();
+
 	// Helpers for ParseCertificate.
 	static StringValPtr KeyCurve(EVP_PKEY* key);
 	static unsigned int KeyLength(EVP_PKEY *key);
@@ -3,6 +3,7 @@
 #include "X509Common.h"
 #include "x509-extension_pac.h"
 #include "Reporter.h"
+#include "Event.h"
 
 #include "events.bif.h"
 #include "ocsp_events.bif.h"
@@ -232,7 +233,28 @@ void X509Common::ParseSignedCertificateTimestamps(X509_EXTENSION* ext)
 	delete conn;
 	}
 
-void X509Common::ParseExtension(X509_EXTENSION* ex, const EventHandlerPtr& h, bool global)
+void X509Common::EnqueueExtensionEvent(const EventHandlerPtr& h, zeek::Args args)
+	{
+	if ( ! h )
+		return;
+
+	if ( recorded_events )
+		{
+		// Scripts may modify what they get, so keep copies.
+		zeek::Args copy;
+		copy.reserve(args.size());
+
+		for ( const auto& a : args )
+			copy.emplace_back(a->Clone());
+
+		recorded_events->emplace_back(h, std::move(copy));
+		}
+
+	args.insert(args.begin(), GetFile()->ToVal());
+	event_mgr.Enqueue(h, std::move(args));
+	}
+
+RecordValPtr X509Common::ParseExtension(X509_EXTENSION* ex, const EventHandlerPtr& h, bool global)
 	{
 	char name[256];
 	char oid[256];
@@ -265,7 +287,7 @@ void X509Common::ParseExtension(X509_EXTENSION* ex, const EventHandlerPtr& h, bo
 		{
 		// let individual analyzers parse more.
 		ParseExtensionsSpecific(ex, global, ext_asn, oid);
-		return;
+		return nullptr;
 		}
 
 	if ( ! ext_val )
@@ -290,13 +312,15 @@ void X509Common::ParseExtension(X509_EXTENSION* ex, const EventHandlerPtr& h, bo
 
 	if ( h == ocsp_extension )
 		event_mgr.Enqueue(h, GetFile()->ToVal(),
-		                  std::move(pX509Ext),
+		                  pX509Ext,
 		                  val_mgr->Bool(global));
 	else
-		event_mgr.Enqueue(h, GetFile()->ToVal(), std::move(pX509Ext));
+		event_mgr.Enqueue(h, GetFile()->ToVal(), pX509Ext);
 
 	// let individual analyzers parse more.
 	ParseExtensionsSpecific(ex, global, ext_asn, oid);
+
+	return pX509Ext;
 	}
 
 StringValPtr X509Common::GetExtensionFromBIO(BIO* bio, file_analysis::File* f)
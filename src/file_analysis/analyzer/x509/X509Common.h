@@ -5,12 +5,16 @@
 
 #pragma once
 
+#include <utility>
+#include <vector>
+
 #include "file_analysis/Analyzer.h"
+#include "EventHandler.h"
+#include "ZeekArgs.h"
 
 #include <openssl/x509.h>
 #include <openssl/asn1.h>
 
-ZEEK_FORWARD_DECLARE_NAMESPACED(EventHandlerPtr, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Reporter, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(StringVal, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(File, zeek, file_analysis);
@@ -43,14 +47,45 @@ public:
 	static double GetTimeFromAsn1(const ASN1_TIME* atime, file_analysis::File* f,
 	                              Reporter* reporter);
 
+	/**
+	 * Events for specific extensions, with their arguments after the
+	 * file's.
+	 */
+	using ExtensionEvents = std::vector<std::pair<EventHandlerPtr, zeek::Args>>;
+
+	/**
+	 * Raises an event for a specific extension, prepending the file to
+	 * its arguments. While recording (see RecordExtensionEvents()), this
+	 * also keeps copies of the arguments.
+	 */
+	void EnqueueExtensionEvent(const EventHandlerPtr& h, zeek::Args args);
+
 protected:
 	X509Common(const file_analysis::Tag& arg_tag,
 	           RecordValPtr arg_args,
 	           file_analysis::File* arg_file);
 
-	void ParseExtension(X509_EXTENSION* ex, const EventHandlerPtr& h, bool global);
+	/**
+	 * Parses an extension and raises the generic extension event *h*
+	 * as well as any specific ones.
+	 * @return the record passed to *h*, or null if there's no handler
+	 *         for it.
+	 */
+	RecordValPtr ParseExtension(X509_EXTENSION* ex, const EventHandlerPtr& h, bool global);
 	void ParseSignedCertificateTimestamps(X509_EXTENSION* ext);
 	virtual void ParseExtensionsSpecific(X509_EXTENSION* ex, bool, ASN1_OBJECT*, const char*) = 0;
+
+	/**
+	 * Starts or stops keeping the events that EnqueueExtensionEvent()
+	 * raises.
+	 *
+	 * @param events where to append the events, or null to stop.
+	 */
+	void RecordExtensionEvents(ExtensionEvents* events)
+		{ recorded_events = events; }
+
+private:
+	ExtensionEvents* recorded_events = nullptr;
 };
 
 } // namespace zeek::file_analysis
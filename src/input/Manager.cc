@@ -103,6 +103,13 @@ public:
 	PDict<InputHash>* currDict;
 	PDict<InputHash>* lastDict;
 
+	// With $replace, and without predicate and events, there's no need
+	// to track changes per entry. The entries of an update then go into
+	// a staging table first, which replaces the contents of tab once
+	// complete.
+	bool bulk;
+	TableVal* staging;
+
 	Func* pred;
 
 	EventHandlerPtr event;
@@ -134,7 +141,7 @@ public:
 Manager::TableStream::TableStream()
 	: Manager::Stream::Stream(TABLE_STREAM),
 	  num_idx_fields(), num_val_fields(), want_record(), tab(), rtype(),
-	  itype(), currDict(), lastDict(), pred(), event()
+	  itype(), currDict(), lastDict(), bulk(), staging(), pred(), event()
 	{
 	}
 
@@ -161,6 +168,9 @@ Manager::TableStream::~TableStream()
 	if ( rtype ) // can be 0 for sets
 		Unref(rtype);
 
+	if ( staging )
+		Unref(staging);
+
 	if ( currDict )
 		{
 		currDict->Clear();
@@ -268,6 +278,9 @@ bool Manager::CreateStream(Stream* info, RecordVal* description)
 			return false;
 		}
 
+	if ( info->stream_type == TABLE_STREAM )
+		rinfo.num_key_fields = static_cast<TableStream*>(info)->num_idx_fields;
+
 	auto config = description->GetFieldOrDefault("config");
 	info->config = config.release()->AsTableVal();
 
@@ -675,6 +688,8 @@ bool Manager::CreateTableStream(RecordVal* fval)
 		}
 
 	TableStream* stream = new TableStream();
+	stream->num_idx_fields = idxfields;
+
 		{
 		bool res = CreateStream(stream, fval);
 		if ( ! res )
@@ -690,7 +705,6 @@ bool Manager::CreateTableStream(RecordVal* fval)
 		fields[i] = fieldsV[i];
 
 	stream->pred = pred ? pred->AsFunc() : nullptr;
-	stream->num_idx_fields = idxfields;
 	stream->num_val_fields = valfields;
 	stream->tab = dst.release()->AsTableVal();
 	stream->rtype = val.release();
@@ -703,6 +717,31 @@ bool Manager::CreateTableStream(RecordVal* fval)
 	stream->lastDict->SetDeleteFunc(input_hash_delete_func);
 	stream->want_record = ( want_record->InternalInt() == 1 );
 
+	// Replacing all of the table's entries at once drops whatever others
+	// put into it, so scripts have to ask for it. It would also bypass
+	// the table's change handlers, and reset the expiration of unchanged
+	// entries.
+	stream->bulk = fval->GetFieldOrDefault("replace")->InternalInt() &&
+		! stream->pred && ! stream->event &&
+		! stream->tab->GetAttr(zeek::detail::ATTR_ON_CHANGE) &&
+		! stream->tab->GetAttr(zeek::detail::ATTR_BROKER_STORE) &&
+		! stream->tab->GetAttr(zeek::detail::ATTR_BACKEND) &&
+		! stream->tab->GetAttr(zeek::detail::ATTR_EXPIRE_READ) &&
+		! stream->tab->GetAttr(zeek::detail::ATTR_EXPIRE_WRITE) &&
+		! stream->tab->GetAttr(zeek::detail::ATTR_EXPIRE_CREATE);
+
+	for ( const auto& r : readers )
+		{
+		if ( r.second->stream_type != TABLE_STREAM )
+			continue;
+
+		auto other = static_cast<const TableStream*>(r.second);
+
+		if ( other->tab == stream->tab && (other->bulk || stream->bulk) )
+			reporter->Warning("Input streams %s and %s share a destination table, which one of them replaces with each update",
+			                  other->name.c_str(), stream->name.c_str());
+		}
+
 	assert(stream->reader);
 	stream->reader->Init(fieldsV.size(), fields );
 
@@ -1119,6 +1158,9 @@ int Manager::SendEntryTable(Stream* i, const Value* const *vals)
 	assert(i->stream_type == TABLE_STREAM);
 	TableStream* stream = (TableStream*) i;
 
+	if ( stream->bulk )
+		return StageEntryTable(i, vals);
+
 	zeek::detail::HashKey* idxhash = HashValues(stream->num_idx_fields, vals);
 
 	if ( idxhash == nullptr )
@@ -1313,6 +1355,49 @@ int Manager::SendEntryTable(Stream* i, const Value* const *vals)
 	return stream->num_val_fields + stream->num_idx_fields;
 	}
 
+int Manager::StageEntryTable(Stream* i, const Value* const *vals)
+	{
+	TableStream* stream = (TableStream*) i;
+
+	if ( ! stream->staging )
+		{
+		stream->staging = new TableVal(stream->tab->GetType<TableType>());
+
+		// Updates tend to be about as large as the previous one.
+		stream->staging->Reserve(stream->tab->Size());
+		}
+
+	Val* valval;
+	int position = stream->num_idx_fields;
+	bool convert_error = false; // this will be set to true by ValueTo* on Error
+
+	if ( stream->num_val_fields == 0 )
+		valval = nullptr;
+
+	else if ( stream->num_val_fields == 1 && !stream->want_record )
+		valval = ValueToVal(i, vals[position], stream->rtype->GetFieldType(0).get(), convert_error);
+
+	else
+		valval = ValueToRecordVal(i, vals, stream->rtype, &position, convert_error);
+
+	Val* idxval = nullptr;
+
+	if ( ! convert_error )
+		idxval = ValueToIndexVal(i, stream->num_idx_fields, stream->itype, vals, convert_error);
+
+	if ( convert_error )
+		{
+		Unref(valval);
+		Unref(idxval);
+		return stream->num_val_fields + stream->num_idx_fields;
+		}
+
+	assert(idxval);
+	stream->staging->Assign({AdoptRef{}, idxval}, {AdoptRef{}, valval});
+
+	return stream->num_val_fields + stream->num_idx_fields;
+	}
+
 void Manager::EndCurrentSend(ReaderFrontend* reader)
 	{
 	Stream *i = FindStream(reader);
@@ -1341,6 +1426,20 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 	assert(i->stream_type == TABLE_STREAM);
 	TableStream* stream = (TableStream*) i;
 
+	if ( stream->bulk )
+		{
+		// Without any entries sent, the table ends up empty.
+		if ( ! stream->staging )
+			stream->staging = new TableVal(stream->tab->GetType<TableType>());
+
+		stream->tab->SwapContents(stream->staging);
+		Unref(stream->staging);
+		stream->staging = nullptr;
+
+		SendEndOfData(i);
+		return;
+		}
+
 	// lastdict contains all deleted entries and should be empty apart from that
 	IterCookie *c = stream->lastDict->InitForIteration();
 	stream->lastDict->MakeRobustCookie(c);
@@ -119,6 +119,7 @@ protected:
 	friend class DeleteMessage;
 	friend class ClearMessage;
 	friend class SendEntryMessage;
+	friend class SendEntriesMessage;
 	friend class EndCurrentSendMessage;
 	friend class ReaderClosedMessage;
 	friend class DisableMessage;
@@ -190,6 +191,11 @@ private:
 	// SendEntry implementation for Table stream.
 	int SendEntryTable(Stream* i, const threading::Value* const *vals);
 
+	// SendEntry implementation for Table streams in bulk mode, which
+	// collects the entries in a staging table that replaces the
+	// destination's contents at EndCurrentSend.
+	int StageEntryTable(Stream* i, const threading::Value* const *vals);
+
 	// Put implementation for Table stream.
 	int PutTable(Stream* i, const threading::Value* const *vals);
 
@@ -90,6 +90,24 @@ private:
 	Value* *val;
 };
 
+class SendEntriesMessage final : public threading::OutputMessage<ReaderFrontend> {
+public:
+	SendEntriesMessage(ReaderFrontend* reader, std::vector<Value**> rows)
+		: threading::OutputMessage<ReaderFrontend>("SendEntries", reader),
+		rows(std::move(rows)) { }
+
+	bool Process() override
+		{
+		for ( auto vals : rows )
+			input_mgr->SendEntry(Object(), vals);
+
+		return true;
+		}
+
+private:
+	std::vector<Value**> rows;
+};
+
 class EndCurrentSendMessage final : public threading::OutputMessage<ReaderFrontend> {
 public:
 	EndCurrentSendMessage(ReaderFrontend* reader)
@@ -220,6 +238,11 @@ void ReaderBackend::SendEntry(Value* *vals)
 	SendOut(new SendEntryMessage(frontend, vals));
 	}
 
+void ReaderBackend::SendEntries(std::vector<Value**> rows)
+	{
+	SendOut(new SendEntriesMessage(frontend, std::move(rows)));
+	}
+
 bool ReaderBackend::Init(const int arg_num_fields,
 		         const threading::Field* const* arg_fields)
 	{
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "ZeekString.h"
 
 #include "threading/SerialTypes.h"
@@ -102,11 +104,18 @@ public:
 		 */
 		ReaderMode mode;
 
+		/**
+		 * For table streams, the number of leading fields that make
+		 * up the table's index. Zero for other streams.
+		 */
+		int num_key_fields;
+
 		ReaderInfo()
 			{
 			source = nullptr;
 			name = nullptr;
 			mode = MODE_NONE;
+			num_key_fields = 0;
 			}
 
 		ReaderInfo(const ReaderInfo& other)
@@ -114,6 +123,7 @@ public:
 			source = other.source ? util::copy_string(other.source) : nullptr;
 			name = other.name ? util::copy_string(other.name) : nullptr;
 			mode = other.mode;
+			num_key_fields = other.num_key_fields;
 
 			for ( config_map::const_iterator i = other.config.begin(); i != other.config.end(); i++ )
 				config.insert(std::make_pair(util::copy_string(i->first), util::copy_string(i->second)));
@@ -339,6 +349,16 @@ protected:
 	 */
 	void SendEntry(threading::Value** vals);
 
+	/**
+	 * Sends a batch of entries in tracking mode. This is equivalent to
+	 * calling SendEntry() for each of them, but passes them on to the
+	 * main thread in a single message.
+	 *
+	 * @param rows The entries, each as for SendEntry(). The method
+	 * takes ownership of them.
+	 */
+	void SendEntries(std::vector<threading::Value**> rows);
+
 	/**
 	 * Method telling the manager, that the current list of entries sent
 	 * by SendEntry is finished.
@@ -1,9 +1,14 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include <sstream>
+#include <cstdarg>
+#include <cstring>
+#include <deque>
+#include <future>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 
@@ -11,6 +16,8 @@
 #include "ascii.bif.h"
 
 #include "threading/SerialTypes.h"
+#include "threading/Manager.h"
+#include "threading/TaskPool.h"
 
 using namespace std;
 using zeek::threading::Value;
@@ -53,6 +60,8 @@ Ascii::Ascii(ReaderFrontend *frontend) : ReaderBackend(frontend)
 	ino = 0;
 	fail_on_file_problem = false;
 	fail_on_invalid_lines = false;
+	parse_threads = 0;
+	changes_only = false;
 	}
 
 Ascii::~Ascii()
@@ -85,6 +94,9 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 	path_prefix.assign((const char*) BifConst::InputAscii::path_prefix->Bytes(),
 	                   BifConst::InputAscii::path_prefix->Len());
 
+	parse_threads = BifConst::InputAscii::parse_threads;
+	changes_only = BifConst::InputAscii::changes_only;
+
 	// Set per-filter configuration options.
 	for ( ReaderInfo::config_map::const_iterator i = info.config.begin(); i != info.config.end(); i++ )
 		{
@@ -105,6 +117,12 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 
 		else if ( strcmp(i->first, "fail_on_file_problem") == 0 )
 			fail_on_file_problem = (strncmp(i->second, "T", 1) == 0);
+
+		else if ( strcmp(i->first, "parse_threads") == 0 )
+			parse_threads = strtoul(i->second, nullptr, 10);
+
+		else if ( strcmp(i->first, "changes_only") == 0 )
+			changes_only = (strncmp(i->second, "T", 1) == 0);
 		}
 
 	if ( separator.size() != 1 )
@@ -113,7 +131,7 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 	if ( set_separator.size() != 1 )
 		Error("set_separator length has to be 1. Separator will be truncated.");
 
-	threading::formatter::Ascii::SeparatorInfo sep_info(separator, set_separator, unset_field, empty_field);
+	sep_info = threading::formatter::Ascii::SeparatorInfo(separator, set_separator, unset_field, empty_field);
 	formatter = unique_ptr<threading::Formatter>(new threading::formatter::Ascii(this, sep_info));
 
 	return DoUpdate();
@@ -332,116 +350,607 @@ bool Ascii::DoUpdate()
 
 		}
 
+	if ( Info().mode != MODE_STREAM )
+		return ReadAll();
+
 	string line;
 
 	file.sync();
 
 	while ( GetLine(line) )
 		{
-		// split on tabs
-		bool error = false;
-		istringstream splitstream(line);
+		Parsed parsed(NumFields());
+		ParseLine(line.data(), line.size(), columnMap, formatter.get(), nullptr, &parsed);
+
+		if ( ! Send(&parsed, SEND_PUT, nullptr) )
+			return false;
+		}
+
+	return true;
+	}
+
+// The amount of data to read at once, and to hand to a thread for parsing.
+static const size_t CHUNK_SIZE = 256 * 1024;
+
+// The number of rows to send to the input manager in one message.
+static const size_t SEND_BATCH_SIZE = 10000;
+
+// Shared by all Ascii readers; created on first use and shut down by the
+// thread manager.
+static threading::detail::TaskPool* parse_pool(size_t num_threads)
+	{
+	return thread_mgr->SharedPool("zk.inparse", num_threads);
+	}
+
+// Like util::fmt(), but safe to use from any thread.
+static string safe_fmt(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static string safe_fmt(const char* fmt, ...)
+	{
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(nullptr, 0, fmt, ap);
+	va_end(ap);
+
+	string s(n, '\0');
+
+	va_start(ap, fmt);
+	vsnprintf(&s[0], n + 1, fmt, ap);
+	va_end(ap);
+
+	return s;
+	}
+
+// Reads the next chunk of complete lines from a file, keeping any
+// incomplete last line in *carry for the next call. Returns false at
+// the end of the file, or on error, which then sets *error to the errno.
+static bool read_lines(int fd, string* carry, string* chunk, int* error)
+	{
+	chunk->swap(*carry);
+	carry->clear();
+
+	while ( true )
+		{
+		size_t old = chunk->size();
+		chunk->resize(old + CHUNK_SIZE);
 
-		map<int, string> stringfields;
-		int pos = 0;
-		while ( splitstream )
+		ssize_t n = read(fd, &(*chunk)[old], CHUNK_SIZE);
+
+		if ( n < 0 )
 			{
-			string s;
-			if ( ! getline(splitstream, s, separator[0]) )
-				break;
+			chunk->resize(old);
+
+			if ( errno == EINTR )
+				continue;
 
-			stringfields[pos] = s;
-			pos++;
+			*error = errno;
+			return false;
 			}
 
-		pos--; // for easy comparisons of max element.
+		chunk->resize(old + n);
 
-		Value** fields = new Value*[NumFields()];
+		if ( n == 0 )
+			// A last line doesn't need to be terminated.
+			return ! chunk->empty();
 
-		int fpos = 0;
-		for ( vector<FieldMapping>::iterator fit = columnMap.begin();
-			fit != columnMap.end();
-			fit++ )
+		auto nl = chunk->rfind('\n');
+
+		if ( nl != string::npos )
 			{
+			carry->assign(*chunk, nl + 1, string::npos);
+			chunk->resize(nl + 1);
+			return true;
+			}
+		}
+	}
 
-			if ( ! fit->present )
-				{
-				// add non-present field
-				fields[fpos] = new Value((*fit).type, false);
-				fpos++;
+Ascii::Parsed::~Parsed()
+	{
+	for ( auto vals : rows )
+		{
+		if ( ! vals )
+			continue;
+
+		for ( int i = 0; i < num_fields; i++ )
+			delete vals[i];
+
+		delete [] vals;
+		}
+	}
+
+bool Ascii::ReadAll()
+	{
+	// The header has been read through the stream already; continue
+	// after it.
+	auto offset = file.is_open() ? file.tellg() : std::streampos(-1);
+
+	int fd = -1;
+
+	if ( offset >= 0 )
+		{
+		fd = open(fname.c_str(), O_RDONLY);
+
+		if ( fd < 0 || lseek(fd, offset, SEEK_SET) < 0 )
+			{
+			FailWarn(fail_on_file_problem, Fmt("Could not read %s: %s", fname.c_str(), strerror(errno)), true);
+
+			if ( fd >= 0 )
+				close(fd);
+
+			return ! fail_on_file_problem;
+			}
+		}
+
+	// Without data to read (including when the file couldn't be opened)
+	// this sends an empty set of entries, as reading line by line would.
+	bool ok;
+
+	if ( changes_only )
+		ok = ReadChanges(fd);
+
+	else
+		{
+		string carry;
+		int error = 0;
+
+		auto next_chunk = [&](string* chunk)
+			{
+			return fd >= 0 && read_lines(fd, &carry, chunk, &error);
+			};
+
+		ok = ParseAndSend(next_chunk, true, columnMap, SEND_ENTRY);
+
+		if ( error )
+			{
+			FailWarn(fail_on_file_problem, Fmt("Could not read %s: %s", fname.c_str(), strerror(error)), true);
+			ok = ok && ! fail_on_file_problem;
+			}
+
+		else if ( ok )
+			EndCurrentSend();
+		}
+
+	if ( fd >= 0 )
+		close(fd);
+
+	return ok;
+	}
+
+bool Ascii::ReadChanges(int fd)
+	{
+	auto current = make_unique<LineSet>();
+	current->headerline = headerline;
+	current->columns = columnMap;
+
+	if ( fd >= 0 )
+		{
+		string carry;
+		string chunk;
+		int error = 0;
+
+		while ( read_lines(fd, &carry, &chunk, &error) )
+			current->data += chunk;
+
+		if ( error )
+			{
+			FailWarn(fail_on_file_problem, Fmt("Could not read %s: %s", fname.c_str(), strerror(error)), true);
+			return ! fail_on_file_problem;
+			}
+		}
+
+	// With a different header, the same line may now mean something else,
+	// so all of the old lines go, and all of the new ones come.
+	bool same_header = last_lines && last_lines->headerline == headerline;
+
+	string added;
+	string removed;
+
+	const char* p = current->data.data();
+	const char* end = p + current->data.size();
+	const char* line;
+	size_t len;
+
+	while ( NextLine(&p, end, true, &line, &len) )
+		{
+		auto [it, is_new] = current->lines.insert_or_assign(LineKey(line, len, columnMap),
+		                                                    string_view(line, len));
+
+		if ( is_new )
+			current->order.push_back(&it->first);
+		}
+
+	for ( auto key : current->order )
+		{
+		auto l = current->lines[*key];
+
+		if ( same_header )
+			{
+			auto old = last_lines->lines.find(*key);
+
+			if ( old != last_lines->lines.end() && old->second == l )
 				continue;
-				}
+			}
 
-			assert(fit->position >= 0 );
+		// A changed line for an existing key simply replaces the old one.
+		added.append(l.data(), l.size());
+		added += '\n';
+		}
 
-			if ( (*fit).position > pos || (*fit).secondary_position > pos )
+	if ( last_lines )
+		{
+		for ( auto key : last_lines->order )
+			{
+			if ( ! same_header || current->lines.count(*key) == 0 )
 				{
-				FailWarn(fail_on_invalid_lines, Fmt("Not enough fields in line '%s' of %s. Found %d fields, want positions %d and %d",
-				                                    line.c_str(), fname.c_str(), pos, (*fit).position, (*fit).secondary_position));
+				auto l = last_lines->lines[*key];
+				removed.append(l.data(), l.size());
+				removed += '\n';
+				}
+			}
+		}
 
-				if ( fail_on_invalid_lines )
-					{
-					for ( int i = 0; i < fpos; i++ )
-						delete fields[i];
+	// Split a buffer of lines into chunks for parsing.
+	auto chunks_of = [](const string& buf)
+		{
+		return [&buf, pos = size_t(0)](string* chunk) mutable
+			{
+			if ( pos >= buf.size() )
+				return false;
 
-					delete [] fields;
+			auto end = buf.find('\n', min(pos + CHUNK_SIZE, buf.size() - 1));
+			end = (end == string::npos ? buf.size() : end + 1);
 
-					return false;
-					}
-				else
-					{
-					error = true;
-					break;
-					}
-				}
+			chunk->assign(buf, pos, end - pos);
+			pos = end;
+			return true;
+			};
+		};
+
+	// Removed lines go first, as after a change of header, old and new
+	// ones may map to the same table index.
+	if ( last_lines && ! ParseAndSend(chunks_of(removed), false, last_lines->columns, SEND_DELETE) )
+		return false;
 
-			Value* val = formatter->ParseValue(stringfields[(*fit).position], (*fit).name, (*fit).type, (*fit).subtype);
+	if ( ! ParseAndSend(chunks_of(added), false, columnMap, SEND_PUT) )
+		return false;
 
-			if ( ! val )
+	last_lines = std::move(current);
+	EndOfData();
+	return true;
+	}
+
+bool Ascii::ParseAndSend(const std::function<bool (string*)>& next_chunk, bool filter,
+                         const vector<FieldMapping>& columns, SendMode mode)
+	{
+	// A chunk of lines, parsed by a thread of the pool unless we're
+	// parsing in this thread. Each gets its own formatter, as these
+	// aren't thread-safe; the formatters' warnings are reported once
+	// the chunk's rows are sent.
+	struct Chunk {
+		explicit Chunk(int num_fields) : parsed(num_fields)	{ }
+
+		string data;
+		Parsed parsed;
+		unique_ptr<threading::Formatter> formatter;
+		vector<string> warnings;
+		future<void> done;
+	};
+
+	auto pool = parse_threads > 0 ? parse_pool(parse_threads) : nullptr;
+
+	// Don't let reading get too far ahead of sending, so that memory
+	// stays bounded.
+	size_t max_pending = pool ? 2 * pool->NumThreads() : 1;
+
+	deque<unique_ptr<Chunk>> pending;
+	vector<Value**> batch;
+	bool more = true;
+	bool ok = true;
+
+	while ( ok )
+		{
+		while ( more && pending.size() < max_pending )
+			{
+			auto c = make_unique<Chunk>(NumFields());
+
+			if ( ! next_chunk(&c->data) )
 				{
-				Warning(Fmt("Could not convert line '%s' of %s to Val. Ignoring line.", line.c_str(), fname.c_str()));
-				error = true;
+				more = false;
 				break;
 				}
 
-			if ( (*fit).secondary_position != -1 )
+			c->formatter = make_unique<threading::formatter::Ascii>(this, sep_info);
+			c->formatter->CollectWarnings(&c->warnings);
+
+			auto task = make_shared<packaged_task<void()>>([this, c = c.get(), filter, &columns]
 				{
-				// we have a port definition :)
-				assert(val->type == TYPE_PORT );
-				//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
+				ParseLines(c->data, filter, columns, c->formatter.get(), &c->warnings, &c->parsed);
+				});
 
-				val->val.port_val.proto = formatter->ParseProto(stringfields[(*fit).secondary_position]);
-				}
+			c->done = task->get_future();
 
-			fields[fpos] = val;
+			if ( pool )
+				pool->Submit([task] { (*task)(); });
+			else
+				(*task)();
 
-			fpos++;
+			pending.push_back(std::move(c));
 			}
 
-		if ( error )
+		if ( pending.empty() )
+			break;
+
+		pending.front()->done.wait();
+		ok = Send(&pending.front()->parsed, mode, &batch);
+		pending.pop_front();
+		}
+
+	// After an error, the chunks still being parsed must finish before
+	// they can be released.
+	for ( auto& c : pending )
+		c->done.wait();
+
+	if ( ! batch.empty() )
+		SendEntries(std::move(batch));
+
+	return ok;
+	}
+
+string Ascii::LineKey(const char* line, size_t len, const vector<FieldMapping>& columns) const
+	{
+	auto num_key_fields = min(static_cast<size_t>(Info().num_key_fields), columns.size());
+
+	if ( num_key_fields == 0 )
+		return string(line, len);
+
+	// Split the way ParseLine() does.
+	vector<string_view> fields;
+
+	for ( size_t start = 0; start < len; )
+		{
+		auto sep = static_cast<const char*>(memchr(line + start, separator[0], len - start));
+		size_t end = sep ? sep - line : len;
+		fields.emplace_back(line + start, end - start);
+		start = end + 1;
+		}
+
+	// Newlines can't appear within fields, and thus separate them here.
+	string key;
+
+	for ( size_t i = 0; i < num_key_fields; i++ )
+		{
+		const auto& c = columns[i];
+
+		if ( ! c.present )
+			continue;
+
+		if ( c.position >= static_cast<int>(fields.size()) ||
+		     c.secondary_position >= static_cast<int>(fields.size()) )
+			// An invalid line, which the parser will complain about.
+			// Keep it apart from the valid ones.
+			return "\n" + string(line, len);
+
+		key.append(fields[c.position]);
+		key += '\n';
+
+		if ( c.secondary_position != -1 )
 			{
-			// Encountered non-fatal error, ignoring line. But
-			// first, delete all successfully read fields and the
-			// array structure.
+			key.append(fields[c.secondary_position]);
+			key += '\n';
+			}
+		}
+
+	return key;
+	}
+
+bool Ascii::NextLine(const char** p, const char* end, bool filter,
+                     const char** line, size_t* len) const
+	{
+	while ( *p < end )
+		{
+		const char* start = *p;
+		auto nl = static_cast<const char*>(memchr(start, '\n', end - start));
+		size_t n = (nl ? nl : end) - start;
+		*p = nl ? nl + 1 : end;
+
+		if ( filter )
+			{
+			// Skip the same lines as GetLine().
+			if ( n == 0 )
+				continue;
+
+			if ( start[n - 1] == '\r' )
+				--n;
+
+			if ( n > 0 && start[0] == '#' )
+				{
+				if ( n <= 8 || memcmp(start, "#fields", 7) != 0 || start[7] != separator[0] )
+					continue;
+
+				start += 8;
+				n -= 8;
+				}
+			}
+
+		*line = start;
+		*len = n;
+		return true;
+		}
+
+	return false;
+	}
+
+void Ascii::ParseLines(const string& data, bool filter, const vector<FieldMapping>& columns,
+                       const threading::Formatter* f, vector<string>* warnings,
+                       Parsed* out) const
+	{
+	const char* p = data.data();
+	const char* end = p + data.size();
+	const char* line;
+	size_t len;
+
+	while ( ! out->failed && NextLine(&p, end, filter, &line, &len) )
+		ParseLine(line, len, columns, f, warnings, out);
+	}
+
+void Ascii::ParseLine(const char* line, size_t len, const vector<FieldMapping>& columns,
+                      const threading::Formatter* f, vector<string>* warnings,
+                      Parsed* out) const
+	{
+	// This may run in a thread of the parse pool, and thus must not use
+	// any of the MsgThread's methods; problems are recorded in *out.
+	auto add_message = [out](bool invalid_line, string text)
+		{
+		out->messages.push_back({out->rows.size(), invalid_line, std::move(text)});
+		};
+
+	auto add_warnings = [&]()
+		{
+		if ( ! warnings )
+			return;
+
+		for ( auto& w : *warnings )
+			add_message(false, std::move(w));
 
-			for ( int i = 0; i < fpos; i++ )
-				delete fields[i];
+		warnings->clear();
+		};
 
-			delete [] fields;
+	// Split on the separator the way getline() on a stream does, which
+	// doesn't yield an empty last field.
+	vector<string> fields;
+
+	for ( size_t start = 0; start < len; )
+		{
+		auto sep = static_cast<const char*>(memchr(line + start, separator[0], len - start));
+		size_t end = sep ? sep - line : len;
+		fields.emplace_back(line + start, end - start);
+		start = end + 1;
+		}
+
+	int pos = fields.size() - 1; // for easy comparisons of max element.
+
+	Value** vals = new Value*[NumFields()];
+	int fpos = 0;
+
+	for ( const auto& fit : columns )
+		{
+		if ( ! fit.present )
+			{
+			// add non-present field
+			vals[fpos++] = new Value(fit.type, false);
 			continue;
 			}
 
-		//printf("fpos: %d, second.num_fields: %d\n", fpos, (*it).second.num_fields);
-		assert ( fpos == NumFields() );
+		assert(fit.position >= 0 );
 
-		if ( Info().mode == MODE_STREAM )
-			Put(fields);
-		else
-			SendEntry(fields);
+		if ( fit.position > pos || fit.secondary_position > pos )
+			{
+			add_message(true, safe_fmt("Not enough fields in line '%s' of %s. Found %d fields, want positions %d and %d",
+			                         string(line, len).c_str(), fname.c_str(), pos, fit.position, fit.secondary_position));
+
+			out->failed = fail_on_invalid_lines;
+			break;
+			}
+
+		Value* val = f->ParseValue(fields[fit.position], fit.name, fit.type, fit.subtype);
+		add_warnings();
+
+		if ( ! val )
+			{
+			add_message(false, safe_fmt("Could not convert line '%s' of %s to Val. Ignoring line.",
+			                          string(line, len).c_str(), fname.c_str()));
+			break;
+			}
+
+		if ( fit.secondary_position != -1 )
+			{
+			// we have a port definition :)
+			assert(val->type == TYPE_PORT );
+			val->val.port_val.proto = f->ParseProto(fields[fit.secondary_position]);
+			add_warnings();
+			}
+
+		vals[fpos++] = val;
 		}
 
-	if ( Info().mode != MODE_STREAM )
-		EndCurrentSend();
+	if ( fpos != NumFields() )
+		{
+		// Encountered an error, ignoring line. But first, delete all
+		// successfully read fields and the array structure.
+		for ( int i = 0; i < fpos; i++ )
+			delete vals[i];
+
+		delete [] vals;
+		return;
+		}
+
+	out->rows.push_back(vals);
+	}
+
+bool Ascii::Send(Parsed* parsed, SendMode mode, vector<Value**>* batch)
+	{
+	auto flush = [this, batch]()
+		{
+		if ( batch && ! batch->empty() )
+			{
+			SendEntries(std::move(*batch));
+			batch->clear();
+			}
+		};
+
+	size_t next_message = 0;
+
+	for ( size_t i = 0; i <= parsed->rows.size(); i++ )
+		{
+		// Report messages in order with the rows.
+		for ( ; next_message < parsed->messages.size() &&
+		        parsed->messages[next_message].row == i; ++next_message )
+			{
+			const auto& m = parsed->messages[next_message];
+			flush();
+
+			if ( m.invalid_line )
+				FailWarn(fail_on_invalid_lines, m.text.c_str());
+			else
+				Warning(m.text.c_str());
+			}
+
+		if ( i == parsed->rows.size() )
+			break;
+
+		Value** vals = parsed->rows[i];
+		parsed->rows[i] = nullptr;
+
+		switch ( mode ) {
+		case SEND_ENTRY:
+			if ( ! batch )
+				{
+				SendEntry(vals);
+				break;
+				}
+
+			batch->push_back(vals);
+
+			if ( batch->size() >= SEND_BATCH_SIZE )
+				flush();
+
+			break;
+
+		case SEND_PUT:
+			Put(vals);
+			break;
+
+		case SEND_DELETE:
+			Delete(vals);
+			break;
+		}
+		}
+
+	if ( parsed->failed )
+		{
+		flush();
+		return false;
+		}
 
 	return true;
 	}
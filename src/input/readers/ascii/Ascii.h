@@ -2,10 +2,13 @@
 
 #pragma once
 
+#include <functional>
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <memory>
+#include <string_view>
+#include <unordered_map>
 #include <sys/types.h>
 
 #include "input/ReaderBackend.h"
@@ -54,10 +57,57 @@ protected:
 	bool DoHeartbeat(double network_time, double current_time) override;
 
 private:
+	// The rows parsed from a range of lines, along with the messages to
+	// report for the lines that couldn't be parsed.
+	struct Parsed {
+		struct Message {
+			size_t row;	// The number of rows to report it after.
+			bool invalid_line;	// Whether to report it with FailWarn().
+			std::string text;
+		};
+
+		explicit Parsed(int num_fields) : num_fields(num_fields)	{ }
+		~Parsed();
+
+		int num_fields;
+		std::vector<threading::Value**> rows;
+		std::vector<Message> messages;
+		bool failed = false;	// Aborted with fail_on_invalid_lines set.
+	};
+
+	// The data lines of the last read of the file, for sending only
+	// what has changed since. Lines are keyed by the text of their
+	// index fields, and the last line with a key wins, as it would when
+	// sending the whole file.
+	struct LineSet {
+		std::string headerline;
+		std::vector<FieldMapping> columns;
+		std::string data;
+		std::vector<const std::string*> order;
+		std::unordered_map<std::string, std::string_view> lines;
+	};
+
+	enum SendMode { SEND_ENTRY, SEND_PUT, SEND_DELETE };
+
 	bool ReadHeader(bool useCached);
 	bool GetLine(std::string& str);
 	bool OpenFile();
 
+	bool ReadAll();
+	bool ReadChanges(int fd);
+	bool ParseAndSend(const std::function<bool (std::string*)>& next_chunk, bool filter,
+	                  const std::vector<FieldMapping>& columns, SendMode mode);
+	void ParseLines(const std::string& data, bool filter, const std::vector<FieldMapping>& columns,
+	                const threading::Formatter* f, std::vector<std::string>* warnings,
+	                Parsed* out) const;
+	void ParseLine(const char* line, size_t len, const std::vector<FieldMapping>& columns,
+	               const threading::Formatter* f, std::vector<std::string>* warnings,
+	               Parsed* out) const;
+	bool NextLine(const char** p, const char* end, bool filter,
+	              const char** line, size_t* len) const;
+	std::string LineKey(const char* line, size_t len, const std::vector<FieldMapping>& columns) const;
+	bool Send(Parsed* parsed, SendMode mode, std::vector<threading::Value**>* batch);
+
 	std::ifstream file;
 	time_t mtime;
 	ino_t ino;
@@ -81,8 +131,12 @@ private:
 	bool fail_on_invalid_lines;
 	bool fail_on_file_problem;
 	std::string path_prefix;
+	size_t parse_threads;
+	bool changes_only;
 
+	threading::formatter::Ascii::SeparatorInfo sep_info;
 	std::unique_ptr<threading::Formatter> formatter;
+	std::unique_ptr<LineSet> last_lines;
 };
 
 } // namespace zeek::input::reader::detail
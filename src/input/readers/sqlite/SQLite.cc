@@ -2,6 +2,7 @@
 
 #include "zeek-config.h"
 
+#include <cctype>
 #include <fstream>
 #include <sstream>
 #include <sys/types.h>
@@ -22,7 +23,8 @@ namespace zeek::input::reader::detail {
 
 SQLite::SQLite(ReaderFrontend *frontend)
 	: ReaderBackend(frontend),
-	  fields(), num_fields(), mode(), started(), query(), db(), st()
+	  fields(), num_fields(), mode(), started(), query(), db(), st(),
+	  incremental_pos(-1), high_water()
 	{
 	set_separator.assign(
 			(const char*) BifConst::LogSQLite::set_separator->Bytes(),
@@ -54,6 +56,9 @@ void SQLite::DoClose()
 	sqlite3_finalize(st);
 	st = nullptr;
 
+	sqlite3_value_free(high_water);
+	high_water = nullptr;
+
 	if ( db != 0 )
 		{
 		sqlite3_close(db);
@@ -80,13 +85,13 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 		return false;
 		}
 
-	// Allow connections to same DB to use single data/schema cache. Also
-	// allows simultaneous writes to one file.
-	sqlite3_enable_shared_cache(1);
+	ReaderInfo::config_map::const_iterator it = info.config.find("incremental");
+	if ( it != info.config.end() )
+		incremental = it->second;
 
-	if ( Info().mode != MODE_MANUAL )
+	if ( Info().mode != MODE_MANUAL && (Info().mode != MODE_STREAM || incremental.empty()) )
 		{
-		Error("SQLite only supports manual reading mode.");
+		Error("SQLite only supports manual reading mode, and streaming mode for incremental queries.");
 		return false;
 		}
 
@@ -96,7 +101,7 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 	fullpath.append(".sqlite");
 
 	std::string query;
-	ReaderInfo::config_map::const_iterator it = info.config.find("query");
+	it = info.config.find("query");
 	if ( it == info.config.end() )
 		{
 		Error(Fmt("No query specified when setting up SQLite data source %s. Aborting.", info.source));
@@ -109,14 +114,40 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 					fullpath.c_str(),
 					&db,
 					SQLITE_OPEN_READWRITE |
-					SQLITE_OPEN_NOMUTEX
+					SQLITE_OPEN_NOMUTEX |
+					SQLITE_OPEN_PRIVATECACHE
 					,
 					NULL)) )
 		return false;
 
+	// A private cache lets us read while a writer in this process holds
+	// a transaction open; other processes' locks are waited for briefly.
+	if ( checkError(sqlite3_busy_timeout(db, BifConst::InputSQLite::busy_timeout * 1000)) )
+		return false;
+
 	num_fields = arg_num_fields;
 	fields = arg_fields;
 
+	if ( ! incremental.empty() )
+		{
+		// Only fetch the rows that the incremental column puts beyond
+		// the last ones we have seen. In SQLite, NULL is smaller than
+		// any other value, so that all rows qualify the first time.
+		while ( ! query.empty() && (query.back() == ';' || isspace(query.back())) )
+			query.pop_back();
+
+		char* q = sqlite3_mprintf("SELECT * FROM (%s) WHERE ?1 IS NULL OR \"%w\" > ?1 ORDER BY \"%w\";",
+		                          query.c_str(), incremental.c_str(), incremental.c_str());
+		if ( q == 0 )
+			{
+			InternalError("Could not malloc memory");
+			return false;
+			}
+
+		query = q;
+		sqlite3_free(q);
+		}
+
 	// create the prepared select statement that we will re-use forever...
 	if ( checkError(sqlite3_prepare_v2( db, query.c_str(), query.size()+1, &st, NULL )) )
 		{
@@ -265,6 +296,9 @@ bool SQLite::DoUpdate()
 		{
 		const char *name = sqlite3_column_name(st, i);
 
+		if ( ! incremental.empty() && incremental == name )
+			incremental_pos = i;
+
 		for ( unsigned j = 0; j < num_fields; j++ )
 			{
 			if ( strcmp(fields[j]->name, name) == 0 )
@@ -296,6 +330,22 @@ bool SQLite::DoUpdate()
 			}
 		}
 
+	if ( ! incremental.empty() && incremental_pos == -1 )
+		{
+		Error(Fmt("Incremental column %s not found after SQLite statement", incremental.c_str()));
+		delete [] mapping;
+		delete [] submapping;
+		return false;
+		}
+
+	if ( ! incremental.empty() &&
+	     checkError(high_water ? sqlite3_bind_value(st, 1, high_water) : sqlite3_bind_null(st, 1)) )
+		{
+		delete [] mapping;
+		delete [] submapping;
+		return false;
+		}
+
 	for ( unsigned int i = 0; i < num_fields; ++i )
 		{
 		if ( mapping[i] == -1 )
@@ -323,24 +373,65 @@ bool SQLite::DoUpdate()
 				delete [] ofields;
 				delete [] mapping;
 				delete [] submapping;
+				sqlite3_reset(st);
 				return false;
 				}
 			}
 
-		SendEntry(ofields);
+		if ( incremental.empty() )
+			{
+			SendEntry(ofields);
+			continue;
+			}
+
+		// Rows come ordered by the incremental column.
+		sqlite3_value_free(high_water);
+		high_water = sqlite3_value_dup(sqlite3_column_value(st, incremental_pos));
+		Put(ofields);
 		}
 
 	delete [] mapping;
 	delete [] submapping;
 
+	if ( errorcode == SQLITE_BUSY || errorcode == SQLITE_LOCKED )
+		{
+		// Another connection kept the database locked for longer than
+		// the busy timeout. That's not a reason to give up on the
+		// source: streams try again at the next heartbeat, and manual
+		// reads at the next Input::force_update(). Incremental rows
+		// passed on already won't be fetched again.
+		if ( Info().mode == MODE_MANUAL )
+			Warning(Fmt("database locked, skipping update: %s", sqlite3_errmsg(db)));
+
+		sqlite3_reset(st);
+		return true;
+		}
+
 	if ( checkError(errorcode) ) // check the last error code returned by sqlite
+		{
+		sqlite3_reset(st);
 		return false;
-
-	EndCurrentSend();
+		}
 
 	if ( checkError(sqlite3_reset(st)) )
 		return false;
 
+	if ( incremental.empty() )
+		EndCurrentSend();
+
+	else if ( Info().mode == MODE_MANUAL )
+		EndOfData();
+
+	return true;
+	}
+
+bool SQLite::DoHeartbeat(double network_time, double current_time)
+	{
+	if ( Info().mode == MODE_STREAM )
+		// Call Update, not DoUpdate, because Update checks the
+		// "disabled" flag.
+		Update();
+
 	return true;
 	}
 
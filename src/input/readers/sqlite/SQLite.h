@@ -24,7 +24,7 @@ protected:
 	bool DoInit(const ReaderInfo& info, int arg_num_fields, const threading::Field* const* arg_fields) override;
 	void DoClose() override;
 	bool DoUpdate() override;
-	bool DoHeartbeat(double network_time, double current_time) override { return true; }
+	bool DoHeartbeat(double network_time, double current_time) override;
 
 private:
 	bool checkError(int code);
@@ -38,6 +38,12 @@ private:
 	std::string query;
 	sqlite3 *db;
 	sqlite3_stmt *st;
+
+	// For incremental updates, the column that tells which rows are new,
+	// and the highest value it has had so far.
+	std::string incremental;
+	int incremental_pos;
+	sqlite3_value* high_water;
 	threading::formatter::Ascii* io;
 
 	std::string set_separator;
@@ -817,11 +817,17 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 		WriterBackend::WriterInfo* info = nullptr;
 		WriterFrontend* writer = nullptr;
 
+		// Writers created for remote logs may be shared by filters
+		// having only their fields' types in common, but not
+		// necessarily those of container elements.
+		bool same_schema = true;
+
 		if ( w != stream->writers.end() )
 			{
 			// We know this writer already.
 			writer = w->second->writer;
 			info = w->second->info;
+			same_schema = ! w->second->from_remote;
 
 			if ( ! w->second->hook_initialized )
 				{
@@ -890,6 +896,23 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 
 		// Alright, can do the write now.
 
+		// Unless plugins want to see the values, encode the record
+		// straight into the writer's row buffer if it can take it.
+		if ( same_schema && ! plugin_mgr->HavePluginForHook(plugin::HOOK_LOG_WRITE) )
+			{
+			if ( auto rows = writer->BeginRow(filter->num_fields) )
+				{
+				RecordToFilterRow(filter, columns.get(), rows);
+				writer->EndRow();
+
+#ifdef DEBUG
+				DBG_LOG(DBG_LOGGING, "Wrote record to filter '%s' on stream '%s'",
+					filter->name.c_str(), stream->name.c_str());
+#endif
+				continue;
+				}
+			}
+
 		threading::Value** vals = RecordToFilterVals(stream, filter, columns.get());
 
 		if ( ! PLUGIN_HOOK_WITH_RESULT(HOOK_LOG_WRITE,
@@ -1107,6 +1130,45 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 	return vals;
 	}
 
+void Manager::RecordToFilterRow(Filter* filter, RecordVal* columns,
+                                RowBuffer* rows)
+	{
+	RecordValPtr ext_rec;
+
+	if ( filter->num_ext_fields > 0 )
+		{
+		auto res = filter->ext_func->Invoke(IntrusivePtr{NewRef{}, filter->path_val});
+
+		if ( res )
+			ext_rec = {AdoptRef{}, res.release()->AsRecordVal()};
+		}
+
+	for ( int i = 0; i < filter->num_fields; ++i )
+		{
+		Val* val;
+
+		if ( i < filter->num_ext_fields )
+			// If the executing function did not return a record,
+			// all of its fields are unset.
+			val = ext_rec.get();
+		else
+			val = columns;
+
+		// For each field, first find the right value, which can
+		// potentially be nested inside other records.
+		for ( auto j : filter->indices[i] )
+			{
+			if ( ! val )
+				// Value, or any of its parents, is not set.
+				break;
+
+			val = val->AsRecordVal()->GetField(j).get();
+			}
+
+		rows->Add(val, filter->fields[i]->type, filter->fields[i]->subtype);
+		}
+	}
+
 bool Manager::CreateWriterForRemoteLog(EnumVal* id, EnumVal* writer, WriterBackend::WriterInfo* info,
                                        int num_fields, const threading::Field* const* fields)
 	{
@@ -1352,6 +1414,35 @@ bool Manager::Flush(EnumVal* id)
 	return true;
 	}
 
+VectorValPtr Manager::GetWriterStats()
+	{
+	auto rval = make_intrusive<VectorVal>(BifType::Vector::Log::WriterStatsVec);
+
+	for ( const auto& stream : streams )
+		{
+		if ( ! stream || ! stream->enabled )
+			continue;
+
+		for ( const auto& w : stream->writers )
+			{
+			WriterInfo* winfo = w.second;
+			auto s = winfo->writer->GetBatchStats();
+			auto r = make_intrusive<RecordVal>(BifType::Record::Log::WriterStats);
+			r->Assign(0, IntrusivePtr{NewRef{}, stream->id});
+			r->Assign<StringVal>(1, winfo->writer->Info().path);
+			r->Assign(2, IntrusivePtr{NewRef{}, winfo->type});
+			r->Assign(3, val_mgr->Count(s.writes));
+			r->Assign(4, val_mgr->Count(s.batches));
+			r->Assign(5, val_mgr->Count(s.batch_size));
+			r->Assign<IntervalVal>(6, s.avg_queue_delay);
+			r->Assign<IntervalVal>(7, s.max_queue_delay);
+			rval->Assign(rval->Size(), std::move(r));
+			}
+		}
+
+	return rval;
+	}
+
 void Manager::Terminate()
 	{
 	for ( vector<Stream *>::iterator s = streams.begin(); s != streams.end(); ++s )
@@ -219,6 +219,15 @@ public:
 	 */
 	bool Flush(EnumVal* id);
 
+	/**
+	 * Returns statistics about the batching of writes for all writers of
+	 * the enabled streams.
+	 *
+	 * This methods corresponds directly to the internal BiF defined in
+	 * logging.bif, which just forwards here.
+	 */
+	VectorValPtr GetWriterStats();
+
 	/**
 	 * Signals the manager to shutdown at Bro's termination.
 	 */
@@ -287,6 +296,12 @@ private:
 	                                      RecordVal* columns);
 
 	threading::Value* ValToLogVal(Val* val, Type* ty = nullptr);
+
+	// Encodes a record into a writer's row buffer, the equivalent of
+	// RecordToFilterVals() for writing through WriterFrontend::BeginRow().
+	void RecordToFilterRow(Filter* filter, RecordVal* columns,
+	                       RowBuffer* rows);
+
 	Stream* FindStream(EnumVal* id);
 	void RemoveDisabledWriters(Stream* stream);
 	void InstallRotationTimer(WriterInfo* winfo);
@@ -0,0 +1,272 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "RowBuffer.h"
+
+#include <cassert>
+
+#include "Val.h"
+#include "File.h"
+#include "Func.h"
+#include "Desc.h"
+#include "IPAddr.h"
+#include "ZeekString.h"
+#include "Reporter.h"
+
+using zeek::threading::Value;
+using zeek::threading::Field;
+
+namespace zeek::logging {
+
+// The encoding of a value is a byte indicating whether it's present,
+// followed by its data if so. The layout of the data mirrors the union
+// in threading::Value, except for strings (length followed by the bytes)
+// and containers (number of elements followed by the elements). See
+// RowBuffer::PutBytes() for the former.
+
+void RowBuffer::Add(Val* val, TypeTag type, TypeTag subtype)
+	{
+	if ( ! val )
+		{
+		Put<uint8_t>(0);
+		return;
+		}
+
+	Put<uint8_t>(1);
+
+	switch ( type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		Put<bro_int_t>(val->InternalInt());
+		break;
+
+	case TYPE_ENUM:
+		{
+		const char* s =
+			val->GetType()->AsEnumType()->Lookup(val->InternalInt());
+
+		if ( ! s )
+			{
+			val->GetType()->Error("enum type does not contain value", val);
+			s = "";
+			}
+
+		PutBytes(s, strlen(s));
+		break;
+		}
+
+	case TYPE_COUNT:
+		Put<bro_uint_t>(val->InternalUnsigned());
+		break;
+
+	case TYPE_PORT:
+		{
+		Value::port_t p;
+		p.port = val->AsPortVal()->Port();
+		p.proto = val->AsPortVal()->PortType();
+		Put(p);
+		break;
+		}
+
+	case TYPE_SUBNET:
+		{
+		Value::subnet_t s;
+		val->AsSubNet().ConvertToThreadingValue(&s);
+		Put(s);
+		break;
+		}
+
+	case TYPE_ADDR:
+		{
+		Value::addr_t a;
+		val->AsAddr().ConvertToThreadingValue(&a);
+		Put(a);
+		break;
+		}
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		Put<double>(val->InternalDouble());
+		break;
+
+	case TYPE_STRING:
+		{
+		const String* s = val->AsString();
+		PutBytes(reinterpret_cast<const char*>(s->Bytes()), s->Len());
+		break;
+		}
+
+	case TYPE_FILE:
+		{
+		std::string s = val->AsFile()->Name();
+		PutBytes(s.data(), s.size());
+		break;
+		}
+
+	case TYPE_FUNC:
+		{
+		ODesc d;
+		val->AsFunc()->Describe(&d);
+		const char* s = d.Description();
+		PutBytes(s, strlen(s));
+		break;
+		}
+
+	case TYPE_TABLE:
+		{
+		auto set = val->AsTableVal()->ToPureListVal();
+
+		if ( ! set )
+			{
+			// ToPureListVal has reported an internal warning
+			// already. Just keep going by making something up.
+			Put<int>(0);
+			break;
+			}
+
+		Put<int>(set->Length());
+
+		for ( int i = 0; i < set->Length(); i++ )
+			Add(set->Idx(i).get(), subtype);
+
+		break;
+		}
+
+	case TYPE_VECTOR:
+		{
+		VectorVal* vec = val->AsVectorVal();
+		Put<int>(vec->Size());
+
+		for ( unsigned int i = 0; i < vec->Size(); i++ )
+			Add(vec->At(i).get(), subtype);
+
+		break;
+		}
+
+	default:
+		reporter->InternalError("unsupported type %s for log_write", type_name(type));
+	}
+	}
+
+RowDecoder::RowDecoder(int arg_num_fields, const Field* const* arg_fields)
+	: num_fields(arg_num_fields), fields(arg_fields), containers(arg_num_fields)
+	{
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		values.emplace_back(new Value(fields[i]->type, fields[i]->subtype));
+		ptrs.push_back(values.back().get());
+		}
+	}
+
+RowDecoder::~RowDecoder()
+	{
+	// None of the values own the memory they point to, so keep their
+	// destructors from releasing it.
+	for ( auto& v : values )
+		v->present = false;
+
+	for ( auto& c : containers )
+		for ( auto& v : c.values )
+			v->present = false;
+	}
+
+Value** RowDecoder::Next()
+	{
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		Value* v = ptrs[i];
+
+		if ( v->type == TYPE_TABLE || v->type == TYPE_VECTOR )
+			{
+			v->present = Get<uint8_t>();
+
+			if ( v->present )
+				DecodeContainer(v, &containers[i]);
+			}
+		else
+			Decode(v);
+		}
+
+	return ptrs.data();
+	}
+
+void RowDecoder::DecodeContainer(Value* v, Container* c)
+	{
+	int n = Get<int>();
+
+	while ( c->values.size() < static_cast<size_t>(n) )
+		{
+		c->values.emplace_back(new Value(v->subtype));
+		c->ptrs.push_back(c->values.back().get());
+		}
+
+	for ( int i = 0; i < n; i++ )
+		Decode(c->ptrs[i]);
+
+	// Both unions have the same layout, but let's be explicit.
+	if ( v->type == TYPE_TABLE )
+		{
+		v->val.set_val.size = n;
+		v->val.set_val.vals = c->ptrs.data();
+		}
+	else
+		{
+		v->val.vector_val.size = n;
+		v->val.vector_val.vals = c->ptrs.data();
+		}
+	}
+
+void RowDecoder::Decode(Value* v)
+	{
+	v->present = Get<uint8_t>();
+
+	if ( ! v->present )
+		return;
+
+	switch ( v->type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		v->val.int_val = Get<bro_int_t>();
+		break;
+
+	case TYPE_COUNT:
+		v->val.uint_val = Get<bro_uint_t>();
+		break;
+
+	case TYPE_PORT:
+		v->val.port_val = Get<Value::port_t>();
+		break;
+
+	case TYPE_SUBNET:
+		v->val.subnet_val = Get<Value::subnet_t>();
+		break;
+
+	case TYPE_ADDR:
+		v->val.addr_val = Get<Value::addr_t>();
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		v->val.double_val = Get<double>();
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		{
+		int len = Get<int>();
+		v->val.string_val.data = const_cast<char*>(data + pos);
+		v->val.string_val.length = len;
+		pos += len + 1;
+		break;
+		}
+
+	default:
+		// Can't happen for the types the encoder accepts.
+		assert(false);
+	}
+	}
+
+} // namespace zeek::logging
@@ -0,0 +1,158 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Compact binary encoding of log records for passing them from the main
+// thread to writer threads.
+
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "threading/SerialTypes.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(Val, zeek);
+
+namespace zeek::logging {
+
+/**
+ * A batch of log records, encoded into a single contiguous buffer.
+ *
+ * The encoding carries no type information: the types of the fields are
+ * given by the writer's schema, i.e., the threading::Field instances passed
+ * to its initialization. This makes encoding a record on the main thread
+ * a matter of appending its values to the buffer, without the many small
+ * heap allocations that building threading::Value instances takes. The
+ * writer thread then uses a RowDecoder to get at the values.
+ *
+ * Buffers are meant to be reused: Clear() keeps the allocated memory.
+ */
+class RowBuffer {
+public:
+	/**
+	 * Removes all records, retaining the memory allocated for them.
+	 */
+	void Clear()	{ data.clear(); num_rows = 0; }
+
+	/**
+	 * Returns the number of complete records in the buffer.
+	 */
+	int NumRows() const	{ return num_rows; }
+
+	/**
+	 * Returns the number of bytes the encoded records take up.
+	 */
+	size_t Size() const	{ return data.size(); }
+
+	/**
+	 * Appends the value of the current record's next field.
+	 *
+	 * Must only be called from the main thread.
+	 *
+	 * @param val The value, or null if the field is not set.
+	 *
+	 * @param type The type of the field.
+	 *
+	 * @param subtype The type of the field's elements for sets and
+	 * vectors.
+	 */
+	void Add(Val* val, TypeTag type, TypeTag subtype = TYPE_VOID);
+
+	/**
+	 * Marks the current record as complete. It must have had a value
+	 * added for every field of the schema.
+	 */
+	void EndRow()	{ ++num_rows; }
+
+private:
+	friend class RowDecoder;
+
+	template<typename T>
+	void Put(const T& v)
+		{
+		auto n = data.size();
+		data.resize(n + sizeof(T));
+		memcpy(data.data() + n, &v, sizeof(T));
+		}
+
+	// Adds a terminating null byte, which isn't included in the
+	// length, for writers treating enums and such as C strings.
+	void PutBytes(const char* bytes, int len)
+		{
+		Put(len);
+		data.insert(data.end(), bytes, bytes + len);
+		data.push_back('\0');
+		}
+
+	std::vector<char> data;
+	int num_rows = 0;
+};
+
+/**
+ * Decodes the records of a RowBuffer into threading::Value instances for
+ * passing them on to a writer.
+ *
+ * The instances are owned by the decoder and reused for every record,
+ * with the data of strings pointing directly into the buffer. They remain
+ * valid only until the next call to Next() or Reset(), and as long as the
+ * buffer is.
+ */
+class RowDecoder {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param num_fields The number of fields in the schema.
+	 *
+	 * @param fields The fields of the schema. The decoder keeps a
+	 * reference to them.
+	 */
+	RowDecoder(int num_fields, const threading::Field* const* fields);
+
+	~RowDecoder();
+
+	RowDecoder(const RowDecoder&) = delete;
+	RowDecoder& operator=(const RowDecoder&) = delete;
+
+	/**
+	 * Starts decoding a new buffer, positioned at its first record.
+	 */
+	void Reset(const RowBuffer* rows)	{ data = rows->data.data(); pos = 0; }
+
+	/**
+	 * Decodes the next record of the buffer, which must exist.
+	 *
+	 * @return An array of values for all fields of the record.
+	 */
+	threading::Value** Next();
+
+private:
+	// Storage for the elements of a set or vector field.
+	struct Container {
+		std::vector<std::unique_ptr<threading::Value>> values;
+		std::vector<threading::Value*> ptrs;
+	};
+
+	template<typename T>
+	T Get()
+		{
+		T v;
+		memcpy(&v, data + pos, sizeof(T));
+		pos += sizeof(T);
+		return v;
+		}
+
+	void Decode(threading::Value* v);
+	void DecodeContainer(threading::Value* v, Container* c);
+
+	int num_fields;
+	const threading::Field* const* fields;
+	std::vector<std::unique_ptr<threading::Value>> values;
+	std::vector<threading::Value*> ptrs;
+	std::vector<Container> containers;	// Indexed by field.
+
+	const char* data = nullptr;
+	size_t pos = 0;
+};
+
+} // namespace zeek::logging
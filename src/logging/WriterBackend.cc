@@ -1,9 +1,13 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include <algorithm>
+
 #include <broker/data.hh>
 
 #include "util.h"
+#include "NetVar.h"
 #include "threading/SerialTypes.h"
+#include "SerializationFormat.h"
 
 #include "Manager.h"
 #include "WriterBackend.h"
@@ -118,6 +122,52 @@ bool WriterBackend::WriterInfo::FromBroker(broker::data d)
 	return true;
 	}
 
+bool WriterBackend::WriterInfo::Read(zeek::detail::SerializationFormat* fmt)
+	{
+	std::string spath, sppf;
+	uint32_t num_config;
+
+	if ( ! (fmt->Read(&spath, "path") &&
+	        fmt->Read(&sppf, "post_proc_func") &&
+	        fmt->Read(&rotation_base, "rotation_base") &&
+	        fmt->Read(&rotation_interval, "rotation_interval") &&
+	        fmt->Read(&network_time, "network_time") &&
+	        fmt->Read(&num_config, "num_config")) )
+		return false;
+
+	path = util::copy_string(spath.c_str());
+	post_proc_func = util::copy_string(sppf.c_str());
+
+	for ( uint32_t i = 0; i < num_config; ++i )
+		{
+		std::string k, v;
+
+		if ( ! (fmt->Read(&k, "config-key") && fmt->Read(&v, "config-value")) )
+			return false;
+
+		config.insert(std::make_pair(util::copy_string(k.c_str()), util::copy_string(v.c_str())));
+		}
+
+	return true;
+	}
+
+bool WriterBackend::WriterInfo::Write(zeek::detail::SerializationFormat* fmt) const
+	{
+	if ( ! (fmt->Write(path, "path") &&
+	        fmt->Write(post_proc_func ? post_proc_func : "", "post_proc_func") &&
+	        fmt->Write(rotation_base, "rotation_base") &&
+	        fmt->Write(rotation_interval, "rotation_interval") &&
+	        fmt->Write(network_time, "network_time") &&
+	        fmt->Write(static_cast<uint32_t>(config.size()), "num_config")) )
+		return false;
+
+	for ( const auto& i : config )
+		if ( ! (fmt->Write(i.first, "config-key") && fmt->Write(i.second, "config-value")) )
+			return false;
+
+	return true;
+	}
+
 WriterBackend::WriterBackend(WriterFrontend* arg_frontend) : MsgThread()
 	{
 	num_fields = 0;
@@ -126,12 +176,21 @@ WriterBackend::WriterBackend(WriterFrontend* arg_frontend) : MsgThread()
 	frontend = arg_frontend;
 	info = new WriterInfo(frontend->Info());
 	rotation_counter = 0;
+	spare_rows = nullptr;
+	spare_writes = nullptr;
+	num_delays = 0;
+	delay_sum = 0;
+	delay_max = 0;
 
 	SetName(frontend->Name());
 	}
 
 WriterBackend::~WriterBackend()
 	{
+	row_decoder.reset();
+	delete spare_rows.load();
+	delete [] spare_writes.load();
+
 	if ( fields )
 		{
 		for(int i = 0; i < num_fields; ++i)
@@ -154,7 +213,8 @@ void WriterBackend::DeleteVals(int num_writes, Value*** vals)
 		delete [] vals[j];
 		}
 
-	delete [] vals;
+	// Hand the array back to the main thread for reuse.
+	delete [] spare_writes.exchange(vals);
 	}
 
 bool WriterBackend::FinishedRotation(const char* new_name, const char* old_name,
@@ -243,6 +303,8 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 			if ( ! success )
 				break;
 			}
+
+		success = DoEndBatch() && success;
 		}
 
 	DeleteVals(num_writes, vals);
@@ -253,6 +315,74 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	return success;
 	}
 
+bool WriterBackend::WriteRows(RowBuffer* rows)
+	{
+	bool success = true;
+
+	if ( ! Failed() )
+		{
+		if ( ! row_decoder )
+			row_decoder = std::make_unique<RowDecoder>(num_fields, fields);
+
+		row_decoder->Reset(rows);
+
+		for ( int j = 0; j < rows->NumRows(); j++ )
+			{
+			success = DoWrite(num_fields, fields, row_decoder->Next());
+
+			if ( ! success )
+				break;
+			}
+
+		success = DoEndBatch() && success;
+		}
+
+	// Hand the buffer back to the main thread for reuse.
+	rows->Clear();
+	delete spare_rows.exchange(rows);
+
+	if ( ! success )
+		DisableFrontend();
+
+	return success;
+	}
+
+RowBuffer* WriterBackend::TakeRowBuffer()
+	{
+	if ( auto rows = spare_rows.exchange(nullptr) )
+		return rows;
+
+	return new RowBuffer();
+	}
+
+Value*** WriterBackend::TakeWriteBuffer()
+	{
+	if ( auto vals = spare_writes.exchange(nullptr) )
+		return vals;
+
+	return new Value**[std::max(BifConst::Log::write_batch_max, static_cast<bro_uint_t>(1))];
+	}
+
+void WriterBackend::BatchDequeued(double queued)
+	{
+	double delay = std::max(util::current_time(true) - queued, 0.0);
+
+	// This thread is the only writer, so there's no need for atomic
+	// read-modify-write operations.
+	delay_sum.store(delay_sum.load() + delay);
+	num_delays.store(num_delays.load() + 1);
+
+	if ( delay > delay_max.load() )
+		delay_max.store(delay);
+	}
+
+void WriterBackend::QueueDelays(double* avg, double* max) const
+	{
+	auto n = num_delays.load();
+	*avg = n ? delay_sum.load() / n : 0.0;
+	*max = delay_max.load();
+	}
+
 bool WriterBackend::SetBuf(bool enabled)
 	{
 	if ( enabled == buffering )
@@ -4,12 +4,17 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "threading/MsgThread.h"
 
 #include "Component.h"
+#include "RowBuffer.h"
 
 namespace broker { class data; }
 
+ZEEK_FORWARD_DECLARE_NAMESPACED(SerializationFormat, zeek::detail);
+
 ZEEK_FORWARD_DECLARE_NAMESPACED(WriterFrontend, zeek, logging);
 
 namespace zeek::logging {
@@ -126,6 +131,10 @@ public:
 		broker::data ToBroker() const;
 		bool FromBroker(broker::data d);
 
+		// The same, for transports that don't go through Broker.
+		bool Read(zeek::detail::SerializationFormat* fmt);
+		bool Write(zeek::detail::SerializationFormat* fmt) const;
+
 		private:
 		const WriterInfo& operator=(const WriterInfo& other); // Disable.
 		};
@@ -161,6 +170,56 @@ public:
 	 */
 	bool Write(int num_fields, int num_writes, threading::Value*** vals);
 
+	/**
+	 * Writes a batch of log records encoded by the main thread. This
+	 * is the equivalent of Write() for records that the logging manager
+	 * encoded directly into a row buffer; the records are passed on to
+	 * the writer's DoWrite() one by one.
+	 *
+	 * @param rows The records. Their encoding must follow the fields
+	 * passed to Init(). The method takes ownership of the buffer.
+	 *
+	 * @return False if an error occured.
+	 */
+	bool WriteRows(RowBuffer* rows);
+
+	/**
+	 * Returns an empty row buffer for encoding records to be passed to
+	 * WriteRows(), reusing one that an earlier WriteRows() has finished
+	 * with if possible. Ownership passes to the caller.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	RowBuffer* TakeRowBuffer();
+
+	/**
+	 * Returns an array for passing up to \c Log::write_batch_max records
+	 * to Write(), reusing one that an earlier Write() has finished with
+	 * if possible. Ownership passes to the caller.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	threading::Value*** TakeWriteBuffer();
+
+	/**
+	 * Records the queueing delay of a batch of records about to be
+	 * passed to Write() or WriteRows(), i.e., the time the batch's first
+	 * record has spent buffered in the frontend and queued for this
+	 * thread.
+	 *
+	 * @param queued The time, as returned by util::current_time(true),
+	 * at which the batch's first record was buffered.
+	 */
+	void BatchDequeued(double queued);
+
+	/**
+	 * Returns the average and the maximum of the queueing delays
+	 * recorded with BatchDequeued().
+	 *
+	 * This method is safe to call from any thread.
+	 */
+	void QueueDelays(double* avg, double* max) const;
+
 	/**
 	 * Sets the buffering status for the writer, assuming the writer
 	 * supports that. (If not, it will be ignored).
@@ -292,6 +351,23 @@ protected:
 	virtual bool DoWrite(int num_fields, const threading::Field* const*  fields,
 			     threading::Value** vals) = 0;
 
+	/**
+	 * Writer-specific method called after a batch of records has been
+	 * passed to DoWrite(), for writers that can store a batch more
+	 * efficiently as a whole than each record on its own (e.g., in a
+	 * single database transaction). Batches don't span messages from
+	 * the main thread, and thus end at the latest before any of the
+	 * other Do*() methods gets called.
+	 *
+	 * The default implementation does nothing. If the method returns
+	 * false, it will be assumed that a fatal error has occured that
+	 * prevents the writer from further operation; it will then be
+	 * disabled and eventually deleted. When returning false, an
+	 * implementation should also call Error() to indicate what
+	 * happened.
+	 */
+	virtual bool DoEndBatch()	{ return true; }
+
 	/**
 	 * Writer-specific method implementing a change of fthe buffering
 	 * state.  If buffering is disabled, the writer should attempt to
@@ -397,6 +473,15 @@ private:
 	bool buffering;	// True if buffering is enabled.
 
 	int rotation_counter; // Tracks FinishedRotation() calls.
+
+	std::unique_ptr<RowDecoder> row_decoder;	// Created with the first WriteRows().
+	std::atomic<RowBuffer*> spare_rows;	// Buffer for TakeRowBuffer() to hand out again.
+	std::atomic<threading::Value***> spare_writes;	// Array for TakeWriteBuffer() to hand out again.
+
+	// Queueing delays, written only by BatchDequeued().
+	std::atomic<uint64_t> num_delays;
+	std::atomic<double> delay_sum;
+	std::atomic<double> delay_max;
 };
 
 } // namespace zeek::logging
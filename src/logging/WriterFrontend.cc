@@ -1,5 +1,9 @@
 
+#include <algorithm>
+
+#include "NetVar.h"
 #include "RunState.h"
+#include "threading/Manager.h"
 #include "threading/SerialTypes.h"
 #include "broker/Manager.h"
 
@@ -12,6 +16,10 @@ using zeek::threading::Field;
 
 namespace zeek::logging  {
 
+// The size of the first batch, before the write rate is known. This used to
+// be the fixed size of all batches.
+static const int INITIAL_BATCH_SIZE = 1000;
+
 // Messages sent from frontend to backend (i.e., "InputMessages").
 
 class InitMessage final : public threading::InputMessage<WriterBackend>
@@ -54,16 +62,40 @@ private:
 class WriteMessage final : public threading::InputMessage<WriterBackend>
 {
 public:
-	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals)
+	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals,
+	             double queued)
 		: threading::InputMessage<WriterBackend>("Write", backend),
-		num_fields(num_fields), num_writes(num_writes), vals(vals)	{}
+		num_fields(num_fields), num_writes(num_writes), vals(vals), queued(queued)	{}
 
-	bool Process() override { return Object()->Write(num_fields, num_writes, vals); }
+	bool Process() override
+		{
+		Object()->BatchDequeued(queued);
+		return Object()->Write(num_fields, num_writes, vals);
+		}
 
 private:
 	int num_fields;
 	int num_writes;
 	Value ***vals;
+	double queued;
+};
+
+class WriteRowsMessage final : public threading::InputMessage<WriterBackend>
+{
+public:
+	WriteRowsMessage(WriterBackend* backend, RowBuffer* rows, double queued)
+		: threading::InputMessage<WriterBackend>("WriteRows", backend),
+		rows(rows), queued(queued)	{}
+
+	bool Process() override
+		{
+		Object()->BatchDequeued(queued);
+		return Object()->WriteRows(rows);
+		}
+
+private:
+	RowBuffer* rows;
+	double queued;
 };
 
 class SetBufMessage final : public threading::InputMessage<WriterBackend>
@@ -107,6 +139,12 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 	remote = arg_remote;
 	write_buffer = nullptr;
 	write_buffer_pos = 0;
+	row_buffer = nullptr;
+	batch_size = std::clamp(BifConst::Log::write_batch_max, static_cast<bro_uint_t>(1),
+	                        static_cast<bro_uint_t>(INITIAL_BATCH_SIZE));
+	batch_start = last_batch = 0;
+	write_rate = 0;
+	num_writes = num_batches = 0;
 	info = new WriterBackend::WriterInfo(arg_info);
 
 	num_fields = 0;
@@ -120,7 +158,12 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 		backend = log_mgr->CreateBackend(this, writer);
 
 		if ( backend )
+			{
+			if ( auto pool = thread_mgr->WriterPool() )
+				backend->UsePool(pool);
+
 			backend->Start();
+			}
 		}
 
 	else
@@ -133,6 +176,8 @@ WriterFrontend::~WriterFrontend()
 		delete fields[i];
 
 	delete [] fields;
+	delete row_buffer;
+	delete [] write_buffer;
 
 	Unref(stream);
 	Unref(writer);
@@ -217,29 +262,79 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals)
 		return;
 		}
 
+	if ( row_buffer && row_buffer->NumRows() )
+		// Keep the order with records written through BeginRow().
+		FlushWriteBuffer();
+
 	if ( ! write_buffer )
-		{
 		// Need new buffer.
-		write_buffer = new Value**[WRITER_BUFFER_SIZE];
-		write_buffer_pos = 0;
-		}
+		write_buffer = backend->TakeWriteBuffer();
+
+	if ( ! write_buffer_pos )
+		batch_start = util::current_time(true);
 
 	write_buffer[write_buffer_pos++] = vals;
 
-	if ( write_buffer_pos >= WRITER_BUFFER_SIZE || ! buf || run_state::terminating )
+	if ( BatchFull(write_buffer_pos) )
 		// Buffer full (or no bufferin desired or termiating).
 		FlushWriteBuffer();
 
 	}
 
+RowBuffer* WriterFrontend::BeginRow(int arg_num_fields)
+	{
+	// Records for remote peers need to be serialized from values.
+	if ( disabled || remote || ! backend || arg_num_fields != num_fields )
+		return nullptr;
+
+	if ( write_buffer_pos )
+		// Keep the order with records written through Write().
+		FlushWriteBuffer();
+
+	if ( ! row_buffer )
+		row_buffer = backend->TakeRowBuffer();
+
+	return row_buffer;
+	}
+
+void WriterFrontend::EndRow()
+	{
+	row_buffer->EndRow();
+
+	if ( row_buffer->NumRows() == 1 )
+		batch_start = util::current_time(true);
+
+	if ( BatchFull(row_buffer->NumRows()) )
+		// Buffer full (or no bufferin desired or termiating).
+		FlushWriteBuffer();
+	}
+
 void WriterFrontend::FlushWriteBuffer()
 	{
+	if ( row_buffer && row_buffer->NumRows() )
+		{
+		if ( backend )
+			{
+			AdaptBatchSize(row_buffer->NumRows());
+
+			// Ownership passes to the child thread.
+			backend->SendIn(new WriteRowsMessage(backend, row_buffer, batch_start));
+			row_buffer = nullptr;
+			}
+		else
+			row_buffer->Clear();
+		}
+
 	if ( ! write_buffer_pos )
 		// Nothing to do.
 		return;
 
 	if ( backend )
-		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos, write_buffer));
+		{
+		AdaptBatchSize(write_buffer_pos);
+		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos,
+		                                 write_buffer, batch_start));
+		}
 
 	// Clear buffer (no delete, we pass ownership to child thread.)
 	write_buffer = nullptr;
@@ -286,6 +381,47 @@ void WriterFrontend::Rotate(const char* rotated_path, double open, double close,
 		log_mgr->FinishedRotation(this, nullptr, nullptr, 0, 0, false, terminating);
 	}
 
+bool WriterFrontend::BatchFull(int n) const
+	{
+	return n >= batch_size || ! buf || run_state::terminating;
+	}
+
+void WriterFrontend::AdaptBatchSize(int n)
+	{
+	num_writes += n;
+	++num_batches;
+
+	double now = util::current_time(true);
+
+	if ( last_batch > 0 )
+		{
+		// Estimate the rate from the writes since the last batch,
+		// smoothing it across batches so that a single burst or lull
+		// doesn't swing the batch size around too much.
+		double rate = n / std::max(now - last_batch, 1e-6);
+		write_rate = write_rate > 0 ? write_rate + 0.25 * (rate - write_rate) : rate;
+
+		// Buffer as many writes as we expect to arrive within the
+		// latency target. Slow streams thus send their records right
+		// away, while busy ones amortize each message over many.
+		double target = write_rate * BifConst::Log::write_batch_latency;
+		double max = std::max(BifConst::Log::write_batch_max, static_cast<bro_uint_t>(1));
+		batch_size = static_cast<int>(std::clamp(target, 1.0, max));
+		}
+
+	last_batch = now;
+	}
+
+WriterFrontend::BatchStats WriterFrontend::GetBatchStats() const
+	{
+	BatchStats stats{num_writes, num_batches, batch_size, 0, 0};
+
+	if ( backend )
+		backend->QueueDelays(&stats.avg_queue_delay, &stats.max_queue_delay);
+
+	return stats;
+	}
+
 void WriterFrontend::DeleteVals(int num_fields, Value** vals)
 	{
 	// Note this code is duplicated in Manager::DeleteVals().
@@ -80,10 +80,12 @@ public:
 	 *
 	 * As an optimization, if buffering is enabled (which is the default)
 	 * this method may buffer several writes and send them over to the
-	 * backend in bulk with a single message. An explicit bulk write of
-	 * all currently buffered data can be triggered with
-	 * FlushWriteBuffer(). The backend writer triggers this with a
-	 * message at every heartbeat.
+	 * backend in bulk with a single message. The number of writes per
+	 * message adapts to the rate at which records arrive, so that
+	 * buffering delays them by about \c Log::write_batch_latency. An
+	 * explicit bulk write of all currently buffered data can be
+	 * triggered with FlushWriteBuffer(). The backend writer triggers
+	 * this with a message at every heartbeat.
 	 *
 	 * See WriterBackend::Writer() for arguments (except that this method
 	 * takes only a single record, not an array). The method takes
@@ -93,6 +95,33 @@ public:
 	 */
 	void Write(int num_fields, threading::Value** vals);
 
+	/**
+	 * Starts writing a log record by encoding it directly into a row
+	 * buffer, an alternative to Write() that avoids building
+	 * threading::Value instances. The caller adds the record's values to
+	 * the returned buffer, following the fields passed to Init(), and
+	 * then calls EndRow(). Buffering works the same as with Write().
+	 *
+	 * This is only possible when writing locally; if the record needs to
+	 * be sent to remote peers, the method returns null and the caller
+	 * must use Write() instead.
+	 *
+	 * This method must only be called from the main thread.
+	 *
+	 * @param num_fields The number of fields the record has.
+	 *
+	 * @return The buffer to encode the record into, or null if the
+	 * record must be passed to Write().
+	 */
+	RowBuffer* BeginRow(int num_fields);
+
+	/**
+	 * Finishes writing a record started with BeginRow().
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	void EndRow();
+
 	/**
 	 * Sets the buffering state.
 	 *
@@ -183,11 +212,37 @@ public:
 	 */
 	const threading::Field* const * Fields() const	{ return fields; }
 
+	/**
+	 * Statistics about the batches of writes sent to the backend.
+	 */
+	struct BatchStats {
+		uint64_t writes;	// Number of records sent.
+		uint64_t batches;	// Number of batches they were sent in.
+		int batch_size;	// The current target size of a batch.
+		double avg_queue_delay;	// See WriterBackend::QueueDelays().
+		double max_queue_delay;
+	};
+
+	/**
+	 * Returns statistics about the batching of writes.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	BatchStats GetBatchStats() const;
+
 protected:
 	friend class Manager;
 
 	void DeleteVals(int num_fields, threading::Value** vals);
 
+	// Returns true if a batch of the given number of writes is to be
+	// sent to the backend.
+	bool BatchFull(int n) const;
+
+	// Adapts the batch size to the rate of the writes, given the number
+	// being sent now.
+	void AdaptBatchSize(int n);
+
 	EnumVal* stream;
 	EnumVal* writer;
 
@@ -204,9 +259,17 @@ protected:
 	const threading::Field* const*  fields;	// The log fields.
 
 	// Buffer for bulk writes.
-	static const int WRITER_BUFFER_SIZE = 1000;
 	int write_buffer_pos;	// Position of next write in buffer.
-	threading::Value*** write_buffer;	// Buffer of size WRITER_BUFFER_SIZE.
+	threading::Value*** write_buffer;	// Buffer of size Log::write_batch_max.
+	RowBuffer* row_buffer;	// Buffer for records written with BeginRow().
+
+	// Batching of writes.
+	int batch_size;	// Number of writes at which to send a batch.
+	double batch_start;	// Time the first write of the current batch came in.
+	double last_batch;	// Time the last batch was sent.
+	double write_rate;	// Smoothed writes per second.
+	uint64_t num_writes;	// Total writes sent.
+	uint64_t num_batches;	// Total batches sent.
 };
 
 } // namespace zeek::logging
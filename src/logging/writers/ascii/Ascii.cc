@@ -6,6 +6,7 @@
 #include <vector>
 #include <memory>
 #include <optional>
+#include <future>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -19,6 +20,8 @@
 #include "supervisor/Supervisor.h"
 #include "logging/Manager.h"
 #include "threading/SerialTypes.h"
+#include "threading/Manager.h"
+#include "threading/TaskPool.h"
 
 #include "Ascii.h"
 #include "ascii.bif.h"
@@ -203,6 +206,8 @@ Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend)
 	formatter = nullptr;
 	gzip_level = 0;
 	gzfile = nullptr;
+	parallel_gzip = false;
+	gzip_wrote = false;
 
 	InitConfigOptions();
 	init_options = InitFilterOptions();
@@ -215,6 +220,8 @@ void Ascii::InitConfigOptions()
 	use_json = BifConst::LogAscii::use_json;
 	enable_utf_8 = BifConst::LogAscii::enable_utf_8;
 	gzip_level = BifConst::LogAscii::gzip_level;
+	gzip_threads = BifConst::LogAscii::gzip_threads;
+	gzip_block_size = BifConst::LogAscii::gzip_block_size;
 
 	separator.assign(
 			(const char*) BifConst::LogAscii::separator->Bytes(),
@@ -495,6 +502,12 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
 			return false;
 			}
 
+		parallel_gzip = gzip_threads > 0;
+		gzip_wrote = false;
+		}
+
+	if ( gzip_level > 0 && ! parallel_gzip )
+		{
 		char mode[4];
 		snprintf(mode, sizeof(mode), "wb%d", gzip_level);
 		errno = 0; // errno will only be set under certain circumstances by gzdopen.
@@ -575,6 +588,15 @@ bool Ascii::WriteHeader(const string& path)
 
 bool Ascii::DoFlush(double network_time)
 	{
+	if ( parallel_gzip && fd )
+		{
+		if ( ! gzip_pending.empty() )
+			SubmitGzipBlock();
+
+		if ( ! WriteGzipBlocks(true) )
+			return false;
+		}
+
 	fsync(fd);
 	return true;
 	}
@@ -855,8 +877,115 @@ string Ascii::Timestamp(double t)
 	return tmp;
 	}
 
+// A block of output, compressed into a gzip member of its own by one of
+// the threads of the pool.
+struct Ascii::GzipBlock {
+	std::string data;	// Uncompressed until done, then compressed.
+	bool ok = false;
+	std::future<void> done;
+};
+
+// Shared by all Ascii writers; created on first use and shut down by the
+// thread manager.
+static threading::detail::TaskPool* gzip_pool(size_t num_threads)
+	{
+	return thread_mgr->SharedPool("zk.loggzip", num_threads);
+	}
+
+static bool gzip_compress(std::string* data, int level)
+	{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	// A window size of 15 + 16 makes zlib write a gzip header and trailer.
+	if ( deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+		return false;
+
+	std::string out;
+	out.resize(deflateBound(&zs, data->size()));
+
+	zs.next_in = reinterpret_cast<Bytef*>(&(*data)[0]);
+	zs.avail_in = data->size();
+	zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+	zs.avail_out = out.size();
+
+	int res = deflate(&zs, Z_FINISH);
+	out.resize(zs.total_out);
+	deflateEnd(&zs);
+
+	if ( res != Z_STREAM_END )
+		return false;
+
+	data->swap(out);
+	return true;
+	}
+
+void Ascii::SubmitGzipBlock()
+	{
+	auto block = std::make_shared<GzipBlock>();
+	block->data.swap(gzip_pending);
+
+	auto task = std::make_shared<std::packaged_task<void()>>(
+		[block, level = gzip_level]
+			{ block->ok = gzip_compress(&block->data, level); });
+
+	block->done = task->get_future();
+	gzip_pool(gzip_threads)->Submit([task] { (*task)(); });
+	gzip_blocks.push_back(std::move(block));
+	gzip_wrote = true;
+	}
+
+bool Ascii::WriteGzipBlocks(bool wait)
+	{
+	// Don't let a writer get too far ahead of the pool, so that memory
+	// stays bounded when the threads can't keep up.
+	size_t max_pending = 2 * gzip_threads;
+
+	while ( ! gzip_blocks.empty() )
+		{
+		auto& block = gzip_blocks.front();
+
+		if ( ! wait && gzip_blocks.size() <= max_pending &&
+		     block->done.wait_for(std::chrono::seconds(0)) != std::future_status::ready )
+			break;
+
+		block->done.get();
+
+		if ( ! block->ok )
+			{
+			Error("Ascii::WriteGzipBlocks error: compression failed");
+			gzip_blocks.clear();
+			return false;
+			}
+
+		if ( ! util::safe_write(fd, block->data.data(), block->data.size()) )
+			{
+			Error(Fmt("Ascii::WriteGzipBlocks error: %s", Strerror(errno)));
+			gzip_blocks.clear();
+			return false;
+			}
+
+		gzip_blocks.pop_front();
+		}
+
+	return true;
+	}
+
 bool Ascii::InternalWrite(int fd, const char* data, int len)
 	{
+	if ( parallel_gzip )
+		{
+		// Collect output into blocks that the pool compresses
+		// independently of each other. Concatenated, the resulting
+		// gzip members form a valid gzip file.
+		gzip_pending.append(data, len);
+
+		if ( gzip_pending.size() >= gzip_block_size )
+			SubmitGzipBlock();
+
+		return WriteGzipBlocks(false);
+		}
+
 	if ( ! gzfile )
 		return util::safe_write(fd, data, len);
 
@@ -880,6 +1009,18 @@ bool Ascii::InternalWrite(int fd, const char* data, int len)
 
 bool Ascii::InternalClose(int fd)
 	{
+	if ( parallel_gzip )
+		{
+		// Write at least one member, even if empty, for the file to
+		// be valid gzip.
+		if ( ! gzip_pending.empty() || ! gzip_wrote )
+			SubmitGzipBlock();
+
+		bool ok = WriteGzipBlocks(true);
+		util::safe_close(fd);
+		return ok;
+		}
+
 	if ( ! gzfile )
 		{
 		util::safe_close(fd);
@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <deque>
+#include <memory>
+
 #include "logging/WriterBackend.h"
 #include "threading/formatters/Ascii.h"
 #include "threading/formatters/JSON.h"
@@ -52,8 +55,17 @@ private:
 	bool InternalWrite(int fd, const char* data, int len);
 	bool InternalClose(int fd);
 
+	// Parallel compression with gzip_threads > 0. See InternalWrite().
+	struct GzipBlock;
+	void SubmitGzipBlock();
+	bool WriteGzipBlocks(bool wait);
+
 	int fd;
 	gzFile gzfile;
+	bool parallel_gzip;
+	std::string gzip_pending;	// Output not yet submitted for compression.
+	std::deque<std::shared_ptr<GzipBlock>> gzip_blocks;	// In file order.
+	bool gzip_wrote;	// True once a block got submitted for the current file.
 	std::string fname;
 	ODesc desc;
 	bool ascii_done;
@@ -71,6 +83,8 @@ private:
 
 	int gzip_level; // level > 0 enables gzip compression
 	std::string gzip_file_extension;
+	size_t gzip_threads;
+	size_t gzip_block_size;
 	bool use_json;
 	bool enable_utf_8;
 	std::string json_timestamps;
@@ -0,0 +1,621 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "zlib.h"
+
+#include "threading/SerialTypes.h"
+#include "threading/Formatter.h"
+#include "util.h"
+
+#include "Columnar.h"
+#include "columnar.bif.h"
+
+using namespace std;
+using zeek::threading::Value;
+using zeek::threading::Field;
+using zeek::threading::Formatter;
+
+namespace zeek::logging::writer::detail {
+
+using namespace columnar;
+
+static int64_t to_usecs(double d)
+	{
+	return static_cast<int64_t>(std::llround(d * 1e6));
+	}
+
+static size_t varint_size(uint64_t v)
+	{
+	size_t n = 1;
+
+	while ( v >= 0x80 )
+		{
+		v >>= 7;
+		++n;
+		}
+
+	return n;
+	}
+
+Columnar::Columnar(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	fields = nullptr;
+	num_fields = 0;
+	num_rows = 0;
+	block_start = 0;
+	fd = 0;
+	finished = false;
+
+	block_rows = BifConst::LogColumnar::block_rows;
+	flush_interval = BifConst::LogColumnar::flush_interval;
+	compression_level = BifConst::LogColumnar::compression_level;
+
+	file_extension.assign(
+		(const char*) BifConst::LogColumnar::file_extension->Bytes(),
+		BifConst::LogColumnar::file_extension->Len());
+
+	unset_field.assign(
+		(const char*) BifConst::LogColumnar::unset_field->Bytes(),
+		BifConst::LogColumnar::unset_field->Len());
+	}
+
+Columnar::~Columnar()
+	{
+	if ( ! finished )
+		// In case of errors aborting the logging altogether,
+		// DoFinish() may not have been called.
+		CloseFile();
+	}
+
+bool Columnar::DoInit(const WriterInfo& info, int arg_num_fields, const Field* const* arg_fields)
+	{
+	fields = arg_fields;
+	num_fields = arg_num_fields;
+
+	for ( const auto& [key, value] : info.config )
+		{
+		if ( strcmp(key, "block_rows") == 0 )
+			block_rows = strtoull(value, nullptr, 10);
+
+		else if ( strcmp(key, "compression_level") == 0 )
+			compression_level = atoi(value);
+
+		else if ( strcmp(key, "flush_interval") == 0 )
+			flush_interval = strtod(value, nullptr);
+		}
+
+	if ( block_rows == 0 || block_rows > MAX_BLOCK_ROWS )
+		{
+		Error(Fmt("invalid value for 'block_rows', must be between 1 and %" PRIu64 ".",
+		          MAX_BLOCK_ROWS));
+		return false;
+		}
+
+	if ( compression_level < 0 || compression_level > 9 )
+		{
+		Error("invalid value for 'compression_level', must be a number between 0 and 9.");
+		return false;
+		}
+
+	if ( ! (flush_interval >= 0) )
+		{
+		Error("invalid value for 'flush_interval', must not be negative.");
+		return false;
+		}
+
+	columns.clear();
+	columns.resize(num_fields);
+
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		Column* c = &columns[i];
+
+		switch ( fields[i]->type ) {
+		case TYPE_INT:
+		case TYPE_INTERVAL:
+			c->kind = ENCODING_PACKED;
+			c->is_signed = true;
+			break;
+
+		case TYPE_BOOL:
+		case TYPE_COUNT:
+		case TYPE_PORT:
+			c->kind = ENCODING_PACKED;
+			break;
+
+		case TYPE_TIME:
+			c->kind = ENCODING_DELTA;
+			c->is_signed = true;
+			break;
+
+		case TYPE_DOUBLE:
+			c->kind = ENCODING_DOUBLE;
+			break;
+
+		case TYPE_TABLE:
+		case TYPE_VECTOR:
+			c->kind = ENCODING_LIST;
+			break;
+
+		default:
+			c->kind = ENCODING_PLAIN;
+			break;
+		}
+		}
+
+	return OpenFile();
+	}
+
+bool Columnar::OpenFile()
+	{
+	fname = Info().path;
+
+	if ( ! IsSpecial(fname) )
+		fname += "." + file_extension;
+
+	fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if ( fd < 0 )
+		{
+		Error(Fmt("cannot open %s: %s", fname.c_str(), Strerror(errno)));
+		fd = 0;
+		return false;
+		}
+
+	block.clear();
+	block.append(FILE_MAGIC, MAGIC_LEN);
+	block.push_back(VERSION);
+	put_str(&block, Info().path, strlen(Info().path));
+	put_varint(&block, num_fields);
+
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		auto type = fields[i]->TypeName();
+		put_str(&block, fields[i]->name, strlen(fields[i]->name));
+		put_str(&block, type.data(), type.size());
+		}
+
+	return WriteData(block);
+	}
+
+void Columnar::CloseFile()
+	{
+	if ( ! fd )
+		return;
+
+	util::safe_close(fd);
+	fd = 0;
+	}
+
+bool Columnar::WriteData(const string& data)
+	{
+	if ( util::safe_write(fd, data.data(), data.size()) )
+		return true;
+
+	Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+	return false;
+	}
+
+bool Columnar::DoWrite(int num_fields, const Field* const* fields, Value** vals)
+	{
+	if ( ! fd && ! OpenFile() )
+		return false;
+
+	if ( ! num_rows )
+		block_start = util::current_time();
+
+	for ( int i = 0; i < num_fields; i++ )
+		AddValue(&columns[i], vals[i]);
+
+	++num_rows;
+
+	if ( num_rows >= block_rows || ! IsBuf() )
+		return WriteBlock();
+
+	return true;
+	}
+
+void Columnar::AddValue(Column* c, const Value* v)
+	{
+	c->present.push_back(v->present);
+
+	if ( ! v->present )
+		{
+		++c->num_unset;
+		return;
+		}
+
+	switch ( c->kind ) {
+	case ENCODING_PACKED:
+		if ( v->type == TYPE_PORT )
+			c->ints.push_back(v->val.port_val.port |
+			                  (static_cast<uint64_t>(v->val.port_val.proto) << 16));
+		else if ( v->type == TYPE_INTERVAL )
+			c->ints.push_back(to_usecs(v->val.double_val));
+		else if ( v->type == TYPE_COUNT )
+			c->ints.push_back(v->val.uint_val);
+		else
+			c->ints.push_back(v->val.int_val);
+		break;
+
+	case ENCODING_DELTA:
+		c->ints.push_back(to_usecs(v->val.double_val));
+		break;
+
+	case ENCODING_DOUBLE:
+		c->doubles.push_back(v->val.double_val);
+		break;
+
+	case ENCODING_LIST:
+		{
+		// Both unions have the same layout.
+		auto n = v->type == TYPE_TABLE ? v->val.set_val.size : v->val.vector_val.size;
+		auto vals = v->type == TYPE_TABLE ? v->val.set_val.vals : v->val.vector_val.vals;
+
+		c->list_sizes.push_back(n);
+
+		for ( bro_int_t i = 0; i < n; i++ )
+			AddString(c, vals[i]);
+
+		break;
+		}
+
+	default:
+		AddString(c, v);
+		break;
+	}
+	}
+
+void Columnar::AddString(Column* c, const Value* v)
+	{
+	auto start = c->bytes.size();
+
+	if ( ! v->present )
+		c->bytes.append(unset_field);
+
+	else switch ( v->type ) {
+	case TYPE_BOOL:
+		c->bytes.push_back(v->val.int_val ? 'T' : 'F');
+		break;
+
+	case TYPE_INT:
+		c->bytes.append(std::to_string(v->val.int_val));
+		break;
+
+	case TYPE_COUNT:
+		c->bytes.append(std::to_string(v->val.uint_val));
+		break;
+
+	case TYPE_PORT:
+		c->bytes.append(std::to_string(v->val.port_val.port));
+		break;
+
+	case TYPE_ADDR:
+		c->bytes.append(Formatter::Render(v->val.addr_val));
+		break;
+
+	case TYPE_SUBNET:
+		c->bytes.append(Formatter::Render(v->val.subnet_val));
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		c->bytes.append(Formatter::Render(v->val.double_val));
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		c->bytes.append(v->val.string_val.data, v->val.string_val.length);
+		break;
+
+	default:
+		Error(Fmt("unsupported field type %d", v->type));
+		break;
+	}
+
+	c->strings.emplace_back(start, c->bytes.size() - start);
+	}
+
+bool Columnar::WriteBlock()
+	{
+	if ( ! num_rows )
+		return true;
+
+	block.clear();
+
+	for ( auto& c : columns )
+		EncodeColumn(&c, &block);
+
+	const string* data = &block;
+	uint8_t codec = CODEC_NONE;
+
+	if ( compression_level > 0 )
+		{
+		uLongf len = compressBound(block.size());
+		compressed.resize(len);
+
+		if ( compress2(reinterpret_cast<Bytef*>(&compressed[0]), &len,
+		               reinterpret_cast<const Bytef*>(block.data()),
+		               block.size(), compression_level) == Z_OK &&
+		     len < block.size() )
+			{
+			compressed.resize(len);
+			data = &compressed;
+			codec = CODEC_ZLIB;
+			}
+		}
+
+	string header(BLOCK_MAGIC, MAGIC_LEN);
+	header.push_back(codec);
+	put_varint(&header, num_rows);
+	put_varint(&header, block.size());
+	put_varint(&header, data->size());
+
+	num_rows = 0;
+
+	return WriteData(header) && WriteData(*data);
+	}
+
+void Columnar::EncodeColumn(Column* c, string* out)
+	{
+	column_data.clear();
+	column_data.push_back(c->num_unset > 0);
+
+	if ( c->num_unset > 0 )
+		{
+		size_t start = column_data.size();
+		column_data.resize(start + (c->present.size() + 7) / 8, '\0');
+
+		for ( size_t i = 0; i < c->present.size(); i++ )
+			if ( c->present[i] )
+				column_data[start + i / 8] |= static_cast<char>(1 << (i % 8));
+		}
+
+	uint8_t encoding = c->kind;
+
+	switch ( c->kind ) {
+	case ENCODING_PACKED:
+		EncodePacked(c, &column_data);
+		break;
+
+	case ENCODING_DELTA:
+		{
+		uint64_t prev = 0;
+
+		for ( auto v : c->ints )
+			{
+			put_varint(&column_data, zigzag(static_cast<int64_t>(v - prev)));
+			prev = v;
+			}
+
+		break;
+		}
+
+	case ENCODING_DOUBLE:
+		for ( auto d : c->doubles )
+			{
+			uint64_t bits;
+			memcpy(&bits, &d, sizeof(bits));
+
+			for ( int i = 0; i < 8; i++ )
+				column_data.push_back(static_cast<char>(bits >> (8 * i)));
+			}
+
+		break;
+
+	case ENCODING_LIST:
+		{
+		size_t k = 0;
+
+		for ( auto n : c->list_sizes )
+			{
+			put_varint(&column_data, n);
+
+			for ( uint32_t i = 0; i < n; i++, k++ )
+				put_str(&column_data, c->bytes.data() + c->strings[k].first,
+				        c->strings[k].second);
+			}
+
+		break;
+		}
+
+	default:
+		EncodeStrings(c, &column_data);
+		encoding = column_data[0] & 0x80 ? ENCODING_DICT : ENCODING_PLAIN;
+		column_data[0] &= 0x7f;
+		break;
+	}
+
+	out->push_back(encoding);
+	put_varint(out, column_data.size());
+	out->append(column_data);
+
+	c->present.clear();
+	c->num_unset = 0;
+	c->ints.clear();
+	c->doubles.clear();
+	c->strings.clear();
+	c->list_sizes.clear();
+	c->bytes.clear();
+	}
+
+void Columnar::EncodePacked(Column* c, string* out)
+	{
+	uint64_t base = 0;
+
+	if ( ! c->ints.empty() )
+		{
+		base = c->ints[0];
+
+		for ( auto v : c->ints )
+			{
+			if ( c->is_signed ? static_cast<int64_t>(v) < static_cast<int64_t>(base) : v < base )
+				base = v;
+			}
+		}
+
+	uint64_t max_delta = 0;
+	scratch.clear();
+
+	for ( auto v : c->ints )
+		{
+		scratch.push_back(v - base);
+		max_delta = std::max(max_delta, v - base);
+		}
+
+	auto width = bit_width(max_delta);
+	put_varint(out, zigzag(static_cast<int64_t>(base)));
+	out->push_back(width);
+	put_packed(out, scratch.data(), scratch.size(), width);
+	}
+
+void Columnar::EncodeStrings(Column* c, string* out)
+	{
+	// Figure out the size of the dictionary encoding and go with it if
+	// it comes out smaller than the plain one. The latter is the common
+	// case for unique strings like UIDs, the former for ones drawn from a
+	// small set like protocols and services. As the choice is per block,
+	// the dictionary stays small.
+	unordered_map<std::string_view, uint32_t> dict;
+	std::vector<std::string_view> entries;
+	size_t plain_size = 0;
+	size_t dict_size = 0;
+
+	scratch.clear();
+
+	for ( const auto& [offset, len] : c->strings )
+		{
+		std::string_view s(c->bytes.data() + offset, len);
+		size_t size = varint_size(len) + len;
+		plain_size += size;
+
+		auto [it, inserted] = dict.emplace(s, entries.size());
+
+		if ( inserted )
+			{
+			entries.push_back(s);
+			dict_size += size;
+			}
+
+		scratch.push_back(it->second);
+		}
+
+	auto width = bit_width(entries.empty() ? 0 : entries.size() - 1);
+	dict_size += varint_size(entries.size()) + 1 + (scratch.size() * width + 7) / 8;
+
+	if ( dict_size >= plain_size )
+		{
+		for ( const auto& [offset, len] : c->strings )
+			put_str(out, c->bytes.data() + offset, len);
+
+		return;
+		}
+
+	// Tell the caller by flagging the first byte of the column data,
+	// which is the unset flag.
+	(*out)[0] |= 0x80;
+
+	put_varint(out, entries.size());
+
+	for ( const auto& s : entries )
+		put_str(out, s.data(), s.size());
+
+	out->push_back(width);
+	put_packed(out, scratch.data(), scratch.size(), width);
+	}
+
+bool Columnar::DoSetBuf(bool enabled)
+	{
+	if ( ! enabled )
+		return WriteBlock();
+
+	return true;
+	}
+
+bool Columnar::DoFlush(double network_time)
+	{
+	if ( ! fd )
+		return true;
+
+	if ( ! WriteBlock() )
+		return false;
+
+	fsync(fd);
+	return true;
+	}
+
+bool Columnar::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	// Don't rotate special files or if there's not one currently open.
+	if ( ! fd || IsSpecial(Info().path) )
+		{
+		FinishedRotation();
+		return true;
+		}
+
+	bool ok = WriteBlock();
+	CloseFile();
+
+	string nname = string(rotated_path) + "." + file_extension;
+
+	if ( rename(fname.c_str(), nname.c_str()) != 0 )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(),
+		          nname.c_str(), buf));
+		FinishedRotation();
+		return false;
+		}
+
+	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+		return false;
+		}
+
+	// The next write reopens the file.
+	return ok;
+	}
+
+bool Columnar::DoFinish(double network_time)
+	{
+	if ( finished )
+		{
+		fprintf(stderr, "internal error: duplicate finish\n");
+		abort();
+		}
+
+	finished = true;
+
+	bool ok = fd ? WriteBlock() : true;
+	CloseFile();
+	return ok;
+	}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time)
+	{
+	// Don't let rows of a slow stream sit in memory indefinitely.
+	if ( fd && num_rows && flush_interval > 0 &&
+	     current_time - block_start >= flush_interval )
+		return WriteBlock();
+
+	return true;
+	}
+
+} // namespace zeek::logging::writer::detail
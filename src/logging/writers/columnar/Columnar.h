@@ -0,0 +1,89 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for binary, column-oriented logs. See ColumnarFormat.h for
+// the format.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "logging/WriterBackend.h"
+
+#include "ColumnarFormat.h"
+
+namespace zeek::logging::writer::detail {
+
+class Columnar : public WriterBackend {
+public:
+	explicit Columnar(WriterFrontend* frontend);
+	~Columnar() override;
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend)
+		{ return new Columnar(frontend); }
+
+protected:
+	bool DoInit(const WriterInfo& info, int num_fields,
+	            const threading::Field* const* fields) override;
+	bool DoWrite(int num_fields, const threading::Field* const* fields,
+	             threading::Value** vals) override;
+	bool DoSetBuf(bool enabled) override;
+	bool DoRotate(const char* rotated_path, double open,
+	              double close, bool terminating) override;
+	bool DoFlush(double network_time) override;
+	bool DoFinish(double network_time) override;
+	bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+	// The values of one column for the rows of the current block. Values
+	// are only stored for rows that have one, in the representation
+	// given by the column's kind.
+	struct Column {
+		columnar::Encoding kind;	// PACKED, DELTA, DOUBLE, PLAIN or LIST.
+		bool is_signed = false;	// For PACKED and DELTA.
+		std::vector<uint8_t> present;	// One per row.
+		size_t num_unset = 0;
+		std::vector<uint64_t> ints;
+		std::vector<double> doubles;
+		std::vector<std::pair<uint32_t, uint32_t>> strings; // Into bytes.
+		std::vector<uint32_t> list_sizes;
+		std::string bytes;
+	};
+
+	bool IsSpecial(const std::string& path) 	{ return path.find("/dev/") == 0; }
+	bool OpenFile();
+	void CloseFile();
+	bool WriteBlock();
+	bool WriteData(const std::string& data);
+
+	void AddValue(Column* c, const threading::Value* v);
+	void AddString(Column* c, const threading::Value* v);
+	void EncodeColumn(Column* c, std::string* out);
+	void EncodePacked(Column* c, std::string* out);
+	void EncodeStrings(Column* c, std::string* out);
+
+	const threading::Field* const* fields;
+	int num_fields;
+	std::vector<Column> columns;
+	size_t num_rows;
+	double block_start;	// Time the first row of the current block came in.
+
+	std::string fname;
+	int fd;
+	bool finished;
+
+	// Scratch buffers, kept around to reuse their memory.
+	std::string block;
+	std::string column_data;
+	std::string compressed;
+	std::vector<uint64_t> scratch;
+
+	// Options set from the script-level.
+	size_t block_rows;
+	double flush_interval;
+	int compression_level;
+	std::string file_extension;
+	std::string unset_field;
+};
+
+} // namespace zeek::logging::writer::detail
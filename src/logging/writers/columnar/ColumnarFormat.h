@@ -0,0 +1,265 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// The file format of the Columnar log writer. This is shared between the
+// writer and the zeek-columnar-cat tool, and thus must not depend on any
+// of Zeek's internals.
+//
+// A file starts with a header describing its schema:
+//
+//   "ZCOL" | u8 version | str path | varint num_columns |
+//   num_columns x (str name | str type)
+//
+// with the type given as in the #types line of Ascii logs. The header is
+// followed by any number of blocks, each holding the next num_rows rows:
+//
+//   "ZBLK" | u8 codec | varint num_rows | varint raw_size |
+//   varint stored_size | stored_size bytes of column data
+//
+// The codec tells whether the column data is stored as is, or has been
+// compressed into stored_size bytes from raw_size ones. A block holds at
+// most MAX_BLOCK_ROWS rows, and zlib never expands data by more than
+// MAX_ZLIB_RATIO, which allows readers to reject corrupt sizes before
+// allocating memory for them. Once decompressed,
+// the column data is the columns in the order of the schema:
+//
+//   u8 encoding | varint size | size bytes
+//
+// which allows readers to skip any columns they are not interested in.
+// The column's bytes start with a flag telling whether any of its values
+// are unset. If so, a bitmap follows in which each set bit marks a row
+// having a value. The values of those rows then come in the column's
+// encoding:
+//
+//   ENCODING_PLAIN:   num_values x str
+//   ENCODING_DICT:    varint num_entries | num_entries x str |
+//                     u8 width | packed entry indices
+//   ENCODING_PACKED:  varint zigzag(base) | u8 width | packed (value - base)
+//   ENCODING_DELTA:   num_values x varint zigzag(value - previous value)
+//   ENCODING_DOUBLE:  num_values x u64 (little-endian IEEE 754 bits)
+//   ENCODING_LIST:    num_values x (varint num_elements | num_elements x str)
+//
+// where str is a varint length followed by that many bytes, and varints
+// use the LEB128 encoding. Packed values are stored with the given number
+// of bits each, least significant bits first. The delta encoding starts
+// from a previous value of zero.
+//
+// Booleans, counts and integers are packed; ports are packed as their
+// number plus the protocol shifted by 16 bits. Time values are delta
+// encoded and intervals are packed, both in microseconds, which is the
+// precision the Ascii writer logs them with. Strings, enums, addresses,
+// subnets, files and functions are plain or dictionary encoded, whichever
+// turns out smaller; all but strings are stored in their Ascii log
+// representation. Sets and vectors are stored as lists of the Ascii log
+// representation of their elements, with the unset field marker ("-")
+// for unset elements.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace zeek::logging::writer::detail::columnar {
+
+constexpr char FILE_MAGIC[] = "ZCOL";
+constexpr char BLOCK_MAGIC[] = "ZBLK";
+constexpr size_t MAGIC_LEN = 4;
+constexpr uint8_t VERSION = 1;
+
+constexpr uint64_t MAX_BLOCK_ROWS = uint64_t(1) << 20;
+constexpr uint64_t MAX_ZLIB_RATIO = 1032;
+
+enum Codec : uint8_t {
+	CODEC_NONE = 0,
+	CODEC_ZLIB = 1,
+};
+
+enum Encoding : uint8_t {
+	ENCODING_PLAIN = 0,
+	ENCODING_DICT = 1,
+	ENCODING_PACKED = 2,
+	ENCODING_DELTA = 3,
+	ENCODING_DOUBLE = 4,
+	ENCODING_LIST = 5,
+};
+
+inline uint64_t zigzag(int64_t v)
+	{
+	return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+	}
+
+inline int64_t unzigzag(uint64_t v)
+	{
+	return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+	}
+
+/**
+ * Returns the number of bits needed to represent a value.
+ */
+inline uint8_t bit_width(uint64_t v)
+	{
+	uint8_t n = 0;
+
+	while ( v )
+		{
+		++n;
+		v >>= 1;
+		}
+
+	return n;
+	}
+
+inline void put_varint(std::string* out, uint64_t v)
+	{
+	while ( v >= 0x80 )
+		{
+		out->push_back(static_cast<char>(v | 0x80));
+		v >>= 7;
+		}
+
+	out->push_back(static_cast<char>(v));
+	}
+
+inline void put_str(std::string* out, const char* data, size_t len)
+	{
+	put_varint(out, len);
+	out->append(data, len);
+	}
+
+/**
+ * Appends values packed with a given number of bits each.
+ */
+inline void put_packed(std::string* out, const uint64_t* vals, size_t n, uint8_t width)
+	{
+	size_t start = out->size();
+	out->resize(start + (n * width + 7) / 8, '\0');
+	auto p = reinterpret_cast<uint8_t*>(&(*out)[start]);
+	size_t bit = 0;
+
+	for ( size_t i = 0; i < n; i++ )
+		{
+		for ( int j = 0; j < width; )
+			{
+			int off = bit % 8;
+			int take = std::min(8 - off, width - j);
+			uint64_t chunk = (vals[i] >> j) & ((1u << take) - 1);
+			p[bit / 8] |= static_cast<uint8_t>(chunk << off);
+			j += take;
+			bit += take;
+			}
+		}
+	}
+
+/**
+ * A cursor for decoding a buffer. Reading past its end doesn't crash but
+ * sets a sticky error flag instead, so that callers can check once after
+ * decoding a larger unit.
+ */
+class Cursor {
+public:
+	Cursor(const char* data, size_t len) : data(data), end(data + len)	{ }
+
+	bool Failed() const	{ return failed; }
+	bool AtEnd() const	{ return data >= end; }
+	size_t Left() const	{ return end - data; }
+
+	uint8_t Byte()
+		{
+		if ( data >= end )
+			{
+			failed = true;
+			return 0;
+			}
+
+		return static_cast<uint8_t>(*data++);
+		}
+
+	uint64_t Varint()
+		{
+		uint64_t v = 0;
+
+		for ( int shift = 0; shift < 64; shift += 7 )
+			{
+			uint8_t b = Byte();
+			v |= static_cast<uint64_t>(b & 0x7f) << shift;
+
+			if ( ! (b & 0x80) )
+				return v;
+			}
+
+		failed = true;
+		return 0;
+		}
+
+	const char* Bytes(size_t len)
+		{
+		if ( Left() < len )
+			{
+			failed = true;
+			data = end;
+			return nullptr;
+			}
+
+		const char* p = data;
+		data += len;
+		return p;
+		}
+
+	std::string Str()
+		{
+		size_t len = Varint();
+		const char* p = Bytes(len);
+		return p ? std::string(p, len) : std::string();
+		}
+
+	/**
+	 * Reads *n* values packed with *width* bits each.
+	 */
+	void Packed(size_t n, uint8_t width, std::vector<uint64_t>* vals)
+		{
+		// Check that the input holds all values before allocating
+		// space for them, and without overflowing n * width.
+		if ( width > 64 || (width && n > Left() * 8 / width) )
+			{
+			failed = true;
+			data = end;
+			return;
+			}
+
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(
+			Bytes((n * width + 7) / 8));
+
+		if ( ! p )
+			return;
+
+		vals->resize(n);
+
+		size_t bit = 0;
+
+		for ( size_t i = 0; i < n; i++ )
+			{
+			uint64_t v = 0;
+
+			for ( int j = 0; j < width; )
+				{
+				int off = bit % 8;
+				int take = std::min(8 - off, width - j);
+				uint64_t chunk = (p[bit / 8] >> off) & ((1u << take) - 1);
+				v |= chunk << j;
+				j += take;
+				bit += take;
+				}
+
+			(*vals)[i] = v;
+			}
+		}
+
+private:
+	const char* data;
+	const char* end;
+	bool failed = false;
+};
+
+} // namespace zeek::logging::writer::detail::columnar
@@ -0,0 +1,23 @@
+// See the file  in the main distribution directory for copyright.
+
+
+#include "plugin/Plugin.h"
+
+#include "Columnar.h"
+
+namespace zeek::plugin::detail::Zeek_ColumnarWriter {
+
+class Plugin : public zeek::plugin::Plugin {
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(new zeek::logging::Component("Columnar", zeek::logging::writer::detail::Columnar::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::ColumnarWriter";
+		config.description = "Columnar binary log writer";
+		return config;
+		}
+} plugin;
+
+} // namespace zeek::plugin::detail::Zeek_ColumnarWriter
@@ -0,0 +1,546 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Converts logs written by the Columnar writer back into Zeek's
+// tab-separated Ascii format, optionally restricted to a set of columns.
+// Columns not asked for are skipped without being decoded.
+
+#include <cctype>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "zlib.h"
+
+#include "ColumnarFormat.h"
+
+using namespace zeek::logging::writer::detail::columnar;
+
+static const char* unset_field = "-";
+static const char* empty_field = "(empty)";
+static const char* set_separator = ",";
+
+struct Column {
+	std::string name;
+	std::string type;
+	bool selected;
+};
+
+static void usage()
+	{
+	fprintf(stderr,
+		"usage: zeek-columnar-cat [-c <columns>] [-n] [-s] <file> ...\n"
+		"\n"
+		"    -c <columns>  comma-separated list of columns to output\n"
+		"    -n            don't output header lines\n"
+		"    -s            output the encoding of each block's columns\n"
+		"                  instead of the rows\n");
+	exit(1);
+	}
+
+static bool read_file(const char* path, std::string* data)
+	{
+	FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+
+	if ( ! f )
+		{
+		fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+		return false;
+		}
+
+	char buf[65536];
+	size_t n;
+
+	while ( (n = fread(buf, 1, sizeof(buf), f)) > 0 )
+		data->append(buf, n);
+
+	bool ok = ! ferror(f);
+
+	if ( f != stdin )
+		fclose(f);
+
+	if ( ! ok )
+		fprintf(stderr, "error reading %s\n", path);
+
+	return ok;
+	}
+
+static std::string escape(const std::string& s)
+	{
+	if ( s.empty() )
+		return empty_field;
+
+	std::string r;
+
+	for ( unsigned char c : s )
+		{
+		if ( c == '\\' || c == '\t' || ! isprint(c) )
+			{
+			char hex[5];
+			snprintf(hex, sizeof(hex), "\\x%02x", c);
+			r += hex;
+			}
+		else
+			r += c;
+		}
+
+	return r;
+	}
+
+static std::string render_number(const std::string& type, uint64_t v)
+	{
+	char buf[64];
+
+	if ( type == "bool" )
+		return v ? "T" : "F";
+
+	if ( type == "count" )
+		snprintf(buf, sizeof(buf), "%" PRIu64, v);
+
+	else if ( type == "port" )
+		snprintf(buf, sizeof(buf), "%" PRIu64, v & 0xffff);
+
+	else if ( type == "time" || type == "interval" )
+		{
+		auto us = static_cast<int64_t>(v);
+		uint64_t abs = us < 0 ? -static_cast<uint64_t>(us) : us;
+		snprintf(buf, sizeof(buf), "%s%" PRIu64 ".%06" PRIu64,
+		         us < 0 ? "-" : "", abs / 1000000, abs % 1000000);
+		}
+
+	else
+		snprintf(buf, sizeof(buf), "%" PRId64, static_cast<int64_t>(v));
+
+	return buf;
+	}
+
+/**
+ * Decodes a column into the Ascii representation of its values, one per
+ * row.
+ */
+static bool decode_column(const Column& col, uint8_t encoding, Cursor* c,
+                          size_t num_rows, std::vector<std::string>* out)
+	{
+	// The caller has bounded num_rows already. Each value of most
+	// encodings takes at least one byte, which bounds their number more
+	// tightly before we allocate anything for them.
+	std::vector<bool> present(num_rows, true);
+	size_t n = num_rows;
+
+	if ( c->Byte() )
+		{
+		auto bitmap = reinterpret_cast<const uint8_t*>(c->Bytes((num_rows + 7) / 8));
+
+		if ( ! bitmap )
+			return false;
+
+		for ( size_t i = 0; i < num_rows; i++ )
+			{
+			present[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+
+			if ( ! present[i] )
+				--n;
+			}
+		}
+
+	size_t min_value_size = 0;
+
+	switch ( encoding ) {
+	case ENCODING_PLAIN:
+	case ENCODING_DELTA:
+	case ENCODING_LIST:
+		min_value_size = 1;
+		break;
+
+	case ENCODING_DOUBLE:
+		min_value_size = 8;
+		break;
+	}
+
+	if ( min_value_size && n > c->Left() / min_value_size )
+		return false;
+
+	std::vector<std::string> vals;
+	vals.reserve(n);
+
+	std::vector<uint64_t> packed;
+
+	switch ( encoding ) {
+	case ENCODING_PLAIN:
+		for ( size_t i = 0; i < n; i++ )
+			vals.push_back(escape(c->Str()));
+		break;
+
+	case ENCODING_DICT:
+		{
+		auto num_entries = c->Varint();
+
+		if ( c->Failed() || num_entries > c->Left() )
+			return false;
+
+		std::vector<std::string> entries(num_entries);
+
+		for ( auto& e : entries )
+			e = escape(c->Str());
+
+		c->Packed(n, c->Byte(), &packed);
+
+		for ( auto idx : packed )
+			{
+			if ( idx >= entries.size() )
+				return false;
+
+			vals.push_back(entries[idx]);
+			}
+
+		break;
+		}
+
+	case ENCODING_PACKED:
+		{
+		uint64_t base = unzigzag(c->Varint());
+		c->Packed(n, c->Byte(), &packed);
+
+		for ( auto v : packed )
+			vals.push_back(render_number(col.type, base + v));
+
+		break;
+		}
+
+	case ENCODING_DELTA:
+		{
+		uint64_t prev = 0;
+
+		for ( size_t i = 0; i < n; i++ )
+			{
+			prev += unzigzag(c->Varint());
+			vals.push_back(render_number(col.type, prev));
+			}
+
+		break;
+		}
+
+	case ENCODING_DOUBLE:
+		for ( size_t i = 0; i < n; i++ )
+			{
+			auto p = reinterpret_cast<const uint8_t*>(c->Bytes(8));
+
+			if ( ! p )
+				return false;
+
+			uint64_t bits = 0;
+
+			for ( int j = 0; j < 8; j++ )
+				bits |= static_cast<uint64_t>(p[j]) << (8 * j);
+
+			double d;
+			memcpy(&d, &bits, sizeof(d));
+
+			// Like the Ascii writer, use as many digits as
+			// needed to represent the value exactly.
+			char buf[64];
+
+			for ( int prec = 1; prec <= 17; prec++ )
+				{
+				snprintf(buf, sizeof(buf), "%.*g", prec, d);
+
+				if ( strtod(buf, nullptr) == d )
+					break;
+				}
+
+			vals.push_back(buf);
+			}
+
+		break;
+
+	case ENCODING_LIST:
+		for ( size_t i = 0; i < n; i++ )
+			{
+			auto k = c->Varint();
+
+			if ( k == 0 )
+				{
+				vals.push_back(empty_field);
+				continue;
+				}
+
+			std::string s;
+
+			for ( uint64_t j = 0; j < k && ! c->Failed(); j++ )
+				{
+				if ( j > 0 )
+					s += set_separator;
+
+				s += escape(c->Str());
+				}
+
+			vals.push_back(s);
+			}
+
+		break;
+
+	default:
+		fprintf(stderr, "unknown encoding %u of column %s\n",
+		        encoding, col.name.c_str());
+		return false;
+	}
+
+	if ( c->Failed() || vals.size() != n )
+		return false;
+
+	out->resize(num_rows);
+
+	for ( size_t i = 0, k = 0; i < num_rows; i++ )
+		(*out)[i] = present[i] ? std::move(vals[k++]) : unset_field;
+
+	return true;
+	}
+
+static const char* encoding_name(uint8_t encoding)
+	{
+	switch ( encoding ) {
+	case ENCODING_PLAIN:	return "plain";
+	case ENCODING_DICT:	return "dict";
+	case ENCODING_PACKED:	return "packed";
+	case ENCODING_DELTA:	return "delta";
+	case ENCODING_DOUBLE:	return "double";
+	case ENCODING_LIST:	return "list";
+	default:		return "unknown";
+	}
+	}
+
+static bool cat(const char* path, const std::vector<std::string>& wanted,
+                bool header, bool stats)
+	{
+	std::string data;
+
+	if ( ! read_file(path, &data) )
+		return false;
+
+	Cursor c(data.data(), data.size());
+	auto magic = c.Bytes(MAGIC_LEN);
+
+	if ( ! magic || memcmp(magic, FILE_MAGIC, MAGIC_LEN) != 0 )
+		{
+		fprintf(stderr, "%s: not a columnar log\n", path);
+		return false;
+		}
+
+	if ( auto version = c.Byte(); version != VERSION )
+		{
+		fprintf(stderr, "%s: unsupported version %u\n", path, version);
+		return false;
+		}
+
+	std::string log_path = c.Str();
+	auto num_columns = c.Varint();
+
+	if ( c.Failed() || num_columns > c.Left() )
+		{
+		fprintf(stderr, "%s: truncated header\n", path);
+		return false;
+		}
+
+	std::vector<Column> columns(num_columns);
+
+	std::vector<int> output;	// Indices of the columns to output.
+
+	for ( auto& col : columns )
+		{
+		col.name = c.Str();
+		col.type = c.Str();
+		col.selected = wanted.empty();
+		}
+
+	if ( wanted.empty() )
+		for ( size_t i = 0; i < columns.size(); i++ )
+			output.push_back(i);
+
+	for ( const auto& w : wanted )
+		{
+		for ( size_t i = 0; i < columns.size(); i++ )
+			if ( columns[i].name == w )
+				{
+				columns[i].selected = true;
+				output.push_back(i);
+				}
+		}
+
+	if ( header && ! stats )
+		{
+		printf("#path\t%s\n#fields", log_path.c_str());
+
+		for ( auto i : output )
+			printf("\t%s", columns[i].name.c_str());
+
+		printf("\n#types");
+
+		for ( auto i : output )
+			printf("\t%s", columns[i].type.c_str());
+
+		printf("\n");
+		}
+
+	std::vector<std::vector<std::string>> values(columns.size());
+	std::string raw;
+	int num_blocks = 0;
+
+	while ( ! c.AtEnd() )
+		{
+		magic = c.Bytes(MAGIC_LEN);
+		auto codec = c.Byte();
+		auto num_rows = c.Varint();
+		auto raw_size = c.Varint();
+		auto stored_size = c.Varint();
+		auto stored = c.Bytes(stored_size);
+
+		// Check the sizes against what the format permits before
+		// allocating anything based on them.
+		if ( c.Failed() || memcmp(magic, BLOCK_MAGIC, MAGIC_LEN) != 0 ||
+		     num_rows > MAX_BLOCK_ROWS || raw_size / MAX_ZLIB_RATIO > stored_size )
+			{
+			fprintf(stderr, "%s: corrupt block %d\n", path, num_blocks);
+			return false;
+			}
+
+		const char* block = stored;
+
+		if ( codec == CODEC_ZLIB )
+			{
+			raw.resize(raw_size);
+			uLongf len = raw_size;
+
+			if ( uncompress(reinterpret_cast<Bytef*>(&raw[0]), &len,
+			                reinterpret_cast<const Bytef*>(stored),
+			                stored_size) != Z_OK || len != raw_size )
+				{
+				fprintf(stderr, "%s: cannot decompress block %d\n", path, num_blocks);
+				return false;
+				}
+
+			block = raw.data();
+			}
+
+		else if ( codec != CODEC_NONE || raw_size != stored_size )
+			{
+			fprintf(stderr, "%s: unknown codec %u in block %d\n", path, codec, num_blocks);
+			return false;
+			}
+
+		if ( stats )
+			printf("block %d: %" PRIu64 " rows, %" PRIu64 " bytes, %" PRIu64 " stored\n",
+			       num_blocks, num_rows, raw_size, stored_size);
+
+		Cursor bc(block, raw_size);
+
+		for ( size_t i = 0; i < columns.size(); i++ )
+			{
+			auto encoding = bc.Byte();
+			auto size = bc.Varint();
+			auto col_data = bc.Bytes(size);
+
+			if ( bc.Failed() )
+				break;
+
+			if ( stats )
+				printf("  %s: %s, %" PRIu64 " bytes\n", columns[i].name.c_str(),
+				       encoding_name(encoding), size);
+
+			if ( ! columns[i].selected || stats )
+				continue;
+
+			Cursor cc(col_data, size);
+
+			if ( ! decode_column(columns[i], encoding, &cc, num_rows, &values[i]) )
+				{
+				fprintf(stderr, "%s: corrupt column %s in block %d\n",
+				        path, columns[i].name.c_str(), num_blocks);
+				return false;
+				}
+			}
+
+		if ( bc.Failed() )
+			{
+			fprintf(stderr, "%s: corrupt block %d\n", path, num_blocks);
+			return false;
+			}
+
+		for ( uint64_t row = 0; row < num_rows && ! stats; row++ )
+			{
+			for ( size_t j = 0; j < output.size(); j++ )
+				{
+				if ( j > 0 )
+					putchar('\t');
+
+				fputs(values[output[j]][row].c_str(), stdout);
+				}
+
+			putchar('\n');
+			}
+
+		++num_blocks;
+		}
+
+	return true;
+	}
+
+int main(int argc, char** argv)
+	{
+	std::vector<std::string> wanted;
+	bool header = true;
+	bool stats = false;
+	int opt;
+
+	while ( (opt = getopt(argc, argv, "c:ns")) != -1 )
+		{
+		switch ( opt ) {
+		case 'c':
+			{
+			std::string cols = optarg;
+			size_t start = 0;
+
+			while ( start <= cols.size() )
+				{
+				auto end = cols.find(',', start);
+
+				if ( end == std::string::npos )
+					end = cols.size();
+
+				if ( end > start )
+					wanted.push_back(cols.substr(start, end - start));
+
+				start = end + 1;
+				}
+
+			break;
+			}
+
+		case 'n':
+			header = false;
+			break;
+
+		case 's':
+			stats = true;
+			break;
+
+		default:
+			usage();
+		}
+		}
+
+	if ( optind >= argc )
+		usage();
+
+	int rc = 0;
+
+	for ( int i = optind; i < argc; i++ )
+		if ( ! cat(argv[i], wanted, header, stats) )
+			rc = 1;
+
+	return rc;
+	}
@@ -4,6 +4,7 @@
 
 #include <string>
 #include <errno.h>
+#include <strings.h>
 #include <vector>
 
 #include "threading/SerialTypes.h"
@@ -19,7 +20,8 @@ namespace zeek::logging::writer::detail {
 
 SQLite::SQLite(WriterFrontend* frontend)
 	: WriterBackend(frontend),
-	  fields(), num_fields(), db(), st()
+	  fields(), num_fields(), db(), st(), begin_st(), commit_st(),
+	  in_transaction()
 	{
 	set_separator.assign(
 			(const char*) BifConst::LogSQLite::set_separator->Bytes(),
@@ -36,6 +38,16 @@ SQLite::SQLite(WriterFrontend* frontend)
 			BifConst::LogSQLite::empty_field->Len()
 			);
 
+	journal_mode.assign(
+			(const char*) BifConst::LogSQLite::journal_mode->Bytes(),
+			BifConst::LogSQLite::journal_mode->Len()
+			);
+
+	synchronous.assign(
+			(const char*) BifConst::LogSQLite::synchronous->Bytes(),
+			BifConst::LogSQLite::synchronous->Len()
+			);
+
 	threading::formatter::Ascii::SeparatorInfo sep_info(string(), set_separator, unset_field, empty_field);
 	io = new threading::formatter::Ascii(this, sep_info);
 	}
@@ -44,7 +56,12 @@ SQLite::~SQLite()
 	{
 	if ( db != 0 )
 		{
+		if ( in_transaction )
+			CommitTransaction();
+
 		sqlite3_finalize(st);
+		sqlite3_finalize(begin_st);
+		sqlite3_finalize(commit_st);
 		if ( ! sqlite3_close(db) )
 			Error("Sqlite could not close connection");
 
@@ -111,6 +128,60 @@ bool SQLite::checkError(int code)
 	return false;
 	}
 
+bool SQLite::SetPragma(const string& name, const string& value)
+	{
+	if ( value.empty() )
+		return true;
+
+	string pragma = "PRAGMA " + name + " = " + value + ";";
+	sqlite3_stmt* stmt;
+
+	if ( checkError(sqlite3_prepare_v2(db, pragma.c_str(), pragma.size()+1, &stmt, NULL)) )
+		return false;
+
+	int res = sqlite3_step(stmt);
+
+	// Setting the journal mode returns the one now in effect, which
+	// stays the old one if the new one isn't possible.
+	if ( res == SQLITE_ROW && sqlite3_column_type(stmt, 0) == SQLITE_TEXT )
+		{
+		const char* current = (const char*) sqlite3_column_text(stmt, 0);
+
+		if ( strcasecmp(current, value.c_str()) != 0 )
+			Warning(Fmt("could not set %s to %s, using %s", name.c_str(),
+			            value.c_str(), current));
+
+		res = sqlite3_step(stmt);
+		}
+
+	sqlite3_finalize(stmt);
+	return ! checkError(res);
+	}
+
+// Writes happen in a transaction per batch of records, which is much
+// faster than letting SQLite commit each on its own.
+bool SQLite::BeginTransaction()
+	{
+	int res = sqlite3_step(begin_st);
+	sqlite3_reset(begin_st);
+
+	if ( checkError(res) )
+		return false;
+
+	in_transaction = true;
+	return true;
+	}
+
+bool SQLite::CommitTransaction()
+	{
+	in_transaction = false;
+
+	int res = sqlite3_step(commit_st);
+	sqlite3_reset(commit_st);
+
+	return ! checkError(res);
+	}
+
 bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
                     const Field* const * arg_fields)
 	{
@@ -120,10 +191,6 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 		return false;
 		}
 
-	// Allow connections to same DB to use single data/schema cache. Also
-	// allows simultaneous writes to one file.
-	sqlite3_enable_shared_cache(1);
-
 	num_fields = arg_num_fields;
 	fields = arg_fields;
 
@@ -140,16 +207,34 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 	else
 		tablename = it->second;
 
+	it = info.config.find("journal_mode");
+	if ( it != info.config.end() )
+		journal_mode = it->second;
+
+	it = info.config.find("synchronous");
+	if ( it != info.config.end() )
+		synchronous = it->second;
+
 	if ( checkError(sqlite3_open_v2(
 					fullpath.c_str(),
 					&db,
 					SQLITE_OPEN_READWRITE |
 					SQLITE_OPEN_CREATE |
-					SQLITE_OPEN_NOMUTEX
+					SQLITE_OPEN_NOMUTEX |
+					SQLITE_OPEN_PRIVATECACHE
 					,
 					NULL)) )
 		return false;
 
+	// Writers to the same database, in this process or others, take
+	// turns through SQLite's file locks. With a private cache, SQLite's
+	// busy handler covers all of them, from the pragmas on.
+	if ( checkError(sqlite3_busy_timeout(db, BifConst::LogSQLite::busy_timeout * 1000)) )
+		return false;
+
+	if ( ! SetPragma("journal_mode", journal_mode) || ! SetPragma("synchronous", synchronous) )
+		return false;
+
 	string create = "CREATE TABLE IF NOT EXISTS " + tablename + " (\n";
 		//"id SERIAL UNIQUE NOT NULL"; // SQLite has rowids, we do not need a counter here.
 
@@ -233,6 +318,12 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 	if ( checkError(sqlite3_prepare_v2(db, insert.c_str(), insert.size()+1, &st, NULL)) )
 		return false;
 
+	// Taking the write lock right away means other writers to the
+	// database make us wait when starting a batch, not midway through.
+	if ( checkError(sqlite3_prepare_v2(db, "BEGIN IMMEDIATE;", -1, &begin_st, NULL)) ||
+	     checkError(sqlite3_prepare_v2(db, "COMMIT;", -1, &commit_st, NULL)) )
+		return false;
+
 	return true;
 	}
 
@@ -334,6 +425,9 @@ int SQLite::AddParams(Value* val, int pos)
 
 bool SQLite::DoWrite(int num_fields, const Field* const * fields, Value** vals)
 	{
+	if ( ! in_transaction && ! BeginTransaction() )
+		return false;
+
 	// bind parameters
 	for ( int i = 0; i < num_fields; i++ )
 		{
@@ -355,6 +449,11 @@ bool SQLite::DoWrite(int num_fields, const Field* const * fields, Value** vals)
 	return true;
 	}
 
+bool SQLite::DoEndBatch()
+	{
+	return ! in_transaction || CommitTransaction();
+	}
+
 bool SQLite::DoRotate(const char* rotated_path, double open, double close, bool terminating)
 	{
 	if ( ! FinishedRotation("/dev/null", Info().path, open, close, terminating))
@@ -26,6 +26,7 @@ protected:
 			    const threading::Field* const* arg_fields) override;
 	bool DoWrite(int num_fields, const threading::Field* const* fields,
 			     threading::Value** vals) override;
+	bool DoEndBatch() override;
 	bool DoSetBuf(bool enabled) override { return true; }
 	bool DoRotate(const char* rotated_path, double open,
 			      double close, bool terminating) override;
@@ -36,6 +37,10 @@ protected:
 private:
 	bool checkError(int code);
 
+	bool SetPragma(const std::string& name, const std::string& value);
+	bool BeginTransaction();
+	bool CommitTransaction();
+
 	int AddParams(threading::Value* val, int pos);
 	std::string GetTableType(int, int);
 
@@ -44,10 +49,15 @@ private:
 
 	sqlite3 *db;
 	sqlite3_stmt *st;
+	sqlite3_stmt *begin_st;
+	sqlite3_stmt *commit_st;
+	bool in_transaction;
 
 	std::string set_separator;
 	std::string unset_field;
 	std::string empty_field;
+	std::string journal_mode;
+	std::string synchronous;
 
 	threading::formatter::Ascii* io;
 };
@@ -2,16 +2,25 @@
 
 #include "BloomFilter.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <limits>
 
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
 #include <broker/data.hh>
 #include <broker/error.hh>
 
+#include <openssl/sha.h>
+
 #include "CounterVector.h"
 
 #include "../util.h"
 #include "../Reporter.h"
+#include "../digest.h"
 
 namespace zeek::probabilistic {
 
@@ -70,8 +79,15 @@ std::unique_ptr<BloomFilter> BloomFilter::Unserialize(const broker::data& data)
 	case Counting:
 		bf = std::unique_ptr<BloomFilter>(new CountingBloomFilter());
 		break;
+
+	case SplitBlock:
+		bf = std::unique_ptr<BloomFilter>(new SplitBlockBloomFilter());
+		break;
 	}
 
+	if ( ! bf )
+		return nullptr;
+
 	if ( ! bf->DoUnserialize((*v)[2]) )
 		return nullptr;
 
@@ -301,4 +317,246 @@ bool CountingBloomFilter::DoUnserialize(const broker::data& data)
 	return true;
 	}
 
+// The odd constants that spread an element's hash over the words of its
+// block, as used by the split-block Bloom filters of Impala and Parquet.
+static constexpr uint32_t split_block_salts[8] = {
+	0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+	0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+SplitBlockBloomFilter::SplitBlockBloomFilter()
+	{
+	}
+
+SplitBlockBloomFilter::SplitBlockBloomFilter(const detail::Hasher* hasher, size_t arg_blocks)
+	: BloomFilter(hasher), blocks(std::max(arg_blocks, static_cast<size_t>(1)), Block{})
+	{
+	}
+
+SplitBlockBloomFilter::~SplitBlockBloomFilter()
+	{
+	}
+
+// The false positive rate of a split-block Bloom filter holding an average
+// of load elements per block. The number of elements in a block follows a
+// Poisson distribution.
+static double split_block_fp(double load)
+	{
+	double p = std::exp(-load);
+	double rval = 0;
+	double last = load + 12 * std::sqrt(load) + 32;
+
+	for ( int k = 0; k <= last; ++k )
+		{
+		if ( k > 0 )
+			p *= load / k;
+
+		rval += p * std::pow(1.0 - std::pow(63.0 / 64, k), 8);
+		}
+
+	return rval;
+	}
+
+size_t SplitBlockBloomFilter::Blocks(double fp, size_t capacity)
+	{
+	// Each word receives one bit per element, so on average it's a
+	// one-hash Bloom filter of its own that needs to have a false
+	// positive rate of the eighth root of fp.
+	double bits = -8.0 * capacity / std::log(1.0 - std::pow(fp, 1.0 / 8));
+	auto n = std::max(static_cast<size_t>(std::ceil(bits / 512)), static_cast<size_t>(1));
+
+	// Blocks with more elements than average have a higher rate, though,
+	// which the average doesn't account for.
+	while ( static_cast<double>(capacity) / n < 512 &&
+	        split_block_fp(static_cast<double>(capacity) / n) > fp )
+		n += n / 64 + 1;
+
+	return n;
+	}
+
+SplitBlockBloomFilter::Block& SplitBlockBloomFilter::BlockFor(uint64_t digest)
+	{
+	// The upper half of the hash selects the block, mapping it onto the
+	// range without a division.
+	return blocks[((digest >> 32) * blocks.size()) >> 32];
+	}
+
+const SplitBlockBloomFilter::Block& SplitBlockBloomFilter::BlockFor(uint64_t digest) const
+	{
+	return blocks[((digest >> 32) * blocks.size()) >> 32];
+	}
+
+// Computes the bit that the lower half of an element's hash sets in each
+// word of its block.
+#if defined(__AVX2__)
+static inline void split_block_mask(uint32_t x, __m256i* lo, __m256i* hi)
+	{
+	const __m256i salts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(split_block_salts));
+	const __m256i one = _mm256_set1_epi64x(1);
+
+	auto shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(x), salts), 26);
+	*lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(shifts)));
+	*hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(shifts, 1)));
+	}
+#else
+static inline void split_block_mask(uint32_t x, uint64_t* mask)
+	{
+	for ( int i = 0; i < 8; ++i )
+		mask[i] = uint64_t(1) << ((x * split_block_salts[i]) >> 26);
+	}
+#endif
+
+void SplitBlockBloomFilter::Add(const zeek::detail::HashKey* key)
+	{
+	uint64_t digest = detail::UHF(hasher->Seed())(key->Key(), key->Size());
+	auto& block = BlockFor(digest);
+
+#if defined(__AVX2__)
+	__m256i lo, hi;
+	split_block_mask(static_cast<uint32_t>(digest), &lo, &hi);
+
+	auto words = reinterpret_cast<__m256i*>(block.words);
+	_mm256_store_si256(words, _mm256_or_si256(_mm256_load_si256(words), lo));
+	_mm256_store_si256(words + 1, _mm256_or_si256(_mm256_load_si256(words + 1), hi));
+#else
+	uint64_t mask[8];
+	split_block_mask(static_cast<uint32_t>(digest), mask);
+
+	for ( int i = 0; i < 8; ++i )
+		block.words[i] |= mask[i];
+#endif
+	}
+
+size_t SplitBlockBloomFilter::Count(const zeek::detail::HashKey* key) const
+	{
+	uint64_t digest = detail::UHF(hasher->Seed())(key->Key(), key->Size());
+	const auto& block = BlockFor(digest);
+
+#if defined(__AVX2__)
+	__m256i lo, hi;
+	split_block_mask(static_cast<uint32_t>(digest), &lo, &hi);
+
+	auto words = reinterpret_cast<const __m256i*>(block.words);
+	return _mm256_testc_si256(_mm256_load_si256(words), lo) &&
+	       _mm256_testc_si256(_mm256_load_si256(words + 1), hi);
+#else
+	uint64_t mask[8];
+	split_block_mask(static_cast<uint32_t>(digest), mask);
+
+	for ( int i = 0; i < 8; ++i )
+		if ( (block.words[i] & mask[i]) != mask[i] )
+			return 0;
+
+	return 1;
+#endif
+	}
+
+bool SplitBlockBloomFilter::Empty() const
+	{
+	for ( const auto& b : blocks )
+		for ( auto w : b.words )
+			if ( w )
+				return false;
+
+	return true;
+	}
+
+void SplitBlockBloomFilter::Clear()
+	{
+	std::fill(blocks.begin(), blocks.end(), Block{});
+	}
+
+bool SplitBlockBloomFilter::Merge(const BloomFilter* other)
+	{
+	if ( typeid(*this) != typeid(*other) )
+		return false;
+
+	const SplitBlockBloomFilter* o = static_cast<const SplitBlockBloomFilter*>(other);
+
+	if ( ! hasher->Equals(o->hasher) )
+		{
+		reporter->Error("incompatible hashers in SplitBlockBloomFilter merge");
+		return false;
+		}
+
+	else if ( blocks.size() != o->blocks.size() )
+		{
+		reporter->Error("different number of blocks in SplitBlockBloomFilter merge");
+		return false;
+		}
+
+	for ( size_t i = 0; i < blocks.size(); ++i )
+		for ( int j = 0; j < 8; ++j )
+			blocks[i].words[j] |= o->blocks[i].words[j];
+
+	return true;
+	}
+
+SplitBlockBloomFilter* SplitBlockBloomFilter::Clone() const
+	{
+	SplitBlockBloomFilter* copy = new SplitBlockBloomFilter();
+
+	copy->hasher = hasher->Clone();
+	copy->blocks = blocks;
+
+	return copy;
+	}
+
+std::string SplitBlockBloomFilter::InternalState() const
+	{
+	u_char buf[SHA256_DIGEST_LENGTH];
+	uint64_t digest;
+	EVP_MD_CTX* ctx = zeek::detail::hash_init(zeek::detail::Hash_SHA256);
+
+	for ( const auto& b : blocks )
+		zeek::detail::hash_update(ctx, b.words, sizeof(b.words));
+
+	zeek::detail::hash_final(ctx, buf);
+	memcpy(&digest, buf, sizeof(digest));
+	return util::fmt("%" PRIu64, digest);
+	}
+
+broker::expected<broker::data> SplitBlockBloomFilter::DoSerialize() const
+	{
+	broker::vector v = {static_cast<uint64_t>(blocks.size())};
+	v.reserve(1 + 8 * blocks.size());
+
+	for ( const auto& b : blocks )
+		for ( auto w : b.words )
+			v.emplace_back(static_cast<uint64_t>(w));
+
+	return {std::move(v)};
+	}
+
+bool SplitBlockBloomFilter::DoUnserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+
+	if ( ! (v && v->size() >= 1) )
+		return false;
+
+	auto num_blocks = caf::get_if<uint64_t>(&(*v)[0]);
+
+	// Check the count against the vector's size before multiplying, so
+	// that a bogus one can't wrap around.
+	if ( ! (num_blocks && *num_blocks > 0 && *num_blocks <= (v->size() - 1) / 8 &&
+	        v->size() == 1 + 8 * *num_blocks) )
+		return false;
+
+	blocks.resize(*num_blocks);
+
+	for ( size_t i = 0; i < *num_blocks; ++i )
+		for ( int j = 0; j < 8; ++j )
+			{
+			auto x = caf::get_if<uint64_t>(&(*v)[1 + 8 * i + j]);
+
+			if ( ! x )
+				return false;
+
+			blocks[i].words[j] = *x;
+			}
+
+	return true;
+	}
+
 } // namespace zeek::probabilistic
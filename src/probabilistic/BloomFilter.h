@@ -20,7 +20,7 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(CounterVector, zeek, probabilistic, detail);
 namespace zeek::probabilistic {
 
 /** Types of derived BloomFilter classes. */
-enum BloomFilterType { Basic, Counting };
+enum BloomFilterType { Basic, Counting, SplitBlock };
 
 /**
  * The abstract base class for Bloom filters.
@@ -230,6 +230,78 @@ private:
 	detail::CounterVector* cells;
 };
 
+/**
+ * A split-block Bloom filter. Each element maps to a single 64-byte block,
+ * i.e., one cache line, in which it sets one bit in each of the block's
+ * eight 64-bit words. The block and the bits all derive from a single
+ * 64-bit hash of the element.
+ */
+class SplitBlockBloomFilter : public BloomFilter {
+public:
+	/**
+	 * Constructs a split-block Bloom filter.
+	 *
+	 * @param hasher The hasher providing the seed. Its number of hash
+	 * functions needs to be 8.
+	 *
+	 * @param blocks The number of 64-byte blocks. The ideal number can
+	 * be computed with *Blocks*.
+	 */
+	SplitBlockBloomFilter(const detail::Hasher* hasher, size_t blocks);
+
+	/**
+	 * Destructor.
+	 */
+	~SplitBlockBloomFilter() override;
+
+	/**
+	 * Computes the number of blocks needed for a given false positive
+	 * rate and capacity.
+	 *
+	 * @param fp The false positive rate.
+	 *
+	 * @param capacity The expected number of elements that will be
+	 * stored.
+	 *
+	 * Returns: The number of blocks needed to support a false positive
+	 * rate of *fp* with at most *capacity* elements.
+	 */
+	static size_t Blocks(double fp, size_t capacity);
+
+	// Overridden from BloomFilter.
+	bool Empty() const override;
+	void Clear() override;
+	bool Merge(const BloomFilter* other) override;
+	SplitBlockBloomFilter* Clone() const override;
+	std::string InternalState() const override;
+
+protected:
+	friend class BloomFilter;
+
+	/**
+	 * Default constructor.
+	 */
+	SplitBlockBloomFilter();
+
+	// Overridden from BloomFilter.
+	void Add(const zeek::detail::HashKey* key) override;
+	size_t Count(const zeek::detail::HashKey* key) const override;
+	broker::expected<broker::data> DoSerialize() const override;
+	bool DoUnserialize(const broker::data& data) override;
+	BloomFilterType Type() const override
+		{ return BloomFilterType::SplitBlock; }
+
+private:
+	struct alignas(64) Block {
+		uint64_t words[8];
+	};
+
+	Block& BlockFor(uint64_t digest);
+	const Block& BlockFor(uint64_t digest) const;
+
+	std::vector<Block> blocks;
+};
+
 } // namespace zeek::probabilistic
 
 namespace probabilistic {
@@ -4,14 +4,86 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <algorithm>
 #include <utility>
 
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
 #include <broker/data.hh>
 
 #include "Reporter.h"
 
 namespace zeek::probabilistic::detail {
 
+// Sets each of dst's buckets to the maximum of it and src's, 32 or 16 at a
+// time where the CPU supports it. Returns the number of buckets that are
+// still 0 afterwards.
+static uint64_t merge_buckets(uint8_t* dst, const uint8_t* src, uint64_t n)
+	{
+	uint64_t zeros = 0;
+	uint64_t i = 0;
+
+	// The zero buckets get counted by summing up a 1 for each of them
+	// per 64-bit lane.
+
+#if defined(__AVX2__)
+	const __m256i zero32 = _mm256_setzero_si256();
+	const __m256i one32 = _mm256_set1_epi8(1);
+	__m256i zeros32 = _mm256_setzero_si256();
+
+	for ( ; i + 32 <= n; i += 32 )
+		{
+		auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+		auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		auto r = _mm256_max_epu8(a, b);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+
+		auto z = _mm256_and_si256(_mm256_cmpeq_epi8(r, zero32), one32);
+		zeros32 = _mm256_add_epi64(zeros32, _mm256_sad_epu8(z, zero32));
+		}
+
+	uint64_t lanes32[4];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes32), zeros32);
+	zeros += lanes32[0] + lanes32[1] + lanes32[2] + lanes32[3];
+#endif
+
+#if defined(__SSE2__)
+	const __m128i zero16 = _mm_setzero_si128();
+	const __m128i one16 = _mm_set1_epi8(1);
+	__m128i zeros16 = _mm_setzero_si128();
+
+	for ( ; i + 16 <= n; i += 16 )
+		{
+		auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+		auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		auto r = _mm_max_epu8(a, b);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+
+		auto z = _mm_and_si128(_mm_cmpeq_epi8(r, zero16), one16);
+		zeros16 = _mm_add_epi64(zeros16, _mm_sad_epu8(z, zero16));
+		}
+
+	uint64_t lanes16[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes16), zeros16);
+	zeros += lanes16[0] + lanes16[1];
+#endif
+
+	for ( ; i < n; ++i )
+		{
+		if ( src[i] > dst[i] )
+			dst[i] = src[i];
+
+		if ( dst[i] == 0 )
+			++zeros;
+		}
+
+	return zeros;
+	}
+
 int CardinalityCounter::OptimalB(double error, double confidence) const
 	{
 	double initial_estimate = 2 * (log(1.04) - log(error)) / log(2);
@@ -58,17 +130,37 @@ void CardinalityCounter::Init(uint64_t size)
 
 	p = calc_p;
 
-	buckets.reserve(m);
-	for ( uint64_t i = 0; i < m; i++ )
-		buckets.push_back(0);
-
-	assert(buckets.size() == m);
+	if ( SparseLimit() == 0 )
+		buckets.assign(m, 0);
 
 	V = m;
 	}
 
+uint64_t CardinalityCounter::SparseLimit() const
+	{
+	// Sparse entries have 24 bits for the index. For few buckets, the
+	// dense representation is small enough anyway.
+	if ( p < 8 || p > 24 )
+		return 0;
+
+	// Each entry takes four bytes, so stop at a quarter of the dense
+	// size. The cap bounds the cost of inserting into the sorted list.
+	return std::min(m / 16, static_cast<uint64_t>(1024));
+	}
+
+void CardinalityCounter::ToDense()
+	{
+	buckets.assign(m, 0);
+
+	for ( auto e : sparse )
+		buckets[e >> 8] = e & 0xff;
+
+	sparse.clear();
+	sparse.shrink_to_fit();
+	}
+
 CardinalityCounter::CardinalityCounter(CardinalityCounter& other)
-	: buckets(other.buckets)
+	: buckets(other.buckets), sparse(other.sparse)
 	{
 	V = other.V;
 	alpha_m = other.alpha_m;
@@ -85,6 +177,7 @@ CardinalityCounter::CardinalityCounter(CardinalityCounter&& o) noexcept
 
 	o.m = 0;
 	buckets = std::move(o.buckets);
+	sparse = std::move(o.sparse);
 	}
 
 CardinalityCounter::CardinalityCounter(double error_margin, double confidence)
@@ -103,11 +196,7 @@ CardinalityCounter::CardinalityCounter(uint64_t size)
 CardinalityCounter::CardinalityCounter(uint64_t arg_size, uint64_t arg_V, double arg_alpha_m)
 	{
 	m = arg_size;
-
-	buckets.reserve(m);
-	for ( uint64_t i = 0; i < m; i++ )
-		buckets.push_back(0);
-
+	buckets.assign(m, 0);
 	alpha_m = arg_alpha_m;
 	V = arg_V;
 	p = log2(m);
@@ -131,13 +220,124 @@ void CardinalityCounter::AddElement(uint64_t hash)
 	uint64_t index = hash % m;
 	hash = hash-index;
 
-	if( buckets[index] == 0 )
-		V--;
-
 	uint8_t temp = Rank(hash);
 
-	if ( temp > buckets[index] )
-		buckets[index] = temp;
+	if ( ! buckets.empty() )
+		{
+		if( buckets[index] == 0 )
+			V--;
+
+		if ( temp > buckets[index] )
+			buckets[index] = temp;
+
+		return;
+		}
+
+	auto key = static_cast<uint32_t>(index << 8);
+	auto i = std::lower_bound(sparse.begin(), sparse.end(), key);
+
+	if ( i != sparse.end() && (*i >> 8) == index )
+		{
+		// With the index being the same, this compares the values.
+		if ( (key | temp) > *i )
+			*i = key | temp;
+
+		return;
+		}
+
+	sparse.insert(i, key | temp);
+	V--;
+
+	if ( sparse.size() > SparseLimit() )
+		ToDense();
+	}
+
+void CardinalityCounter::Histogram(uint64_t* counts) const
+	{
+	std::fill(counts, counts + num_ranks, 0);
+
+	if ( buckets.empty() )
+		{
+		counts[0] = m - sparse.size();
+
+		for ( auto e : sparse )
+			++counts[e & 0xff];
+
+		return;
+		}
+
+	// Most buckets hold one of a few values. Spreading the counting
+	// over several tables avoids stalling on the same counter.
+	uint64_t partial[3][num_ranks] = {};
+	uint64_t i = 0;
+
+	for ( ; i + 4 <= m; i += 4 )
+		{
+		++counts[buckets[i]];
+		++partial[0][buckets[i + 1]];
+		++partial[1][buckets[i + 2]];
+		++partial[2][buckets[i + 3]];
+		}
+
+	for ( ; i < m; ++i )
+		++counts[buckets[i]];
+
+	for ( int k = 0; k < num_ranks; ++k )
+		counts[k] += partial[0][k] + partial[1][k] + partial[2][k];
+	}
+
+static double ertl_sigma(double x)
+	{
+	if ( x == 1.0 )
+		return INFINITY;
+
+	double y = 1.0;
+	double z = x;
+	double z_old;
+
+	do {
+		x *= x;
+		z_old = z;
+		z += x * y;
+		y += y;
+	} while ( z != z_old );
+
+	return z;
+	}
+
+static double ertl_tau(double x)
+	{
+	if ( x == 0.0 || x == 1.0 )
+		return 0.0;
+
+	double y = 1.0;
+	double z = 1.0 - x;
+	double z_old;
+
+	do {
+		x = sqrt(x);
+		z_old = z;
+		y *= 0.5;
+		z -= (1.0 - x) * (1.0 - x) * y;
+	} while ( z != z_old );
+
+	return z / 3.0;
+	}
+
+double CardinalityCounter::ImprovedEstimate(const uint64_t* counts) const
+	{
+	// q is the number of hash bits that go into the rank, which ranges
+	// from 1 to q + 1.
+	int q = 64 - p;
+	double dm = m;
+	double z = dm * ertl_tau(1.0 - counts[q + 1] / dm);
+
+	for ( int k = q; k >= 1; --k )
+		z = 0.5 * (z + counts[k]);
+
+	z += dm * ertl_sigma(counts[0] / dm);
+
+	return dm * dm / (2.0 * log(2.0) * z);
 	}
 
 /**
@@ -151,16 +351,27 @@ void CardinalityCounter::AddElement(uint64_t hash)
  **/
 double CardinalityCounter::Size() const
 	{
+	uint64_t counts[num_ranks];
+	Histogram(counts);
+
 	double answer = 0;
-	for ( unsigned int i = 0; i < m; i++ )
-		answer += pow(2, -((int)buckets[i]));
+	for ( int k = 0; k < num_ranks; k++ )
+		answer += ldexp(counts[k], -k);
 
 	answer = 1 / answer;
 	answer = (alpha_m * m * m * answer);
 
-	if ( answer <= 5.0 * (m/2) )
+	if ( answer <= 5.0 * (m/2) && V > 0 )
 		return m * log(((double)m) / V);
 
+	// This is the range in which HLL++ corrects the raw estimate for
+	// its bias, which requires empirically determined tables of the bias
+	// for each number of buckets. The improved estimator doesn't need
+	// them. It also covers the case of no bucket being 0, where linear
+	// counting doesn't work.
+	else if ( answer <= 5.0 * m )
+		return ImprovedEstimate(counts);
+
 	else if ( answer <= (pow(2, 64) / 30) )
 		return answer;
 
@@ -173,19 +384,56 @@ bool CardinalityCounter::Merge(CardinalityCounter* c)
 	if ( m != c->GetM() )
 		return false;
 
-	const std::vector<uint8_t>& temp = c->GetBuckets();
+	if ( ! c->buckets.empty() )
+		{
+		if ( buckets.empty() )
+			ToDense();
 
-	V = 0;
+		V = merge_buckets(buckets.data(), c->buckets.data(), m);
+		return true;
+		}
 
-	for ( size_t i = 0; i < m; i++ )
+	if ( ! buckets.empty() )
 		{
-		if ( temp[i] > buckets[i] )
-			buckets[i] = temp[i];
+		for ( auto e : c->sparse )
+			{
+			auto& b = buckets[e >> 8];
 
-		if ( buckets[i] == 0 )
-			++V;
+			if ( b == 0 )
+				--V;
+
+			b = std::max(b, static_cast<uint8_t>(e & 0xff));
+			}
+
+		return true;
+		}
+
+	// Both are sparse. As the entries are sorted by index, merging the
+	// lists keeps them sorted.
+	std::vector<uint32_t> merged;
+	merged.reserve(sparse.size() + c->sparse.size());
+
+	auto i = sparse.begin();
+	auto j = c->sparse.begin();
+
+	while ( i != sparse.end() || j != c->sparse.end() )
+		{
+		if ( j == c->sparse.end() || (i != sparse.end() && (*i >> 8) < (*j >> 8)) )
+			merged.push_back(*i++);
+
+		else if ( i == sparse.end() || (*j >> 8) < (*i >> 8) )
+			merged.push_back(*j++);
+
+		else
+			merged.push_back(std::max(*i++, *j++));
 		}
 
+	sparse = std::move(merged);
+	V = m - sparse.size();
+
+	if ( sparse.size() > SparseLimit() )
+		ToDense();
+
 	return true;
 	}
 
@@ -204,8 +452,27 @@ broker::expected<broker::data> CardinalityCounter::Serialize() const
 	broker::vector v = {m, V, alpha_m};
 	v.reserve(3 + m);
 
+	if ( ! buckets.empty() )
+		{
+		for ( size_t i = 0; i < m; ++i )
+			v.emplace_back(static_cast<uint64_t>(buckets[i]));
+
+		return {std::move(v)};
+		}
+
+	// Sparse counters use the dense format as well, so that peers
+	// running older versions still understand them.
+	auto e = sparse.begin();
+
 	for ( size_t i = 0; i < m; ++i )
-		v.emplace_back(static_cast<uint64_t>(buckets[i]));
+		{
+		uint64_t b = 0;
+
+		if ( e != sparse.end() && (*e >> 8) == i )
+			b = *e++ & 0xff;
+
+		v.emplace_back(b);
+		}
 
 	return {std::move(v)};
 	}
@@ -225,6 +492,12 @@ std::unique_ptr<CardinalityCounter> CardinalityCounter::Unserialize(const broker
 	if ( v->size() != 3 + *m )
 		return nullptr;
 
+	// The number of buckets determines how many hash bits go into the
+	// rank, which the estimate relies on. Init() only ever creates
+	// powers of two from 16 on.
+	if ( *m < 16 || (*m & (*m - 1)) != 0 )
+		return nullptr;
+
 	auto cc = std::unique_ptr<CardinalityCounter>(new CardinalityCounter(*m, *V, *alpha_m));
 	if ( *m != cc->m )
 		return nullptr;
@@ -237,9 +510,32 @@ std::unique_ptr<CardinalityCounter> CardinalityCounter::Unserialize(const broker
 		if ( ! x )
 			return nullptr;
 
+		// Rank() returns at most this. Larger values would index past
+		// the histogram that Size() builds.
+		if ( *x > static_cast<uint64_t>(64 - cc->p + 1) )
+			return nullptr;
+
 		cc->buckets[i] = *x;
 		}
 
+	// Counters received from elsewhere mostly hold few elements. Those go
+	// back to the sparse representation.
+	if ( cc->m - cc->V <= cc->SparseLimit() )
+		{
+		for ( size_t i = 0; i < *m; ++i )
+			if ( cc->buckets[i] )
+				cc->sparse.push_back(static_cast<uint32_t>(i << 8) | cc->buckets[i]);
+
+		if ( cc->sparse.size() <= cc->SparseLimit() )
+			{
+			cc->V = cc->m - cc->sparse.size();
+			cc->buckets.clear();
+			cc->buckets.shrink_to_fit();
+			}
+		else
+			cc->sparse.clear();
+		}
+
 	return cc;
 	}
 
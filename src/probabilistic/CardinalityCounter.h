@@ -15,6 +15,11 @@ namespace zeek::probabilistic::detail {
 
 /**
  * A probabilistic cardinality counter using the HyperLogLog algorithm.
+ *
+ * As long as only few buckets are set, the counter keeps just those, in a
+ * sorted list, and switches to the full array of buckets once the list
+ * grows past a limit. This keeps counters that only ever see a handful of
+ * elements small.
  */
 class CardinalityCounter {
 public:
@@ -104,7 +109,8 @@ protected:
 	 * Returns the buckets array that holds all of the rough cardinality
 	 * estimates.
 	 *
-	 * Use GetM() to determine the size.
+	 * Use GetM() to determine the size. The array is empty while the
+	 * counter uses its sparse representation.
 	 *
 	 * @return Array containing cardinality estimates
 	 */
@@ -124,6 +130,34 @@ private:
 	 */
 	void Init(uint64_t arg_size);
 
+	/**
+	 * Returns the number of set buckets up to which the counter uses its
+	 * sparse representation, or 0 if it always uses the dense one.
+	 */
+	uint64_t SparseLimit() const;
+
+	/**
+	 * Switches from the sparse representation to the dense one.
+	 */
+	void ToDense();
+
+	/**
+	 * Counts how many buckets hold each value.
+	 *
+	 * @param counts array of num_ranks elements receiving the counts
+	 */
+	void Histogram(uint64_t* counts) const;
+
+	/**
+	 * Estimates the cardinality with Ertl's improved estimator ("New
+	 * cardinality estimation algorithms for HyperLogLog sketches", 2017),
+	 * which, unlike the raw estimate, isn't biased for cardinalities
+	 * of a few times the number of buckets.
+	 *
+	 * @param counts the histogram of bucket values, see Histogram()
+	 */
+	double ImprovedEstimate(const uint64_t* counts) const;
+
 	/**
 	 * This function calculates the smallest value of b that will
 	 * satisfy these the constraints of a specified error margin and
@@ -175,6 +209,19 @@ private:
 	 */
 	std::vector<uint8_t> buckets;
 
+	/**
+	 * The set buckets, sorted by index, while the counter uses its sparse
+	 * representation, in which case buckets is empty. Each entry holds
+	 * the bucket's index in its upper 24 bits and its value in the lower
+	 * 8 bits.
+	 */
+	std::vector<uint32_t> sparse;
+
+	/**
+	 * Bucket values are always below this.
+	 */
+	static constexpr int num_ranks = 66;
+
 	/**
 	 * There are some state constants that need to be kept track of to
 	 * make the final estimate easier. V is the number of values in
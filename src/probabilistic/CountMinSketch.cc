@@ -0,0 +1,229 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "CountMinSketch.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+#include <broker/data.hh>
+#include <broker/error.hh>
+
+#include "Hasher.h"
+
+namespace zeek::probabilistic::detail {
+
+static constexpr CountMinSketch::count_type max_count =
+	std::numeric_limits<CountMinSketch::count_type>::max();
+
+CountMinSketch::CountMinSketch(const Hasher* arg_hasher, size_t arg_width)
+	: hasher(arg_hasher), width(arg_width)
+	{
+	assert(hasher->K() > 0 && hasher->K() <= MaxDepth);
+	assert(width > 0 && width * hasher->K() <= MaxCells);
+	counters.resize(width * hasher->K());
+	}
+
+CountMinSketch::CountMinSketch(const CountMinSketch& other)
+	: hasher(other.hasher->Clone()), width(other.width), counters(other.counters)
+	{
+	}
+
+CountMinSketch::~CountMinSketch()
+	{
+	delete hasher;
+	}
+
+size_t CountMinSketch::Width(double epsilon)
+	{
+	return static_cast<size_t>(std::ceil(M_E / epsilon));
+	}
+
+size_t CountMinSketch::Depth(double delta)
+	{
+	return std::max(static_cast<size_t>(std::ceil(std::log(1 / delta))), size_t(1));
+	}
+
+size_t CountMinSketch::Depth() const
+	{
+	return hasher->K();
+	}
+
+void CountMinSketch::Cells(const zeek::detail::HashKey* key, uint32_t* cells) const
+	{
+	auto digests = hasher->Hash(key);
+
+	// The upper half of each row's hash selects the counter, mapping it
+	// onto the row without a division.
+	for ( size_t i = 0; i < digests.size(); ++i )
+		cells[i] = i * width + (((digests[i] >> 32) * width) >> 32);
+	}
+
+CountMinSketch::count_type CountMinSketch::Min(const uint32_t* cells) const
+	{
+	size_t depth = Depth();
+
+#if defined(__AVX2__)
+	// Gather eight rows at a time. Rows past the depth are masked off and
+	// keep the maximum value, so they don't affect the minimum.
+	const auto base = reinterpret_cast<const int*>(counters.data());
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i min = _mm256_set1_epi32(-1);
+
+	for ( size_t i = 0; i < depth; i += 8 )
+		{
+		__m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(depth - i), lanes);
+		__m256i idx = _mm256_maskload_epi32(reinterpret_cast<const int*>(cells + i), mask);
+		__m256i c = _mm256_mask_i32gather_epi32(_mm256_set1_epi32(-1), base, idx, mask, 4);
+		min = _mm256_min_epu32(min, c);
+		}
+
+	__m128i m = _mm_min_epu32(_mm256_castsi256_si128(min), _mm256_extracti128_si256(min, 1));
+	m = _mm_min_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+	m = _mm_min_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return static_cast<count_type>(_mm_cvtsi128_si32(m));
+#else
+	count_type min = max_count;
+
+	for ( size_t i = 0; i < depth; ++i )
+		min = std::min(min, counters[cells[i]]);
+
+	return min;
+#endif
+	}
+
+void CountMinSketch::Add(const zeek::detail::HashKey* key, uint64_t count)
+	{
+	uint32_t cells[MaxDepth];
+	Cells(key, cells);
+
+	// Conservative update: no counter needs to go beyond the element's
+	// new estimate.
+	uint64_t target = std::min(static_cast<uint64_t>(Min(cells)) + count,
+	                           static_cast<uint64_t>(max_count));
+
+	for ( size_t i = 0; i < Depth(); ++i )
+		{
+		auto& c = counters[cells[i]];
+
+		if ( c < target )
+			c = target;
+		}
+	}
+
+CountMinSketch::count_type CountMinSketch::Estimate(const zeek::detail::HashKey* key) const
+	{
+	uint32_t cells[MaxDepth];
+	Cells(key, cells);
+	return Min(cells);
+	}
+
+bool CountMinSketch::Merge(const CountMinSketch& other)
+	{
+	if ( width != other.width || counters.size() != other.counters.size() ||
+	     ! hasher->Equals(other.hasher) )
+		return false;
+
+	count_type* a = counters.data();
+	const count_type* b = other.counters.data();
+	size_t n = counters.size();
+	size_t i = 0;
+
+	// Saturating addition, as a + min(b, max - a).
+#if defined(__AVX2__)
+	const __m256i ones = _mm256_set1_epi32(-1);
+
+	for ( ; i + 8 <= n; i += 8 )
+		{
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+		__m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+		__m256i room = _mm256_xor_si256(x, ones);
+		x = _mm256_add_epi32(x, _mm256_min_epu32(y, room));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(a + i), x);
+		}
+#endif
+
+	for ( ; i < n; ++i )
+		a[i] += std::min(b[i], static_cast<count_type>(max_count - a[i]));
+
+	return true;
+	}
+
+void CountMinSketch::Clear()
+	{
+	std::fill(counters.begin(), counters.end(), 0);
+	}
+
+bool CountMinSketch::Empty() const
+	{
+	return std::all_of(counters.begin(), counters.end(),
+	                   [](count_type c) { return c == 0; });
+	}
+
+broker::expected<broker::data> CountMinSketch::Serialize() const
+	{
+	auto h = hasher->Serialize();
+	if ( ! h )
+		return broker::ec::invalid_data;
+
+	broker::vector v = {std::move(*h), static_cast<uint64_t>(width)};
+	v.reserve(2 + (counters.size() + 1) / 2);
+
+	// Two counters go into each value.
+	for ( size_t i = 0; i < counters.size(); i += 2 )
+		{
+		uint64_t x = counters[i];
+
+		if ( i + 1 < counters.size() )
+			x |= static_cast<uint64_t>(counters[i + 1]) << 32;
+
+		v.emplace_back(x);
+		}
+
+	return {std::move(v)};
+	}
+
+std::unique_ptr<CountMinSketch> CountMinSketch::Unserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+	if ( ! (v && v->size() >= 2) )
+		return nullptr;
+
+	auto h = Hasher::Unserialize((*v)[0]);
+	auto width = caf::get_if<uint64_t>(&(*v)[1]);
+
+	if ( ! (h && width) )
+		return nullptr;
+
+	if ( h->K() == 0 || h->K() > MaxDepth || *width == 0 ||
+	     *width > MaxCells / h->K() )
+		return nullptr;
+
+	size_t n = *width * h->K();
+
+	if ( v->size() != 2 + (n + 1) / 2 )
+		return nullptr;
+
+	auto cm = std::make_unique<CountMinSketch>(h.release(), *width);
+
+	for ( size_t i = 0; i < n; i += 2 )
+		{
+		auto x = caf::get_if<uint64_t>(&(*v)[2 + i / 2]);
+		if ( ! x )
+			return nullptr;
+
+		cm->counters[i] = static_cast<count_type>(*x);
+
+		if ( i + 1 < n )
+			cm->counters[i + 1] = static_cast<count_type>(*x >> 32);
+		}
+
+	return cm;
+	}
+
+} // namespace zeek::probabilistic::detail
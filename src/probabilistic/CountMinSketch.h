@@ -0,0 +1,153 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek-config.h"
+
+#include <broker/expected.hh>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace broker { class data; }
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(HashKey, zeek::detail);
+
+namespace zeek::probabilistic::detail {
+
+class Hasher;
+
+/**
+ * A Count-Min sketch, which estimates how often each element occurred in
+ * a stream, using a fixed amount of memory independent of the number of
+ * distinct elements.
+ *
+ * The sketch is a table of *depth* rows of *width* counters. The hasher
+ * maps an element to one counter per row. An estimate is the smallest of
+ * the element's counters, which never falls below the element's true
+ * count. Adding uses conservative update: it raises each of the element's
+ * counters only as far as needed to exceed the old estimate, which keeps
+ * the overestimate of other elements sharing those counters low.
+ *
+ * The counters of all rows live in one array. With AVX2, an element's
+ * counters across rows are read with a single gather.
+ */
+class CountMinSketch {
+public:
+	typedef uint32_t count_type;
+
+	/**
+	 * The largest number of rows a sketch may have.
+	 */
+	static constexpr size_t MaxDepth = 32;
+
+	/**
+	 * The largest number of counters a sketch may have.
+	 */
+	static constexpr size_t MaxCells = size_t(1) << 30;
+
+	/**
+	 * Constructs a sketch.
+	 *
+	 * @param hasher The hasher to map elements to counters. The sketch
+	 * gets one row per hash function, and takes ownership of the hasher.
+	 *
+	 * @param width The number of counters per row.
+	 *
+	 * @pre `hasher->K() <= MaxDepth && width * hasher->K() <= MaxCells`
+	 */
+	CountMinSketch(const Hasher* hasher, size_t width);
+
+	/**
+	 * Copy-constructs a sketch.
+	 */
+	CountMinSketch(const CountMinSketch& other);
+
+	~CountMinSketch();
+
+	/**
+	 * Computes the number of counters per row so that estimates exceed
+	 * the true count by at most *epsilon* times the total count of all
+	 * elements, with probability *1 - delta*.
+	 *
+	 * @param epsilon The error bound, relative to the total count.
+	 *
+	 * @return The width for the sketch.
+	 */
+	static size_t Width(double epsilon);
+
+	/**
+	 * Computes the number of rows so that the error bound of Width()
+	 * holds with probability *1 - delta*.
+	 *
+	 * @param delta The probability of exceeding the error bound.
+	 *
+	 * @return The depth for the sketch.
+	 */
+	static size_t Depth(double delta);
+
+	/**
+	 * Adds occurrences of an element. Counters saturate at their maximum
+	 * value.
+	 *
+	 * @param key The element's key.
+	 *
+	 * @param count The number of occurrences to add.
+	 */
+	void Add(const zeek::detail::HashKey* key, uint64_t count = 1);
+
+	/**
+	 * Estimates how often an element occurred.
+	 *
+	 * @param key The element's key.
+	 *
+	 * @return The estimated count, which is at least the true count.
+	 */
+	count_type Estimate(const zeek::detail::HashKey* key) const;
+
+	/**
+	 * Merges another sketch into this one by adding their counters. Both
+	 * need to have the same dimensions and hasher.
+	 *
+	 * @param other The sketch to merge.
+	 *
+	 * @return False if the sketches don't match.
+	 */
+	bool Merge(const CountMinSketch& other);
+
+	/**
+	 * Resets all counters to 0.
+	 */
+	void Clear();
+
+	/**
+	 * @return true if no element was added.
+	 */
+	bool Empty() const;
+
+	size_t Width() const	{ return width; }
+	size_t Depth() const;
+
+	broker::expected<broker::data> Serialize() const;
+	static std::unique_ptr<CountMinSketch> Unserialize(const broker::data& data);
+
+private:
+	CountMinSketch& operator=(const CountMinSketch&); // Disable.
+
+	/**
+	 * Computes the indices of an element's counters, one per row.
+	 */
+	void Cells(const zeek::detail::HashKey* key, uint32_t* cells) const;
+
+	/**
+	 * Returns the smallest of the counters at the given indices.
+	 */
+	count_type Min(const uint32_t* cells) const;
+
+	const Hasher* hasher;
+	size_t width;
+	std::vector<count_type> counters;	// Row after row.
+};
+
+} // namespace zeek::probabilistic::detail
@@ -0,0 +1,276 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "TDigest.h"
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+#include <broker/data.hh>
+
+namespace zeek::probabilistic::detail {
+
+TDigest::TDigest(double arg_compression)
+	{
+	if ( ValidCompression(arg_compression) )
+		compression = arg_compression;
+	else
+		compression = arg_compression > max_compression ? max_compression : 100;
+
+	// Larger buffers mean fewer merges of the centroids, but also more
+	// values to sort per merge. A few times the number of centroids
+	// works well.
+	buffer_size = std::max(static_cast<size_t>(5 * compression), size_t(50));
+	buffer.reserve(buffer_size);
+
+	min = std::numeric_limits<double>::infinity();
+	max = -std::numeric_limits<double>::infinity();
+	}
+
+bool TDigest::Add(double x, double w)
+	{
+	if ( ! isfinite(x) || ! (w > 0) || ! isfinite(w) )
+		return false;
+
+	if ( buffer.size() >= buffer_size )
+		Compress();
+
+	buffer.push_back({x, w});
+	buffer_weight += w;
+	min = std::min(min, x);
+	max = std::max(max, x);
+	return true;
+	}
+
+void TDigest::Merge(const TDigest& other)
+	{
+	other.Compress();
+
+	// Copy first, as other may be this digest.
+	auto merged = other.centroids;
+
+	for ( const auto& c : merged )
+		{
+		if ( buffer.size() >= buffer_size )
+			Compress();
+
+		buffer.push_back(c);
+		buffer_weight += c.weight;
+		}
+
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+	}
+
+double TDigest::QuantileLimit(double q) const
+	{
+	// The k1 scale function, k(q) = compression / (2 pi) * asin(2q - 1),
+	// which limits each centroid to a span of 1 in k. Its slope grows
+	// towards q = 0 and q = 1, which keeps centroids small there.
+	double k = compression / (2 * M_PI) * asin(2 * q - 1) + 1;
+
+	if ( k >= compression / 4 )
+		return 1;
+
+	return (sin(k * 2 * M_PI / compression) + 1) / 2;
+	}
+
+void TDigest::Compress() const
+	{
+	if ( buffer.empty() )
+		return;
+
+	auto by_mean = [](const Centroid& a, const Centroid& b)
+		{ return a.mean < b.mean; };
+
+	// The centroids are sorted already, so it's enough to sort the buffer
+	// and merge the two.
+	std::sort(buffer.begin(), buffer.end(), by_mean);
+	size_t n = centroids.size();
+	centroids.insert(centroids.end(), buffer.begin(), buffer.end());
+	std::inplace_merge(centroids.begin(), centroids.begin() + n,
+	                   centroids.end(), by_mean);
+
+	centroid_weight += buffer_weight;
+	buffer.clear();
+	buffer_weight = 0;
+
+	// Sweep from left to right, folding each centroid into the previous
+	// one as long as the result stays within the size limit for its
+	// position.
+	double total = centroid_weight;
+	double weight_so_far = 0;
+	double weight_limit = total * QuantileLimit(0);
+	size_t out = 0;
+
+	for ( size_t i = 1; i < centroids.size(); ++i )
+		{
+		Centroid& cur = centroids[out];
+		const Centroid& next = centroids[i];
+
+		if ( weight_so_far + cur.weight + next.weight <= weight_limit )
+			{
+			cur.weight += next.weight;
+			cur.mean += (next.mean - cur.mean) * next.weight / cur.weight;
+
+			// Don't let rounding move the mean past the next one,
+			// so that it stays within the digest's min and max.
+			cur.mean = std::min(cur.mean, next.mean);
+			continue;
+			}
+
+		weight_so_far += cur.weight;
+		weight_limit = total * QuantileLimit(weight_so_far / total);
+		centroids[++out] = next;
+		}
+
+	centroids.resize(out + 1);
+	}
+
+// Returns the average of two values, weighted by the other's distance.
+static double interpolate(double x1, double w1, double x2, double w2)
+	{
+	double x = (x1 * w1 + x2 * w2) / (w1 + w2);
+	return std::max(std::min(x1, x2), std::min(x, std::max(x1, x2)));
+	}
+
+double TDigest::Quantile(double q) const
+	{
+	Compress();
+
+	if ( centroids.empty() )
+		return 0;
+
+	size_t n = centroids.size();
+
+	if ( n == 1 )
+		return centroids[0].mean;
+
+	// This follows the reference implementation: the values a centroid
+	// stands for are spread evenly around its mean, except that
+	// singletons are exact, and the extreme values are known exactly.
+	double total = centroid_weight;
+	double index = std::max(0.0, std::min(q, 1.0)) * total;
+
+	if ( index < 1 )
+		return min;
+
+	const Centroid& first = centroids[0];
+
+	if ( first.weight > 1 && index < first.weight / 2 )
+		return min + (index - 1) / (first.weight / 2 - 1) * (first.mean - min);
+
+	if ( index > total - 1 )
+		return max;
+
+	const Centroid& last = centroids[n - 1];
+
+	if ( last.weight > 1 && total - index <= last.weight / 2 )
+		return max - (total - index - 1) / (last.weight / 2 - 1) * (max - last.mean);
+
+	double weight_so_far = first.weight / 2;
+
+	for ( size_t i = 0; i < n - 1; ++i )
+		{
+		const Centroid& left = centroids[i];
+		const Centroid& right = centroids[i + 1];
+		double dw = (left.weight + right.weight) / 2;
+
+		if ( weight_so_far + dw > index )
+			{
+			double left_unit = 0;
+			double right_unit = 0;
+
+			if ( left.weight == 1 )
+				{
+				if ( index - weight_so_far < 0.5 )
+					return left.mean;
+
+				left_unit = 0.5;
+				}
+
+			if ( right.weight == 1 )
+				{
+				if ( weight_so_far + dw - index <= 0.5 )
+					return right.mean;
+
+				right_unit = 0.5;
+				}
+
+			double z1 = index - weight_so_far - left_unit;
+			double z2 = weight_so_far + dw - index - right_unit;
+			return interpolate(left.mean, z2, right.mean, z1);
+			}
+
+		weight_so_far += dw;
+		}
+
+	return last.mean;
+	}
+
+broker::expected<broker::data> TDigest::Serialize() const
+	{
+	Compress();
+
+	broker::vector v = {compression, min, max};
+	v.reserve(3 + 2 * centroids.size());
+
+	for ( const auto& c : centroids )
+		{
+		v.emplace_back(c.mean);
+		v.emplace_back(c.weight);
+		}
+
+	return {std::move(v)};
+	}
+
+std::unique_ptr<TDigest> TDigest::Unserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+	if ( ! (v && v->size() >= 3 && v->size() % 2 == 1) )
+		return nullptr;
+
+	auto compression = caf::get_if<double>(&(*v)[0]);
+	auto min = caf::get_if<double>(&(*v)[1]);
+	auto max = caf::get_if<double>(&(*v)[2]);
+
+	if ( ! (compression && min && max && ValidCompression(*compression)) )
+		return nullptr;
+
+	auto d = std::make_unique<TDigest>(*compression);
+
+	if ( v->size() == 3 )
+		return d;
+
+	if ( ! (isfinite(*min) && isfinite(*max)) )
+		return nullptr;
+
+	d->min = *min;
+	d->max = *max;
+	d->centroids.reserve((v->size() - 3) / 2);
+
+	for ( size_t i = 3; i < v->size(); i += 2 )
+		{
+		auto mean = caf::get_if<double>(&(*v)[i]);
+		auto weight = caf::get_if<double>(&(*v)[i + 1]);
+
+		if ( ! (mean && weight && isfinite(*mean) && isfinite(*weight) && *weight > 0) )
+			return nullptr;
+
+		if ( ! d->centroids.empty() && *mean < d->centroids.back().mean )
+			return nullptr;
+
+		d->centroids.push_back({*mean, *weight});
+		d->centroid_weight += *weight;
+		}
+
+	// The means are sorted, so the extremes must enclose the first and
+	// last of them.
+	if ( ! (isfinite(d->centroid_weight) && d->min <= d->centroids.front().mean &&
+	        d->max >= d->centroids.back().mean) )
+		return nullptr;
+
+	return d;
+	}
+
+} // namespace zeek::probabilistic::detail
@@ -0,0 +1,128 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <broker/expected.hh>
+
+#include <memory>
+#include <vector>
+
+namespace broker { class data; }
+
+namespace zeek::probabilistic::detail {
+
+/**
+ * A quantile sketch using the merging t-digest of Dunning and Ertl.
+ *
+ * The digest summarizes a distribution of values as a sorted list of
+ * centroids, each a mean and the weight of the values it stands for.
+ * Centroids near the tails of the distribution stay small, so that
+ * extreme quantiles remain accurate, while those near the median grow
+ * large. The number of centroids is bounded by the compression parameter,
+ * independent of the number of values added. Digests merge by combining
+ * their centroids.
+ *
+ * New values first go into a buffer, which gets merged into the centroids
+ * once it fills up, or when the digest is queried.
+ */
+class TDigest {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param compression bounds the number of centroids, trading size
+	 * for accuracy. A digest keeps roughly between compression/2 and
+	 * compression centroids. 100 gives quantiles to within about 1% of
+	 * their rank near the median, and much closer towards the tails.
+	 * Callers should check it with ValidCompression(); an invalid one
+	 * gets replaced with the nearest valid one, or the default.
+	 */
+	explicit TDigest(double compression = 100);
+
+	/**
+	 * The largest compression a digest accepts. The buffer and centroids
+	 * grow with it, and the accuracy it buys beyond this is negligible.
+	 */
+	static constexpr double max_compression = 1e5;
+
+	/**
+	 * Checks a compression for the constructor.
+	 *
+	 * @return true if it's positive and at most max_compression.
+	 */
+	static bool ValidCompression(double c)
+		{ return c > 0 && c <= max_compression; }
+
+	/**
+	 * Adds a value.
+	 *
+	 * @param x the value.
+	 *
+	 * @param w the weight of the value, i.e., how many times it occurred.
+	 *
+	 * @return false if the value or weight isn't valid, i.e., if the value
+	 * isn't a finite number or the weight isn't positive.
+	 */
+	bool Add(double x, double w = 1);
+
+	/**
+	 * Merges another digest into this one. The result keeps this digest's
+	 * compression.
+	 *
+	 * @param other the digest to merge.
+	 */
+	void Merge(const TDigest& other);
+
+	/**
+	 * Estimates a quantile of the values added.
+	 *
+	 * @param q the quantile, between 0 and 1.
+	 *
+	 * @return the estimated value at quantile *q*, or 0 if the digest is
+	 * empty.
+	 */
+	double Quantile(double q) const;
+
+	/**
+	 * @return the total weight of the values added.
+	 */
+	double Count() const	{ return centroid_weight + buffer_weight; }
+
+	/**
+	 * @return the compression given to the constructor.
+	 */
+	double Compression() const	{ return compression; }
+
+	broker::expected<broker::data> Serialize() const;
+	static std::unique_ptr<TDigest> Unserialize(const broker::data& data);
+
+private:
+	struct Centroid {
+		double mean;
+		double weight;
+	};
+
+	/**
+	 * Merges the buffered values into the centroids. This doesn't change
+	 * what the digest represents, and thus works on a const digest.
+	 */
+	void Compress() const;
+
+	/**
+	 * Returns the largest quantile that a centroid starting at quantile
+	 * *q* may extend to, according to the digest's scale function.
+	 */
+	double QuantileLimit(double q) const;
+
+	double compression;
+	size_t buffer_size;
+	double min;
+	double max;
+
+	mutable std::vector<Centroid> centroids;	// Sorted by mean.
+	mutable std::vector<Centroid> buffer;
+	mutable double centroid_weight = 0;
+	mutable double buffer_weight = 0;
+};
+
+} // namespace zeek::probabilistic::detail
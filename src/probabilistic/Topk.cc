@@ -2,20 +2,17 @@
 
 #include "probabilistic/Topk.h"
 
+#include <cstring>
+
 #include <broker/error.hh>
 
 #include "broker/Data.h"
 #include "CompHash.h"
 #include "Reporter.h"
-#include "Dict.h"
 
 namespace zeek::probabilistic::detail {
 
-static void topk_element_hash_delete_func(void* val)
-	{
-	Element* e = (Element*) val;
-	delete e;
-	}
+static constexpr size_t initial_slots = 16;
 
 void TopkVal::Typify(TypePtr t)
 	{
@@ -26,46 +23,232 @@ void TopkVal::Typify(TypePtr t)
 	hash = new zeek::detail::CompositeHash(std::move(tl));
 	}
 
-zeek::detail::HashKey* TopkVal::GetHash(Val* v) const
+std::unique_ptr<zeek::detail::HashKey> TopkVal::GetHash(Val* v) const
 	{
 	auto key = hash->MakeHashKey(*v, true);
 	assert(key);
-	return key.release();
+	return key;
 	}
 
-TopkVal::TopkVal(uint64_t arg_size) : OpaqueVal(topk_type)
+TopkVal::TopkVal(uint64_t arg_size) : TopkVal()
 	{
-	elementDict = new PDict<Element>;
-	elementDict->SetDeleteFunc(topk_element_hash_delete_func);
 	size = arg_size;
-	numElements = 0;
-	pruned = false;
-	hash = nullptr;
 	}
 
 TopkVal::TopkVal() : OpaqueVal(topk_type)
 	{
-	elementDict = new PDict<Element>;
-	elementDict->SetDeleteFunc(topk_element_hash_delete_func);
+	slots.assign(initial_slots, nil);
+	min_bucket = max_bucket = nil;
+	free_buckets = free_elements = nil;
 	size = 0;
 	numElements = 0;
+	pruned = false;
 	hash = nullptr;
 	}
 
 TopkVal::~TopkVal()
 	{
-	elementDict->Clear();
-	delete elementDict;
+	delete hash;
+	}
 
-	// now all elements are already gone - delete the buckets
-	std::list<Bucket*>::iterator bi = buckets.begin();
-	while ( bi != buckets.end() )
+uint32_t TopkVal::Lookup(zeek::detail::hash_t h, const void* key, size_t key_size) const
+	{
+	size_t mask = slots.size() - 1;
+
+	for ( size_t i = h & mask; ; i = (i + 1) & mask )
 		{
-		delete *bi;
-		bi++;
+		uint32_t e = slots[i];
+
+		if ( e == nil )
+			return nil;
+
+		const Element& el = elements[e];
+
+		if ( el.hash == h && el.key.size() == key_size &&
+		     memcmp(el.key.data(), key, key_size) == 0 )
+			return e;
 		}
+	}
 
-	delete hash;
+void TopkVal::IndexInsert(uint32_t e)
+	{
+	if ( (numElements + 1) * 2 > slots.size() )
+		{
+		// Keep the table at most half full, so that probe sequences
+		// stay short.
+		std::vector<uint32_t> old(slots.size() * 2, nil);
+		slots.swap(old);
+
+		size_t mask = slots.size() - 1;
+
+		for ( auto o : old )
+			{
+			if ( o == nil )
+				continue;
+
+			size_t i = elements[o].hash & mask;
+
+			while ( slots[i] != nil )
+				i = (i + 1) & mask;
+
+			slots[i] = o;
+			}
+		}
+
+	size_t mask = slots.size() - 1;
+	size_t i = elements[e].hash & mask;
+
+	while ( slots[i] != nil )
+		i = (i + 1) & mask;
+
+	slots[i] = e;
+	}
+
+void TopkVal::IndexRemove(uint32_t e)
+	{
+	size_t mask = slots.size() - 1;
+	size_t i = elements[e].hash & mask;
+
+	while ( slots[i] != e )
+		{
+		assert(slots[i] != nil);
+		i = (i + 1) & mask;
+		}
+
+	// Shift following entries back into the hole as long as that doesn't
+	// move them in front of their home slot, so that lookups never need
+	// to skip over deleted entries.
+	for ( size_t j = (i + 1) & mask; slots[j] != nil; j = (j + 1) & mask )
+		{
+		size_t home = elements[slots[j]].hash & mask;
+
+		if ( ((j - home) & mask) >= ((j - i) & mask) )
+			{
+			slots[i] = slots[j];
+			i = j;
+			}
+		}
+
+	slots[i] = nil;
+	}
+
+uint32_t TopkVal::NewElement(ValPtr value, zeek::detail::hash_t h,
+                             const void* key, size_t key_size)
+	{
+	uint32_t e = free_elements;
+
+	if ( e != nil )
+		free_elements = elements[e].next;
+	else
+		{
+		e = elements.size();
+		elements.emplace_back();
+		}
+
+	Element& el = elements[e];
+	el.epsilon = 0;
+	el.value = std::move(value);
+	el.hash = h;
+	el.key.assign(static_cast<const char*>(key), key_size);
+	el.bucket = nil;
+	el.prev = el.next = nil;
+	return e;
+	}
+
+void TopkVal::FreeElement(uint32_t e)
+	{
+	Element& el = elements[e];
+	el.value = nullptr;
+	el.key.clear();
+	el.next = free_elements;
+	free_elements = e;
+	}
+
+uint32_t TopkVal::NewBucket(uint64_t count, uint32_t after)
+	{
+	uint32_t b = free_buckets;
+
+	if ( b != nil )
+		free_buckets = buckets[b].next;
+	else
+		{
+		b = buckets.size();
+		buckets.emplace_back();
+		}
+
+	Bucket& bu = buckets[b];
+	bu.count = count;
+	bu.num_elements = 0;
+	bu.head = bu.tail = nil;
+	bu.prev = after;
+	bu.next = after == nil ? min_bucket : buckets[after].next;
+
+	if ( bu.prev == nil )
+		min_bucket = b;
+	else
+		buckets[bu.prev].next = b;
+
+	if ( bu.next == nil )
+		max_bucket = b;
+	else
+		buckets[bu.next].prev = b;
+
+	return b;
+	}
+
+void TopkVal::FreeBucket(uint32_t b)
+	{
+	Bucket& bu = buckets[b];
+	assert(bu.num_elements == 0);
+
+	if ( bu.prev == nil )
+		min_bucket = bu.next;
+	else
+		buckets[bu.prev].next = bu.next;
+
+	if ( bu.next == nil )
+		max_bucket = bu.prev;
+	else
+		buckets[bu.next].prev = bu.prev;
+
+	bu.next = free_buckets;
+	free_buckets = b;
+	}
+
+void TopkVal::Append(uint32_t e, uint32_t b)
+	{
+	Element& el = elements[e];
+	Bucket& bu = buckets[b];
+
+	el.bucket = b;
+	el.prev = bu.tail;
+	el.next = nil;
+
+	if ( bu.tail == nil )
+		bu.head = e;
+	else
+		elements[bu.tail].next = e;
+
+	bu.tail = e;
+	++bu.num_elements;
+	}
+
+void TopkVal::Unlink(uint32_t e)
+	{
+	Element& el = elements[e];
+	Bucket& bu = buckets[el.bucket];
+
+	if ( el.prev == nil )
+		bu.head = el.next;
+	else
+		elements[el.prev].next = el.next;
+
+	if ( el.next == nil )
+		bu.tail = el.prev;
+	else
+		elements[el.next].prev = el.prev;
+
+	--bu.num_elements;
 	}
 
 void TopkVal::Merge(const TopkVal* value, bool doPrune)
@@ -92,54 +275,40 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 			}
 		}
 
-	std::list<Bucket*>::const_iterator it = value->buckets.begin();
-	while ( it != value->buckets.end() )
+	for ( uint32_t b = value->min_bucket; b != nil; b = value->buckets[b].next )
 		{
-		Bucket* b = *it;
-		uint64_t currcount = b->count;
-		std::list<Element*>::const_iterator eit = b->elements.begin();
+		uint64_t currcount = value->buckets[b].count;
 
-		while ( eit != b->elements.end() )
+		for ( uint32_t e = value->buckets[b].head; e != nil; e = value->elements[e].next )
 			{
-			Element* e = *eit;
-			// lookup if we already know this one...
-			zeek::detail::HashKey* key = GetHash(e->value);
-			Element* olde = (Element*) elementDict->Lookup(key);
+			const Element& other = value->elements[e];
+
+			// Both sides hash the same type, so we can look up
+			// the other side's key bytes directly.
+			uint32_t olde = Lookup(other.hash, other.key.data(), other.key.size());
 
-			if ( olde == nullptr )
+			if ( olde == nil )
 				{
-				olde = new Element();
-				olde->epsilon = 0;
-				olde->value = e->value;
+				olde = NewElement(other.value, other.hash,
+				                  other.key.data(), other.key.size());
+
 				// insert at bucket position 0
-				if ( buckets.size() > 0 )
+				if ( min_bucket != nil )
 					{
-					assert (buckets.front()-> count > 0 );
+					assert(buckets[min_bucket].count > 0);
 					}
 
-				Bucket* newbucket = new Bucket();
-				newbucket->count = 0;
-				newbucket->bucketPos = buckets.insert(buckets.begin(), newbucket);
-
-				olde->parent = newbucket;
-				newbucket->elements.insert(newbucket->elements.end(), olde);
-
-				elementDict->Insert(key, olde);
+				Append(olde, NewBucket(0, nil));
+				IndexInsert(olde);
 				numElements++;
-
 				}
 
 			// now that we are sure that the old element is present - increment epsilon
-			olde->epsilon += e->epsilon;
+			elements[olde].epsilon += other.epsilon;
 
 			// and increment position...
 			IncrementCounter(olde, currcount);
-			delete key;
-
-			eit++;
 			}
-
-		it++;
 		}
 
 	// now we have added everything. And our top-k table could be too big.
@@ -153,23 +322,17 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 	while ( numElements > size )
 		{
 		pruned = true;
-		assert(buckets.size() > 0 );
-		Bucket* b = buckets.front();
-		assert(b->elements.size() > 0);
+		assert(min_bucket != nil);
+		uint32_t b = min_bucket;
+		uint32_t e = buckets[b].head;
+		assert(e != nil);
 
-		Element* e = b->elements.front();
-		zeek::detail::HashKey* key = GetHash(e->value);
-		elementDict->RemoveEntry(key);
-		delete key;
-		delete e;
+		IndexRemove(e);
+		Unlink(e);
+		FreeElement(e);
 
-		b->elements.pop_front();
-
-		if ( b->elements.size() == 0 )
-			{
-			delete b;
-			buckets.pop_front();
-			}
+		if ( buckets[b].num_elements == 0 )
+			FreeBucket(b);
 
 		numElements--;
 		}
@@ -197,24 +360,14 @@ VectorValPtr TopkVal::GetTopK(int k) const // returns vector
 	// in any case - just to make this future-proof (and I am lazy) - this can return more than k.
 
 	int read = 0;
-	std::list<Bucket*>::const_iterator it = buckets.end();
-	it--;
-	while (read < k )
+
+	for ( uint32_t b = max_bucket; b != nil && read < k; b = buckets[b].prev )
 		{
-		//printf("Bucket %llu\n", (*it)->count);
-		std::list<Element*>::iterator eit = (*it)->elements.begin();
-		while ( eit != (*it)->elements.end() )
+		for ( uint32_t e = buckets[b].head; e != nil; e = elements[e].next )
 			{
-			//printf("Size: %ld\n", (*it)->elements.size());
-			t->Assign(read, (*eit)->value);
+			t->Assign(read, elements[e].value);
 			read++;
-			eit++;
 			}
-
-		if ( it == buckets.begin() )
-			break;
-
-		it--;
 		}
 
 	return t;
@@ -222,45 +375,36 @@ VectorValPtr TopkVal::GetTopK(int k) const // returns vector
 
 uint64_t TopkVal::GetCount(Val* value) const
 	{
-	zeek::detail::HashKey* key = GetHash(value);
-	Element* e = (Element*) elementDict->Lookup(key);
-	delete key;
+	uint32_t e = hash ? Lookup(*GetHash(value)) : nil;
 
-	if ( e == nullptr )
+	if ( e == nil )
 		{
 		reporter->Error("GetCount for element that is not in top-k");
 		return 0;
 		}
 
-	return e->parent->count;
+	return buckets[elements[e].bucket].count;
 	}
 
 uint64_t TopkVal::GetEpsilon(Val* value) const
 	{
-	zeek::detail::HashKey* key = GetHash(value);
-	Element* e = (Element*) elementDict->Lookup(key);
-	delete key;
+	uint32_t e = hash ? Lookup(*GetHash(value)) : nil;
 
-	if ( e == nullptr )
+	if ( e == nil )
 		{
 		reporter->Error("GetEpsilon for element that is not in top-k");
 		return 0;
 		}
 
-	return e->epsilon;
+	return elements[e].epsilon;
 	}
 
 uint64_t TopkVal::GetSum() const
 	{
 	uint64_t sum = 0;
 
-	std::list<Bucket*>::const_iterator it = buckets.begin();
-	while ( it != buckets.end() )
-		{
-		sum += (*it)->elements.size() * (*it)->count;
-
-		it++;
-		}
+	for ( uint32_t b = min_bucket; b != nil; b = buckets[b].next )
+		sum += buckets[b].num_elements * buckets[b].count;
 
 	if ( pruned )
 		reporter->Warning("TopkVal::GetSum() was used on a pruned data structure. Result values do not represent total element count");
@@ -282,39 +426,26 @@ void TopkVal::Encountered(ValPtr encountered)
 			}
 
 	// Step 1 - get the hash.
-	zeek::detail::HashKey* key = GetHash(encountered);
-	Element* e = (Element*) elementDict->Lookup(key);
+	auto key = GetHash(encountered);
+	uint32_t e = Lookup(*key);
 
-	if ( e == nullptr )
+	if ( e == nil )
 		{
-		e = new Element();
-		e->epsilon = 0;
-		e->value = std::move(encountered);
-
 		// well, we do not know this one yet...
 		if ( numElements < size )
 			{
+			e = NewElement(std::move(encountered), key->Hash(), key->Key(), key->Size());
+
 			// brilliant. just add it at position 1
-			if ( buckets.size() == 0 || (*buckets.begin())->count > 1 )
-				{
-				Bucket* b = new Bucket();
-				b->count = 1;
-				std::list<Bucket*>::iterator pos = buckets.insert(buckets.begin(), b);
-				b->bucketPos = pos;
-				b->elements.insert(b->elements.end(), e);
-				e->parent = b;
-				}
-			else
-				{
-				Bucket* b = *buckets.begin();
-				assert(b->count == 1);
-				b->elements.insert(b->elements.end(), e);
-				e->parent = b;
-				}
+			uint32_t b = min_bucket;
+
+			if ( b == nil || buckets[b].count > 1 )
+				b = NewBucket(1, nil);
 
-			elementDict->Insert(key, e);
+			assert(buckets[b].count == 1);
+			Append(e, b);
+			IndexInsert(e);
 			numElements++;
-			delete key;
 
 			return; // done. it is at pos 1.
 			}
@@ -322,22 +453,24 @@ void TopkVal::Encountered(ValPtr encountered)
 		else
 			{
 			// replace element with min-value
-			Bucket* b = *buckets.begin(); // bucket with smallest elements
+			uint32_t b = min_bucket; // bucket with smallest elements
+
+			// evict oldest element with least hits, and reuse its
+			// slot for the new one.
+			e = buckets[b].head;
+			assert(e != nil); // there has to have been a minimal element...
+			IndexRemove(e);
+			Unlink(e);
 
-			// evict oldest element with least hits.
-			assert(b->elements.size() > 0);
-			zeek::detail::HashKey* deleteKey = GetHash((*(b->elements.begin()))->value);
-			b->elements.erase(b->elements.begin());
-			Element* deleteElement = (Element*) elementDict->RemoveEntry(deleteKey);
-			assert(deleteElement); // there has to have been a minimal element...
-			delete deleteElement;
-			delete deleteKey;
+			Element& el = elements[e];
+			el.value = std::move(encountered);
+			el.hash = key->Hash();
+			el.key.assign(static_cast<const char*>(key->Key()), key->Size());
 
 			// and add the new one to the end
-			e->epsilon = b->count;
-			b->elements.insert(b->elements.end(), e);
-			elementDict->Insert(key, e);
-			e->parent = b;
+			el.epsilon = buckets[b].count;
+			Append(e, b);
+			IndexInsert(e);
 
 			// fallthrough, increment operation has to run!
 			}
@@ -345,56 +478,53 @@ void TopkVal::Encountered(ValPtr encountered)
 		}
 
 	// ok, we now have an element in e
-	delete key;
 	IncrementCounter(e); // well, this certainly was anticlimatic.
 	}
 
 // increment by count
-void TopkVal::IncrementCounter(Element* e, unsigned int count)
+void TopkVal::IncrementCounter(uint32_t e, uint64_t count)
 	{
-	Bucket* currBucket = e->parent;
-	uint64_t currcount = currBucket->count;
+	uint32_t currBucket = elements[e].bucket;
+	uint64_t newcount = buckets[currBucket].count + count;
 
-	// well, let's test if there is a bucket for currcount++
-	std::list<Bucket*>::iterator bucketIter = currBucket->bucketPos;
+	// well, let's test if there is a bucket for currcount+count
+	uint32_t prev = currBucket;
+	uint32_t next = buckets[currBucket].next;
 
-	Bucket* nextBucket = nullptr;
-
-	bucketIter++;
+	while ( next != nil && buckets[next].count < newcount )
+		{
+		prev = next;
+		next = buckets[next].next;
+		}
 
-	while ( bucketIter != buckets.end() && (*bucketIter)->count < currcount+count )
-		bucketIter++;
+	if ( next != nil && buckets[next].count == newcount )
+		{
+		// ok, the bucket exists. Shift the element over...
+		Unlink(e);
+		Append(e, next);
+		}
 
-	if ( bucketIter != buckets.end() && (*bucketIter)->count == currcount+count )
-		nextBucket = *bucketIter;
+	else if ( prev == currBucket && buckets[currBucket].num_elements == 1 )
+		{
+		// The element is alone in its bucket, and the bucket would
+		// go right where the one for the new count needs to be.
+		// Just raise its count.
+		buckets[currBucket].count = newcount;
+		return;
+		}
 
-	if ( nextBucket == nullptr )
+	else
 		{
 		// the bucket for the value that we want does not exist.
 		// create it...
-
-		Bucket* b = new Bucket();
-		b->count = currcount+count;
-
-		std::list<Bucket*>::iterator nextBucketPos = buckets.insert(bucketIter, b);
-		b->bucketPos = nextBucketPos; // and give it the iterator we know now.
-
-		nextBucket = b;
+		uint32_t b = NewBucket(newcount, prev);
+		Unlink(e);
+		Append(e, b);
 		}
 
-	// ok, now we have the new bucket in nextBucket. Shift the element over...
-	currBucket->elements.remove(e);
-	nextBucket->elements.insert(nextBucket->elements.end(), e);
-
-	e->parent = nextBucket;
-
-	// if currBucket is empty, we have to delete it now
-	if ( currBucket->elements.size() == 0 )
-		{
-		buckets.remove(currBucket);
-		delete currBucket;
-		currBucket = nullptr;
-		}
+	// if currBucket is empty, we have to free it now
+	if ( buckets[currBucket].num_elements == 0 )
+		FreeBucket(currBucket);
 	}
 
 IMPLEMENT_OPAQUE_VALUE(TopkVal)
@@ -415,31 +545,22 @@ broker::expected<broker::data> TopkVal::DoSerialize() const
 		d.emplace_back(broker::none());
 
 	uint64_t i = 0;
-	std::list<Bucket*>::const_iterator it = buckets.begin();
-	while ( it != buckets.end() )
-		{
-		Bucket* b = *it;
-		uint32_t elements_count = b->elements.size();
 
-		d.emplace_back(static_cast<uint64_t>(b->elements.size()));
-		d.emplace_back(b->count);
+	for ( uint32_t b = min_bucket; b != nil; b = buckets[b].next )
+		{
+		d.emplace_back(static_cast<uint64_t>(buckets[b].num_elements));
+		d.emplace_back(buckets[b].count);
 
-		std::list<Element*>::const_iterator eit = b->elements.begin();
-		while ( eit != b->elements.end() )
+		for ( uint32_t e = buckets[b].head; e != nil; e = elements[e].next )
 			{
-			Element* element = *eit;
-			d.emplace_back(element->epsilon);
-			auto v = Broker::detail::val_to_data(element->value.get());
+			d.emplace_back(elements[e].epsilon);
+			auto v = Broker::detail::val_to_data(elements[e].value.get());
 			if ( ! v )
 				return broker::ec::invalid_data;
 
-			d.emplace_back(*v);
-
-			eit++;
+			d.emplace_back(std::move(*v));
 			i++;
 			}
-
-		it++;
 		}
 
 	assert(i == numElements);
@@ -462,7 +583,6 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 		return false;
 
 	size = *size_;
-	numElements = *numElements_;
 	pruned = *pruned_;
 
 	auto no_type = caf::get_if<broker::none>(&(*v)[3]);
@@ -476,20 +596,26 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 		Typify(t);
 		}
 
-	uint64_t i = 0;
+	if ( *numElements_ > 0 && ! type )
+		return false;
+
 	uint64_t idx = 4;
 
-	while ( i < numElements )
+	while ( numElements < *numElements_ )
 		{
+		if ( idx + 2 > v->size() )
+			return false;
+
 		auto elements_count = caf::get_if<uint64_t>(&(*v)[idx++]);
 		auto count = caf::get_if<uint64_t>(&(*v)[idx++]);
 
 		if ( ! (elements_count && count) )
 			return false;
 
-		Bucket* b = new Bucket();
-		b->count = *count;
-		b->bucketPos = buckets.insert(buckets.end(), b);
+		if ( ! *elements_count || *elements_count > (v->size() - idx) / 2 )
+			return false;
+
+		uint32_t b = NewBucket(*count, max_bucket);
 
 		for ( uint64_t j = 0; j < *elements_count; j++ )
 			{
@@ -499,25 +625,20 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 			if ( ! (epsilon && val) )
 				return false;
 
-			Element* e = new Element();
-			e->epsilon = *epsilon;
-			e->value = std::move(val);
-			e->parent = b;
-
-			b->elements.insert(b->elements.end(), e);
-
-			zeek::detail::HashKey* key = GetHash(e->value);
-			assert (elementDict->Lookup(key) == nullptr);
+			auto key = GetHash(val);
 
-			elementDict->Insert(key, e);
-			delete key;
+			if ( Lookup(*key) != nil )
+				return false;
 
-			i++;
+			uint32_t e = NewElement(std::move(val), key->Hash(), key->Key(), key->Size());
+			elements[e].epsilon = *epsilon;
+			Append(e, b);
+			IndexInsert(e);
+			numElements++;
 			}
 		}
 
-	assert(i == numElements);
-	return true;
+	return numElements == *numElements_;
 	}
 
 } // namespace zeek::probabilistic::detail
@@ -2,33 +2,40 @@
 
 #pragma once
 
-#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "Val.h"
 #include "OpaqueVal.h"
+#include "Hash.h"
 
 // This class implements the top-k algorithm. Or - to be more precise - an
-// interpretation of it.
+// interpretation of it: the Space-Saving algorithm on top of a
+// Stream-Summary, i.e., a list of buckets of equal counts, each holding a
+// list of elements. Buckets and elements live in flat arrays and link to
+// each other through indices, and elements are found through an
+// open-addressed table, so counting an element doesn't allocate beyond
+// computing its hash key.
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(CompositeHash, zeek::detail);
 
 namespace zeek::probabilistic::detail {
 
-struct Element;
-
 struct Bucket {
 	uint64_t count;
-	std::list<Element*> elements;
-
-	// Iterators only get invalidated for removed elements. This one
-	// points to us - so it is invalid when we are no longer there. Cute,
-	// isn't it?
-	std::list<Bucket*>::iterator bucketPos;
+	uint32_t num_elements;
+	uint32_t head, tail;	// Elements, oldest first.
+	uint32_t prev, next;	// Neighboring buckets, ordered by count.
 };
 
 struct Element {
 	uint64_t epsilon;
 	ValPtr value;
-	Bucket* parent;
+	zeek::detail::hash_t hash;
+	std::string key;	// The bytes of the value's HashKey.
+	uint32_t bucket;
+	uint32_t prev, next;	// Neighbors in the bucket, or free list.
 };
 
 class TopkVal : public OpaqueVal {
@@ -136,14 +143,53 @@ protected:
 	TopkVal();
 
 private:
+	// Marks the end of lists and empty slots.
+	static constexpr uint32_t nil = UINT32_MAX;
+
 	/**
 	 * Increment the counter for a specific element
 	 *
-	 * @param e element to increment counter for
+	 * @param e index of the element to increment counter for
 	 *
 	 * @param count increment counter by this much
 	 */
-	void IncrementCounter(Element* e, unsigned int count = 1);
+	void IncrementCounter(uint32_t e, uint64_t count = 1);
+
+	/**
+	 * Look up an element by the bytes of its HashKey.
+	 *
+	 * @returns the element's index, or nil if it isn't tracked
+	 */
+	uint32_t Lookup(zeek::detail::hash_t h, const void* key, size_t size) const;
+	uint32_t Lookup(const zeek::detail::HashKey& k) const
+		{ return Lookup(k.Hash(), k.Key(), k.Size()); }
+
+	/**
+	 * Add an element to, or remove it from, the lookup table.
+	 */
+	void IndexInsert(uint32_t e);
+	void IndexRemove(uint32_t e);
+
+	/**
+	 * Take an element slot from the free list, or a new one.
+	 */
+	uint32_t NewElement(ValPtr value, zeek::detail::hash_t h,
+	                    const void* key, size_t size);
+	void FreeElement(uint32_t e);
+
+	/**
+	 * Take a bucket from the free list, or a new one, and link it into
+	 * the list of buckets after another one, or at the front if that is
+	 * nil.
+	 */
+	uint32_t NewBucket(uint64_t count, uint32_t after);
+	void FreeBucket(uint32_t b);
+
+	/**
+	 * Append an element to a bucket's elements, or unlink it from them.
+	 */
+	void Append(uint32_t e, uint32_t b);
+	void Unlink(uint32_t e);
 
 	/**
 	 * get the hashkey for a specific value
@@ -152,8 +198,8 @@ private:
 	 *
 	 * @returns HashKey for value
 	 */
-	zeek::detail::HashKey* GetHash(Val* v) const; // this probably should go somewhere else.
-	zeek::detail::HashKey* GetHash(const ValPtr& v) const
+	std::unique_ptr<zeek::detail::HashKey> GetHash(Val* v) const; // this probably should go somewhere else.
+	std::unique_ptr<zeek::detail::HashKey> GetHash(const ValPtr& v) const
 		{ return GetHash(v.get()); }
 
 	/**
@@ -165,8 +211,13 @@ private:
 
 	TypePtr type;
 	zeek::detail::CompositeHash* hash;
-	std::list<Bucket*> buckets;
-	PDict<Element>* elementDict;
+	std::vector<Bucket> buckets;
+	std::vector<Element> elements;
+	std::vector<uint32_t> slots;	// Element indices, by hash.
+	uint32_t min_bucket;	// Bucket with the smallest count.
+	uint32_t max_bucket;
+	uint32_t free_buckets;	// Linked through next.
+	uint32_t free_elements;
 	uint64_t size; // how many elements are we tracking?
 	uint64_t numElements; // how many elements do we have at the moment
 	bool pruned; // was this data structure pruned?
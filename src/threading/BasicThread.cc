@@ -47,6 +47,11 @@ void BasicThread::SetName(const char* arg_name)
 void BasicThread::SetOSName(const char* arg_name)
 	{
 	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value, "libstdc++ doesn't use pthread_t");
+
+	// Without an OS thread of our own, there's nothing to name.
+	if ( ! thread.joinable() )
+		return;
+
 	util::detail::set_thread_name(arg_name, thread.native_handle());
 	}
 
@@ -94,13 +99,18 @@ void BasicThread::Start()
 
 	started = true;
 
-	thread = std::thread(&BasicThread::launcher, this);
+	Launch();
 
 	DBG_LOG(DBG_THREADING, "Started thread %s", name);
 
 	OnStart();
 	}
 
+void BasicThread::Launch()
+	{
+	thread = std::thread(&BasicThread::launcher, this);
+	}
+
 void BasicThread::SignalStop()
 	{
 	if ( ! started )
@@ -131,6 +141,11 @@ void BasicThread::Join()
 	if ( ! started )
 		return;
 
+	OnJoin();
+	}
+
+void BasicThread::OnJoin()
+	{
 	if ( ! thread.joinable() )
 		return;
 
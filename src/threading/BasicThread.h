@@ -147,6 +147,21 @@ protected:
 	 */
 	virtual void OnStart()	{}
 
+	/**
+	 * Executed with Start() to get the thread running. The default
+	 * implementation spawns an OS thread executing Run(). Derived classes
+	 * may override this to have their work executed by other means, such
+	 * as a pool of threads shared among multiple instances; they then need
+	 * to call Done() once finished and override OnJoin() as well.
+	 */
+	virtual void Launch();
+
+	/**
+	 * Executed with Join() to wait for the thread to finish. The default
+	 * implementation joins the OS thread spawned by Launch().
+	 */
+	virtual void OnJoin();
+
 	/**
 	 * Executed with SignalStop(). This is a hook into preparing the
 	 * thread for stopping. It will be called from Bro's main thread
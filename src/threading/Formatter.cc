@@ -4,6 +4,7 @@
 #include "Formatter.h"
 
 #include <errno.h>
+#include <stdarg.h>
 
 #include "MsgThread.h"
 #include "bro_inet_ntop.h"
@@ -22,16 +23,65 @@ Formatter::~Formatter()
 	{
 	}
 
+void Formatter::Warning(const char* fmt, ...) const
+	{
+	// Not using the thread's Fmt(), as its buffer must not be shared
+	// when collecting warnings on behalf of another thread.
+	char buf[512];
+	std::string msg;
+
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if ( n >= static_cast<int>(sizeof(buf)) )
+		{
+		msg.resize(n + 1);
+		va_start(ap, fmt);
+		vsnprintf(&msg[0], n + 1, fmt, ap);
+		va_end(ap);
+		msg.resize(n);
+		}
+	else if ( n > 0 )
+		msg.assign(buf, n);
+
+	if ( warnings )
+		warnings->push_back(std::move(msg));
+	else
+		thread->Warning(msg.c_str());
+	}
+
 std::string Formatter::Render(const threading::Value::addr_t& addr)
 	{
 	if ( addr.family == IPv4 )
 		{
+		// Rendering the octets directly is much faster than
+		// inet_ntop(), with the same result.
+		auto octets = reinterpret_cast<const unsigned char*>(&addr.in.in4);
 		char s[INET_ADDRSTRLEN];
+		char* p = s;
 
-		if ( ! bro_inet_ntop(AF_INET, &addr.in.in4, s, INET_ADDRSTRLEN) )
-			return "<bad IPv4 address conversion>";
-		else
-			return s;
+		for ( int i = 0; i < 4; i++ )
+			{
+			unsigned int o = octets[i];
+
+			if ( i > 0 )
+				*p++ = '.';
+
+			if ( o >= 100 )
+				{
+				*p++ = '0' + o / 100;
+				o %= 100;
+				*p++ = '0' + o / 10;
+				}
+			else if ( o >= 10 )
+				*p++ = '0' + o / 10;
+
+			*p++ = '0' + o % 10;
+			}
+
+		return std::string(s, p - s);
 		}
 	else
 		{
@@ -55,7 +105,7 @@ TransportProto Formatter::ParseProto(const std::string &proto) const
 	else if ( proto == "icmp" )
 		return TRANSPORT_ICMP;
 
-	thread->Warning(thread->Fmt("Tried to parse invalid/unknown protocol: %s", proto.c_str()));
+	Warning("Tried to parse invalid/unknown protocol: %s", proto.c_str());
 
 	return TRANSPORT_UNKNOWN;
 	}
@@ -72,7 +122,7 @@ threading::Value::addr_t Formatter::ParseAddr(const std::string &s) const
 
 		if ( inet_aton(s.c_str(), &(val.in.in4)) <= 0 )
 			{
-			thread->Warning(thread->Fmt("Bad address: %s", s.c_str()));
+			Warning("Bad address: %s", s.c_str());
 			memset(&val.in.in4.s_addr, 0, sizeof(val.in.in4.s_addr));
 			}
 		}
@@ -85,7 +135,7 @@ threading::Value::addr_t Formatter::ParseAddr(const std::string &s) const
 			clean_s = s.substr(1, s.length() - 2);
 		if ( inet_pton(AF_INET6, clean_s.c_str(), val.in.in6.s6_addr) <= 0 )
 			{
-			thread->Warning(thread->Fmt("Bad address: %s", clean_s.c_str()));
+			Warning("Bad address: %s", clean_s.c_str());
 			memset(val.in.in6.s6_addr, 0, sizeof(val.in.in6.s6_addr));
 			}
 		}
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "Type.h"
 #include "SerialTypes.h"
@@ -152,6 +153,17 @@ public:
 	 */
 	Value::addr_t ParseAddr(const std::string &addr) const;
 
+	/**
+	 * Makes the formatter collect the warnings it would otherwise report
+	 * through its thread. This allows to use the formatter from another
+	 * thread, as long as only one uses it at a time; the warnings can
+	 * then be passed on by the formatter's thread later.
+	 *
+	 * @param sink The vector to append warnings to, or null to report
+	 * them through the thread again.
+	 */
+	void CollectWarnings(std::vector<std::string>* sink)	{ warnings = sink; }
+
 protected:
 	/**
 	 * Returns the thread associated with the formatter via the
@@ -159,8 +171,17 @@ protected:
 	 */
 	MsgThread* GetThread() const	{ return thread; }
 
+	/**
+	 * Reports a warning through the formatter's thread, or collects it
+	 * if requested with CollectWarnings().
+	 *
+	 * @param fmt A printf-style format string for the message.
+	 */
+	void Warning(const char* fmt, ...) const __attribute__((format(printf, 2, 3)));
+
 private:
 	MsgThread* thread;
+	std::vector<std::string>* warnings = nullptr;
 };
 
 } // namespace zeek::threading
@@ -3,6 +3,8 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "TaskPool.h"
+
 #include "NetVar.h"
 #include "iosource/Manager.h"
 #include "Event.h"
@@ -63,9 +65,43 @@ void Manager::Terminate()
 
 	all_threads.clear();
 	msg_threads.clear();
+
+	// Nothing can submit tasks to the pools anymore. Destroying them
+	// runs what's still pending and joins their threads.
+	writer_pool.reset();
+
+		{
+		std::lock_guard<std::mutex> lock(shared_pools_mtx);
+		shared_pools.clear();
+		}
+
 	terminating = false;
 	}
 
+detail::TaskPool* Manager::WriterPool()
+	{
+	if ( ! writer_pool && BifConst::Threading::writer_pool_size > 0 )
+		{
+		DBG_LOG(DBG_THREADING, "Creating writer pool with %" PRIu64 " threads ...",
+		        BifConst::Threading::writer_pool_size);
+		writer_pool = std::make_unique<detail::TaskPool>(
+			BifConst::Threading::writer_pool_size, "zk.writers");
+		}
+
+	return writer_pool.get();
+	}
+
+detail::TaskPool* Manager::SharedPool(const std::string& name, size_t num_threads)
+	{
+	std::lock_guard<std::mutex> lock(shared_pools_mtx);
+	auto& pool = shared_pools[name];
+
+	if ( ! pool )
+		pool = std::make_unique<detail::TaskPool>(num_threads, name.c_str());
+
+	return pool.get();
+	}
+
 void Manager::AddThread(BasicThread* thread)
 	{
 	DBG_LOG(DBG_THREADING, "Adding thread %s ...", thread->Name());
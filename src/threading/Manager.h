@@ -5,12 +5,18 @@
 #include "Timer.h"
 
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <utility>
 
 namespace zeek {
 namespace threading {
 namespace detail {
 
+class TaskPool;
+
 class HeartbeatTimer final : public zeek::detail::Timer {
 public:
 	HeartbeatTimer(double t) : zeek::detail::Timer(t, zeek::detail::TIMER_THREAD_HEARTBEAT) {}
@@ -104,6 +110,34 @@ public:
 	 */
 	bool SendEvent(MsgThread* thread, const std::string& name, const int num_vals, Value* *vals) const;
 
+	/**
+	 * Returns the pool of threads shared by all log writers, creating it
+	 * on first use. The pool's size is given by
+	 * Threading::writer_pool_size.
+	 *
+	 * @return The pool, or null if writers are configured to run in
+	 * threads of their own.
+	 */
+	detail::TaskPool* WriterPool();
+
+	/**
+	 * Returns a pool of threads for self-contained tasks, shared by all
+	 * callers passing the same name and created on first use. Terminate()
+	 * shuts the pools down once all other threads have stopped.
+	 *
+	 * Unlike the manager's other methods, this one may be called from any
+	 * thread. Callers must not keep the pool beyond Terminate().
+	 *
+	 * @param name The pool's name, which is also shown by the OS as the
+	 * description of its threads, where supported.
+	 *
+	 * @param num_threads The number of threads to spawn if the pool
+	 * doesn't exist yet; must be > 0.
+	 *
+	 * @return The pool.
+	 */
+	detail::TaskPool* SharedPool(const std::string& name, size_t num_threads);
+
 protected:
 	friend class BasicThread;
 	friend class MsgThread;
@@ -153,6 +187,11 @@ private:
 	msg_stats_list stats;
 
 	bool heartbeat_timer_running = false;
+
+	std::unique_ptr<detail::TaskPool> writer_pool;
+
+	std::mutex shared_pools_mtx;
+	std::map<std::string, std::unique_ptr<detail::TaskPool>> shared_pools;
 };
 
 } // namespace threading
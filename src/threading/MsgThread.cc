@@ -6,12 +6,17 @@
 
 #include "MsgThread.h"
 #include "Manager.h"
+#include "TaskPool.h"
 #include "iosource/Manager.h"
 #include "RunState.h"
 
 // Set by Zeek's main signal handler.
 extern int signal_val;
 
+// Maximum number of messages a thread running on a pool processes before
+// giving other threads their turn.
+static const size_t POOL_SLICE_SIZE = 64;
+
 namespace zeek::threading {
 namespace detail {
 
@@ -207,6 +212,7 @@ MsgThread::MsgThread() : BasicThread(), queue_in(this, nullptr), queue_out(nullp
 	child_finished = false;
 	child_sent_finish = false;
 	failed = false;
+	launched = false;
 	thread_mgr->AddMsgThread(this);
 
 	if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
@@ -222,6 +228,41 @@ MsgThread::~MsgThread()
 	iosource_mgr->UnregisterFd(flare.FD(), this);
 	}
 
+void MsgThread::UsePool(detail::TaskPool* pool)
+	{
+	assert(! launched);
+	pool_queue = std::make_shared<detail::SerialQueue>(pool);
+	}
+
+void MsgThread::Launch()
+	{
+	if ( ! pool_queue )
+		{
+		BasicThread::Launch();
+		return;
+		}
+
+	launched = true;
+
+	// Pick up anything sent before we got started.
+	if ( queue_in.Size() )
+		ScheduleSlice();
+	}
+
+void MsgThread::OnJoin()
+	{
+	if ( ! pool_queue )
+		{
+		BasicThread::OnJoin();
+		return;
+		}
+
+	// Once all our slices have run, we're done as the main thread
+	// won't schedule any further ones.
+	pool_queue->Wait();
+	DBG_LOG(DBG_THREADING, "Joined with pooled thread %s", Name());
+	}
+
 void MsgThread::OnSignalStop()
 	{
 	if ( main_finished || Killed() || child_sent_finish )
@@ -304,6 +345,13 @@ void MsgThread::Heartbeat()
 		return;
 
 	SendIn(new detail::HeartbeatMessage(this, run_state::network_time, util::current_time()));
+
+	// A thread of our own waiting for input wakes up periodically even
+	// if a notification got lost. Give pooled threads the same safety
+	// net: if input is pending but no slice is scheduled or running,
+	// start one.
+	if ( launched && ! pool_queue->Pending() && queue_in.Size() )
+		ScheduleSlice();
 	}
 
 void MsgThread::Finished()
@@ -368,8 +416,13 @@ void MsgThread::SendIn(BasicInputMessage* msg, bool force)
 
 	DBG_LOG(DBG_THREADING, "Sending '%s' to %s ...", msg->Name(), Name());
 
-	queue_in.Put(msg);
+	bool was_empty = queue_in.Put(msg);
 	++cnt_sent_in;
+
+	// A running slice keeps going as long as it finds input, so it's
+	// only if the queue was empty that we need to start a new one.
+	if ( was_empty && launched )
+		ScheduleSlice();
 	}
 
 
@@ -381,11 +434,14 @@ void MsgThread::SendOut(BasicOutputMessage* msg, bool force)
 		return;
 		}
 
-	queue_out.Put(msg);
+	bool was_empty = queue_out.Put(msg);
 
 	++cnt_sent_out;
 
-	flare.Fire();
+	// The main thread drains the queue completely once woken up, so it
+	// only needs a signal if it may have seen the queue empty.
+	if ( was_empty )
+		flare.Fire();
 	}
 
 void MsgThread::SendEvent(const char* name, const int num_vals, Value* *vals)
@@ -419,6 +475,25 @@ BasicInputMessage* MsgThread::RetrieveIn()
 	return msg;
 	}
 
+void MsgThread::ProcessIn(BasicInputMessage* msg)
+	{
+	bool result = msg->Process();
+
+	delete msg;
+
+	if ( ! result )
+		{
+		Error("terminating thread");
+
+		// This will eventually kill this thread, but only
+		// after all other outgoing messages (in particular
+		// error messages have been processed by then main
+		// thread).
+		SendOut(new detail::KillMeMessage(this));
+		failed = true;
+		}
+	}
+
 void MsgThread::Run()
 	{
 	while ( ! (child_finished || Killed() ) )
@@ -428,21 +503,7 @@ void MsgThread::Run()
 		if ( ! msg )
 			continue;
 
-		bool result = msg->Process();
-
-		delete msg;
-
-		if ( ! result )
-			{
-			Error("terminating thread");
-
-			// This will eventually kill this thread, but only
-			// after all other outgoing messages (in particular
-			// error messages have been processed by then main
-			// thread).
-			SendOut(new detail::KillMeMessage(this));
-			failed = true;
-			}
+		ProcessIn(msg);
 		}
 
 	// In case we haven't sent the finish method yet, do it now. Reading
@@ -455,6 +516,52 @@ void MsgThread::Run()
 		}
 	}
 
+void MsgThread::RunSlice()
+	{
+	if ( child_finished || Killed() )
+		return;
+
+	BasicInputMessage* msgs[POOL_SLICE_SIZE];
+	size_t n = queue_in.Get(msgs, POOL_SLICE_SIZE);
+
+	for ( size_t i = 0; i < n; i++ )
+		{
+		if ( child_finished || Killed() )
+			{
+			// Like Run(), we leave the rest unprocessed.
+			delete msgs[i];
+			continue;
+			}
+
+#ifdef DEBUG
+		std::string s = Fmt("Retrieved '%s' in %s",  msgs[i]->Name(), Name());
+		Debug(DBG_THREADING, s.c_str());
+#endif
+
+		ProcessIn(msgs[i]);
+		}
+
+	if ( child_finished || Killed() )
+		{
+		BasicThread::Done();
+		return;
+		}
+
+	// There may be more input, including messages that the main thread
+	// queued while we were processing without scheduling a new slice
+	// because it didn't see the queue empty. Continue in a new slice,
+	// which also gives other threads on the pool their turn.
+	if ( queue_in.Ready() )
+		ScheduleSlice();
+	}
+
+void MsgThread::ScheduleSlice()
+	{
+	// Each slice counts as one unit of cost, so that Pending() tells
+	// whether any slice is scheduled or running.
+	pool_queue->Submit([this]() { RunSlice(); }, 1);
+	}
+
 void MsgThread::GetStats(Stats* stats)
 	{
 	stats->sent_in = cnt_sent_in;
@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <memory>
+
 #include "DebugLogger.h"
 
 #include "BasicThread.h"
@@ -30,6 +32,9 @@ class FinishMessage;
 class FinishedMessage;
 class KillMeMessage;
 
+class TaskPool;
+class SerialQueue;
+
 }
 
 /**
@@ -59,6 +64,22 @@ public:
 	 */
 	virtual ~MsgThread();
 
+	/**
+	 * Lets the thread's work be executed by a pool of OS threads shared
+	 * with other instances, instead of spawning a thread of its own.
+	 * Incoming messages are then processed in slices scheduled on the
+	 * pool whenever new input arrives. Only one slice of an instance runs
+	 * at any time, so messages are still processed in order. As a pool
+	 * thread is blocked while processing a message, doing so must not
+	 * take unduly long.
+	 *
+	 * Only the main thread may call this method, and only before Start().
+	 *
+	 * @param pool The pool to use. It must remain valid until the thread
+	 * has been joined.
+	 */
+	void UsePool(detail::TaskPool* pool);
+
 	/**
 	 * Sends a message to the child thread. The message will be proceesed
 	 * once the thread has retrieved it from its incoming queue.
@@ -275,6 +296,8 @@ protected:
 	 * Overriden from BasicThread.
 	 */
 	void Run() override;
+	void Launch() override;
+	void OnJoin() override;
 	void OnWaitForStop() override;
 	void OnSignalStop() override;
 	void OnKill() override;
@@ -291,6 +314,26 @@ private:
 	 */
 	BasicInputMessage* RetrieveIn();
 
+	/**
+	 * Processes a message sent by the main thread and deletes it.
+	 *
+	 * Must only be called by the child thread.
+	 */
+	void ProcessIn(BasicInputMessage* msg);
+
+	/**
+	 * Processes the messages pending for the child when running on a
+	 * pool, up to a limit.
+	 *
+	 * Must only be called from the pool.
+	 */
+	void RunSlice();
+
+	/**
+	 * Schedules RunSlice() for execution on the pool.
+	 */
+	void ScheduleSlice();
+
 	/**
 	 * Queues a message for the child.
 	 *
@@ -353,6 +396,11 @@ private:
 	bool failed;	// Set to true when a command failed.
 
 	zeek::detail::Flare flare;
+
+	// Runs our slices one at a time when executing on a pool; null
+	// when running in a thread of our own.
+	std::shared_ptr<detail::SerialQueue> pool_queue;
+	bool launched;	// Set to true once started when running on a pool.
 };
 
 /**
@@ -1,9 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
-#include <deque>
 #include <stdint.h>
 #include <sys/time.h>
 
@@ -17,13 +16,19 @@ namespace zeek::threading {
 /**
  * A thread-safe single-reader single-writer queue.
  *
- * The implementation uses multiple queues and reads/writes in rotary fashion
- * in an attempt to limit contention.
+ * The implementation is a lock-free ring buffer made up of fixed-size
+ * segments. When the current segment fills up, the writer chains a new one
+ * (recycling the last one the reader has released where possible), so that
+ * writing never blocks. Each side caches the other side's position and only
+ * reloads it from the shared counters once its cached view is exhausted,
+ * keeping cache-line traffic between the threads to a minimum when data is
+ * exchanged in bursts.
  *
- * All Queue instances must be instantiated by Bro's main thread.
+ * A mutex/condition variable pair is only used for putting an idle reader
+ * to sleep; a writer touches it solely when the reader is actually
+ * waiting.
  *
- * TODO: Unclear how critical performance is for this qeueue. We could likely
- * optimize it further if helpful.
+ * All Queue instances must be instantiated by Bro's main thread.
  */
 template<typename T>
 class Queue
@@ -47,16 +52,39 @@ public:
 	 * Retrieves one element. This may block for a little while of no
 	 * input is available and eventually return with a null element if
 	 * nothing shows up.
+	 *
+	 * Must only be called by the reader.
 	 */
 	T Get();
 
+	/**
+	 * Retrieves up to *max* elements at once without blocking.
+	 *
+	 * Must only be called by the reader.
+	 *
+	 * @param dst Array receiving the elements.
+	 *
+	 * @param max The size of *dst*.
+	 *
+	 * @return The number of elements retrieved.
+	 */
+	size_t Get(T* dst, size_t max);
+
 	/**
 	 * Queues one element.
+	 *
+	 * Must only be called by the writer.
+	 *
+	 * @return True if the queue was empty before, i.e., if the reader
+	 * may need to be notified through some external means that data is
+	 * now available.
 	 */
-	void Put(T data);
+	bool Put(T data);
 
 	/**
 	 * Returns true if the next Get() operation will succeed.
+	 *
+	 * Must only be called by the reader.
 	 */
 	bool Ready();
 
@@ -69,7 +97,11 @@ public:
 	 * it is empty. In other words, this method helps to avoid locking the queue
 	 * frequently, but doesn't allow you to forgo it completely.
 	 */
-	bool MaybeReady() { return (num_reads != num_writes); }
+	bool MaybeReady()
+		{
+		return num_reads.load(std::memory_order_relaxed) !=
+		       num_writes.load(std::memory_order_relaxed);
+		}
 
 	/**
 	 * Wake up the reader if it's currently blocked for input. This is
@@ -100,23 +132,63 @@ public:
 	void GetStats(Stats* stats);
 
 private:
-	static const int NUM_QUEUES = 8;
+	static const size_t SEGMENT_SIZE = 256;
+	static const size_t CACHE_LINE_SIZE = 64;
+
+	struct Segment
+		{
+		T items[SEGMENT_SIZE];
+
+		// Set by the writer before it publishes the first element
+		// stored in the next segment.
+		Segment* next = nullptr;
+		};
+
+	// Blocks until data is available or the wait times out. Returns
+	// true if data is available.
+	bool WaitForData();
+
+	// Reloads the writer's counter; see the definition for the ordering.
+	uint64_t LoadWrites();
 
-	std::vector<std::unique_lock<std::mutex>> LocksForAllQueues();
+	// Removes the next element, which must be available.
+	T Pop();
 
-	std::mutex mutex[NUM_QUEUES];	// Mutex protected shared accesses.
-	std::condition_variable has_data[NUM_QUEUES];	// Signals when data becomes available
-	std::queue<T> messages[NUM_QUEUES];	// Actually holds the queued messages
+	// Stores an element without publishing it yet.
+	void Push(T data);
 
-	int read_ptr;	// Where the next operation will read from
-	int write_ptr;	// Where the next operation will write to
+	// Publishes all elements pushed so far, returning whether the queue
+	// was empty before.
+	bool Publish();
+
+	bool Killed() const
+		{
+		return (reader && reader->Killed()) || (writer && writer->Killed());
+		}
+
+	// Writer-side state.
+	alignas(CACHE_LINE_SIZE) Segment* tail;	// Segment the next write goes to.
+	size_t tail_pos;	// Index of the next write inside tail.
+	uint64_t writes;	// Elements pushed so far.
+	uint64_t published;	// Elements published so far.
+
+	// Reader-side state.
+	alignas(CACHE_LINE_SIZE) Segment* head;	// Segment the next read comes from.
+	size_t head_pos;	// Index of the next read inside head.
+	uint64_t reads;	// Elements retrieved so far.
+	uint64_t cached_writes;	// Last seen value of num_writes.
+
+	// Shared state. The counters double as statistics.
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> num_writes;
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> num_reads;
+	std::atomic<Segment*> spare;	// A released segment for reuse.
+	std::atomic<bool> waiting;	// Whether the reader is about to sleep.
+
+	std::mutex mutex;	// Protects sleeping and waking up only.
+	std::condition_variable has_data;
 
 	BasicThread* reader;
 	BasicThread* writer;
-
-	// Statistics.
-	uint64_t num_reads;
-	uint64_t num_writes;
 };
 
 inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
@@ -135,10 +207,11 @@ inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
 
 template<typename T>
 inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer)
+	: num_writes(0), num_reads(0), spare(nullptr), waiting(false)
 	{
-	read_ptr = 0;
-	write_ptr = 0;
-	num_reads = num_writes = 0;
+	head = tail = new Segment;
+	head_pos = tail_pos = 0;
+	reads = writes = published = cached_writes = 0;
 	reader = arg_reader;
 	writer = arg_writer;
 	}
@@ -146,119 +219,180 @@ inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer)
 template<typename T>
 inline Queue<T>::~Queue()
 	{
+	while ( head )
+		{
+		Segment* next = head->next;
+		delete head;
+		head = next;
+		}
+
+	delete spare.load();
 	}
 
 template<typename T>
-inline T Queue<T>::Get()
+inline bool Queue<T>::WaitForData()
 	{
-	auto lock = acquire_lock(mutex[read_ptr]);
+	if ( Killed() )
+		return false;
+
+	auto lock = acquire_lock(mutex);
 
-	int old_read_ptr = read_ptr;
+	// Announce that we are going to sleep before checking for data a
+	// last time. Together with Publish() storing the counter before
+	// checking the flag (both sequentially consistent) this guarantees
+	// that either we see the new data or the writer sees us waiting.
+	waiting.store(true);
 
-	if ( messages[read_ptr].empty() && ! ((reader && reader->Killed()) || (writer && writer->Killed())) )
+	// The timeout is only a safety net; writers and WakeUp() signal
+	// us explicitly.
+	has_data.wait_for(lock, std::chrono::seconds(5), [this]()
 		{
-		if ( has_data[read_ptr].wait_for(lock, std::chrono::seconds(5)) == std::cv_status::timeout )
-			return nullptr;
-		}
+		cached_writes = num_writes.load();
+		return reads != cached_writes || Killed();
+		});
 
-	if ( messages[read_ptr].empty() )
-		return nullptr;
+	waiting.store(false);
 
-	T data = messages[read_ptr].front();
-	messages[read_ptr].pop();
+	return reads != cached_writes;
+	}
 
-	read_ptr = (read_ptr + 1) % NUM_QUEUES;
-	++num_reads;
+template<typename T>
+inline T Queue<T>::Pop()
+	{
+	if ( head_pos == SEGMENT_SIZE )
+		{
+		Segment* old = head;
+		head = head->next;
+		head_pos = 0;
+		delete spare.exchange(old);
+		}
 
+	T data = head->items[head_pos++];
+	num_reads.store(++reads, std::memory_order_seq_cst);
 	return data;
 	}
 
+// The reader's reloads of num_writes after it ran out of cached data must
+// be sequentially consistent, like the store of num_reads in Pop() and both
+// accesses in Publish(). With weaker ordering, the reader could miss new
+// data while the writer still sees the old num_reads and reports the queue
+// as non-empty, so nobody would notify the reader about the data.
 template<typename T>
-inline void Queue<T>::Put(T data)
+inline uint64_t Queue<T>::LoadWrites()
 	{
-	auto lock = acquire_lock(mutex[write_ptr]);
+	return num_writes.load(std::memory_order_seq_cst);
+	}
+
+template<typename T>
+inline T Queue<T>::Get()
+	{
+	if ( reads == cached_writes )
+		{
+		cached_writes = LoadWrites();
 
-	int old_write_ptr = write_ptr;
+		if ( reads == cached_writes && ! WaitForData() )
+			return nullptr;
+		}
+
+	return Pop();
+	}
 
-	bool need_signal = messages[write_ptr].empty();
+template<typename T>
+inline size_t Queue<T>::Get(T* dst, size_t max)
+	{
+	if ( reads == cached_writes )
+		cached_writes = LoadWrites();
 
-	messages[write_ptr].push(data);
+	size_t n = 0;
 
-	write_ptr = (write_ptr + 1) % NUM_QUEUES;
-	++num_writes;
+	while ( n < max && reads != cached_writes )
+		dst[n++] = Pop();
 
-	if ( need_signal )
-		{
-		lock.unlock();
-		has_data[old_write_ptr].notify_one();
-		}
+	return n;
 	}
 
-
 template<typename T>
-inline bool Queue<T>::Ready()
+inline void Queue<T>::Push(T data)
 	{
-	auto lock = acquire_lock(mutex[read_ptr]);
+	if ( tail_pos == SEGMENT_SIZE )
+		{
+		Segment* s = spare.exchange(nullptr);
 
-	bool ret = (messages[read_ptr].size());
+		if ( s )
+			s->next = nullptr;
+		else
+			s = new Segment;
+
+		tail->next = s;
+		tail = s;
+		tail_pos = 0;
+		}
 
-	return ret;
+	tail->items[tail_pos++] = data;
+	++writes;
 	}
 
 template<typename T>
-inline std::vector<std::unique_lock<std::mutex>> Queue<T>::LocksForAllQueues()
+inline bool Queue<T>::Publish()
 	{
-	std::vector<std::unique_lock<std::mutex>> locks;
+	uint64_t old_published = published;
+	published = writes;
 
-	try
-		{
-		for ( int i = 0; i < NUM_QUEUES; i++ )
-			locks.emplace_back(std::unique_lock<std::mutex>(mutex[i]));
-		}
+	// This store and the following load pair up with the reader's store
+	// in Pop() and its load in LoadWrites(): at least one side sees the
+	// other's update.
+	num_writes.store(published, std::memory_order_seq_cst);
 
-	catch ( const std::system_error& e )
+	bool was_empty = (num_reads.load(std::memory_order_seq_cst) == old_published);
+
+	if ( waiting.load(std::memory_order_seq_cst) )
 		{
-		reporter->FatalErrorWithCore("cannot lock all mutexes: %s", e.what());
-		// Never gets here.
-		throw std::exception();
+		auto lock = acquire_lock(mutex);
+		lock.unlock();
+		has_data.notify_one();
 		}
 
-	return locks;
+	return was_empty;
 	}
 
 template<typename T>
-inline uint64_t Queue<T>::Size()
+inline bool Queue<T>::Put(T data)
 	{
-	// Need to lock all queues.
-	auto locks = LocksForAllQueues();
+	Push(data);
+	return Publish();
+	}
 
-	uint64_t size = 0;
+template<typename T>
+inline bool Queue<T>::Ready()
+	{
+	if ( reads != cached_writes )
+		return true;
 
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		size += messages[i].size();
+	cached_writes = LoadWrites();
+	return reads != cached_writes;
+	}
 
-	return size;
+template<typename T>
+inline uint64_t Queue<T>::Size()
+	{
+	// Load the reads first so that we never underflow.
+	uint64_t r = num_reads.load();
+	uint64_t w = num_writes.load();
+	return w - r;
 	}
 
 template<typename T>
 inline void Queue<T>::GetStats(Stats* stats)
 	{
-	// To be safe, we look all queues. That's probably unneccessary, but
-	// doesn't really hurt.
-	auto locks = LocksForAllQueues();
-
-	stats->num_reads = num_reads;
-	stats->num_writes = num_writes;
+	stats->num_reads = num_reads.load();
+	stats->num_writes = num_writes.load();
 	}
 
 template<typename T>
 inline void Queue<T>::WakeUp()
 	{
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		{
-		auto lock = acquire_lock(mutex[i]);
-		has_data[i].notify_all();
-		}
+	auto lock = acquire_lock(mutex);
+	has_data.notify_all();
 	}
 
 } // namespace zeek::threading
@@ -0,0 +1,147 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "TaskPool.h"
+
+#include <signal.h>
+#include <pthread.h>
+
+#include "util.h"
+
+namespace zeek::threading::detail {
+
+TaskPool::TaskPool(size_t num_threads, const char* arg_name)
+	: name(arg_name)
+	{
+	threads.reserve(num_threads);
+
+	for ( size_t i = 0; i < num_threads; ++i )
+		{
+		threads.emplace_back(&TaskPool::Run, this);
+		util::detail::set_thread_name(util::fmt("%s/%zu", name.c_str(), i),
+		                              threads.back().native_handle());
+		}
+	}
+
+TaskPool::~TaskPool()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mtx);
+		terminating = true;
+		}
+
+	cond.notify_all();
+
+	for ( auto& t : threads )
+		t.join();
+	}
+
+void TaskPool::Submit(Task task)
+	{
+		{
+		std::lock_guard<std::mutex> lock(mtx);
+		tasks.push_back(std::move(task));
+		}
+
+	cond.notify_one();
+	}
+
+void TaskPool::Run()
+	{
+	// Block signals in the pool's threads, like BasicThread does. We
+	// handle signals only in the main thread.
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, 0);
+
+	for ( ;; )
+		{
+		Task task;
+
+			{
+			std::unique_lock<std::mutex> lock(mtx);
+			cond.wait(lock, [this] { return terminating || ! tasks.empty(); });
+
+			// Pending tasks are still executed when terminating.
+			if ( tasks.empty() )
+				return;
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+			}
+
+		task();
+		}
+	}
+
+void SerialQueue::Submit(TaskPool::Task task, size_t cost)
+	{
+	bool schedule = false;
+
+		{
+		std::lock_guard<std::mutex> lock(mtx);
+		tasks.emplace_back(std::move(task), cost);
+		pending += cost;
+
+		if ( ! scheduled )
+			schedule = scheduled = true;
+		}
+
+	if ( schedule )
+		pool->Submit([self = shared_from_this()] { self->Drain(); });
+	}
+
+void SerialQueue::Drain()
+	{
+	for ( ;; )
+		{
+		std::pair<TaskPool::Task, size_t> next;
+
+			{
+			std::lock_guard<std::mutex> lock(mtx);
+
+			if ( tasks.empty() )
+				{
+				scheduled = false;
+				cond.notify_all();
+				return;
+				}
+
+			next = std::move(tasks.front());
+			tasks.pop_front();
+			}
+
+		next.first();
+
+			{
+			std::lock_guard<std::mutex> lock(mtx);
+			pending -= next.second;
+			}
+
+		cond.notify_all();
+		}
+	}
+
+void SerialQueue::Wait()
+	{
+	std::unique_lock<std::mutex> lock(mtx);
+	cond.wait(lock, [this] { return ! scheduled && tasks.empty(); });
+	}
+
+void SerialQueue::WaitBelow(size_t max_cost)
+	{
+	std::unique_lock<std::mutex> lock(mtx);
+	cond.wait(lock, [this, max_cost] { return pending <= max_cost; });
+	}
+
+size_t SerialQueue::Pending()
+	{
+	std::lock_guard<std::mutex> lock(mtx);
+	return pending;
+	}
+
+} // namespace zeek::threading::detail
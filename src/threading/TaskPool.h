@@ -0,0 +1,133 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zeek::threading::detail {
+
+/**
+ * A small, fixed-size pool of OS threads executing self-contained tasks.
+ *
+ * Unlike MsgThread, the pool's threads do not exchange messages with the
+ * main thread and are not tracked by the threading::Manager. Tasks must
+ * therefore not access any of Zeek's global state (Vals, the reporter, the
+ * event manager, ...); they are meant for pure computation or I/O on
+ * buffers handed to them. Results need to be picked up by the main thread
+ * itself.
+ */
+class TaskPool {
+public:
+	using Task = std::function<void()>;
+
+	/**
+	 * Constructor. Spawns the pool's threads right away.
+	 *
+	 * @param num_threads The number of threads to spawn; must be > 0.
+	 *
+	 * @param name A descriptive name that will be shown by the OS as
+	 * the description of the threads, where supported.
+	 */
+	TaskPool(size_t num_threads, const char* name);
+
+	/**
+	 * Destructor. Executes all tasks still pending and then joins the
+	 * threads.
+	 */
+	~TaskPool();
+
+	TaskPool(const TaskPool&) = delete;
+	TaskPool& operator=(const TaskPool&) = delete;
+
+	/**
+	 * Queues a task for execution by the next idle thread. There is no
+	 * ordering guarantee between tasks; use a SerialQueue if that's
+	 * needed.
+	 *
+	 * This method is safe to call from any thread.
+	 */
+	void Submit(Task task);
+
+	/**
+	 * Returns the number of threads in the pool.
+	 */
+	size_t NumThreads() const	{ return threads.size(); }
+
+private:
+	void Run();
+
+	std::mutex mtx;
+	std::condition_variable cond;
+	std::deque<Task> tasks;
+	std::vector<std::thread> threads;
+	std::string name;
+	bool terminating = false;
+};
+
+/**
+ * Runs tasks on a TaskPool strictly in submission order, one at a time.
+ * This allows to move a sequential computation (like incrementally
+ * updating a digest) off the main thread without any locking of its state,
+ * as long as that state is only accessed from inside the tasks and, after
+ * Wait() returned, by the submitter.
+ *
+ * Instances must be managed by a shared_ptr, as tasks keep their queue
+ * alive until they have finished.
+ */
+class SerialQueue : public std::enable_shared_from_this<SerialQueue> {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param pool The pool executing the queue's tasks. It must remain
+	 * valid for the lifetime of the queue.
+	 */
+	explicit SerialQueue(TaskPool* pool) : pool(pool)	{ }
+
+	/**
+	 * Queues a task for execution after all previously submitted ones.
+	 *
+	 * @param task The task.
+	 *
+	 * @param cost A caller-defined cost of the task (e.g., the number of
+	 * bytes it will process) that's accounted in Pending() until the task
+	 * has finished.
+	 */
+	void Submit(TaskPool::Task task, size_t cost = 0);
+
+	/**
+	 * Blocks until all previously submitted tasks have finished.
+	 */
+	void Wait();
+
+	/**
+	 * Blocks until the total cost of unfinished tasks drops to at most
+	 * *max_cost*.
+	 */
+	void WaitBelow(size_t max_cost);
+
+	/**
+	 * Returns the total cost of all tasks not yet finished.
+	 */
+	size_t Pending();
+
+private:
+	void Drain();
+
+	TaskPool* pool;
+	std::mutex mtx;
+	std::condition_variable cond;
+	std::deque<std::pair<TaskPool::Task, size_t>> tasks;
+	size_t pending = 0;
+	bool scheduled = false;
+};
+
+} // namespace zeek::threading::detail
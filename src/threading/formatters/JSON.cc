@@ -38,7 +38,9 @@ JSON::~JSON()
 bool JSON::Describe(ODesc* desc, int num_fields, const Field* const * fields,
                     Value** vals) const
 	{
-	rapidjson::StringBuffer buffer;
+	// Reuse the buffer's memory across records.
+	static thread_local rapidjson::StringBuffer buffer;
+	buffer.Clear();
 	NullDoubleWriter writer(buffer);
 
 	writer.StartObject();
@@ -131,14 +133,22 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 			{
 			if ( timestamps == TS_ISO8601 )
 				{
-				char buffer[40];
+				// Consecutive timestamps mostly fall into the same
+				// second, so remember the last one's rendering.
+				static thread_local bool have_last = false;
+				static thread_local time_t last_time;
+				static thread_local char buffer[40];
+
 				char buffer2[48];
 				time_t the_time = time_t(floor(val->val.double_val));
 				struct tm t;
 
-				if ( ! gmtime_r(&the_time, &t) ||
-				     ! strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &t) )
+				if ( ( ! have_last || the_time != last_time ) &&
+				     ( ! gmtime_r(&the_time, &t) ||
+				       ! strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &t) ) )
 					{
+					have_last = false;
+
 					GetThread()->Error(GetThread()->Fmt("json formatter: failure getting time: (%lf)", val->val.double_val));
 					// This was a failure, doesn't really matter what gets put here
 					// but it should probably stand out...
@@ -146,6 +156,9 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 					}
 				else
 					{
+					have_last = true;
+					last_time = the_time;
+
 					double integ;
 					double frac = modf(val->val.double_val, &integ);
 
@@ -39,6 +39,12 @@
 # include <malloc.h>
 #endif
 
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
 #include <string>
 #include <array>
 #include <vector>
@@ -2413,6 +2419,60 @@ char* zeekenv(const char* name)
 	return val;
 	}
 
+// Returns the length of the run of bytes at the start of the data that
+// json_escape_utf8() copies as they are without looking at them more
+// closely: ASCII characters other than control characters. This checks
+// 32 or 16 bytes at a time where the CPU supports it, and 8 otherwise.
+static size_t json_plain_run(const unsigned char* data, size_t len)
+	{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	// As a signed comparison, this catches bytes >= 0x80 as well.
+	const __m256i limit32 = _mm256_set1_epi8(0x20);
+
+	for ( ; i + 32 <= len; i += 32 )
+		{
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		auto m = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(limit32, v)));
+
+		if ( m )
+			return i + __builtin_ctz(m);
+		}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i limit16 = _mm_set1_epi8(0x20);
+
+	for ( ; i + 16 <= len; i += 16 )
+		{
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		auto m = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmplt_epi8(v, limit16)));
+
+		if ( m )
+			return i + __builtin_ctz(m);
+		}
+#else
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t highs = 0x8080808080808080ULL;
+
+	for ( ; i + 8 <= len; i += 8 )
+		{
+		uint64_t w;
+		memcpy(&w, data + i, sizeof(w));
+
+		// Any byte with the high bit set, or below 0x20.
+		if ( (w & highs) || ((w - ones * 0x20) & ~w & highs) )
+			break;
+		}
+#endif
+
+	while ( i < len && data[i] >= 0x20 && data[i] < 0x80 )
+		++i;
+
+	return i;
+	}
+
 static string json_escape_byte(char c)
 	{
 	char hex[2] = {'0', '0'};
@@ -2483,6 +2543,18 @@ TEST_CASE("util json_escape_utf8")
 	// Invalid 4 Octet Sequence (too short)
 	CHECK(json_escape_utf8("\xf4\x80\x8c") == "\\xf4\\x80\\x8c");
 	CHECK(json_escape_utf8("\xf0") == "\\xf0");
+
+	// Strings long enough to be scanned in blocks, with bytes to escape
+	// at and around block boundaries.
+	std::string plain(70, 'a');
+	CHECK(json_escape_utf8(plain) == plain);
+	CHECK(json_escape_utf8(plain + "\x82") == plain + "\\x82");
+	CHECK(json_escape_utf8(plain.substr(0, 15) + "\x82" + plain.substr(0, 16)) ==
+	      plain.substr(0, 15) + "\\x82" + plain.substr(0, 16));
+	CHECK(json_escape_utf8(plain.substr(0, 31) + "\xc3\xb1" + plain.substr(0, 33)) ==
+	      plain.substr(0, 31) + "\xc3\xb1" + plain.substr(0, 33));
+	CHECK(json_escape_utf8(plain.substr(0, 7) + "\x07" + plain.substr(0, 40) + "\x7f") ==
+	      plain.substr(0, 7) + "\\x07" + plain.substr(0, 40) + "\x7f");
 	}
 
 string json_escape_utf8(const string& val)
@@ -2498,6 +2570,17 @@ string json_escape_utf8(const string& val)
 	size_t idx;
 	for ( idx = 0; idx < val_size; )
 		{
+		// Most strings consist of printable ASCII characters only, so
+		// copy runs of those in one go.
+		size_t run = json_plain_run(val_data + idx, val_size - idx);
+
+		if ( run > 0 )
+			{
+			result.append(val, idx, run);
+			idx += run;
+			continue;
+			}
+
 		const char ch = val[idx];
 
 		// Normal ASCII characters plus a few of the control characters can be inserted directly. The